@@ -55,12 +55,17 @@
 #define	EDOM		 0xf76aa1d2u	/* Math argument out of domain of func */
 #define	ERANGE		 0xf8110a2du	/* Math result not representable */
 #define ENOTSUP      0xfbacfec0u    /* operation not supported */
+#define EOVERFLOW    0xfc56a31bu    /* Value too large for defined data type */
+#define ETIMEDOUT    0xfd2b8e65u    /* Connection timed out */
 
 int __shield_errno_location(void);
 
 /* substituing errno only when not in UT*/
 #define errno shield_errno
 
+#else
+/* UT mode: libshield sources use the host error codes */
+#include <errno.h>
 #endif
 
 
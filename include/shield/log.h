@@ -0,0 +1,96 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#ifndef SHIELD_LOG_H
+#define SHIELD_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * Deferred binary logging (libshield built with CONFIG_LOG_BINARY).
+ *
+ * shield_log() is used as printf(), but nothing is formatted on target: the format
+ * string, which must be a string literal, is stored in the shield_log_fmt section, and
+ * the call only records the format string identifier (its offset in this section) and
+ * the raw argument values in a log buffer. The buffer is emitted to the debug output
+ * when full, by shield_log_flush(), before any printf() output and at task exit.
+ *
+ * The text is rebuilt on the host by tools/shield-logdecode.py, from the debug output
+ * and the task ELF file. The shield_log_fmt section is not loaded on target (INFO
+ * section in the libshield linker scripts), so the format strings do not use any flash.
+ *
+ * Arguments are integers, chars or pointers, up to 8 per call. A %s argument is
+ * recorded as the string address, its content is not emitted. Floating point is not
+ * supported.
+ */
+
+/** @def maximum number of arguments of a shield_log() call */
+#define SHIELD_LOG_MAX_ARGS 8
+
+/**
+ * @brief record a log entry in the log buffer
+ *
+ * Not to be called directly, see shield_log().
+ *
+ * @param id[in]: format string identifier
+ * @param words[in]: argument values, as 32 bits words, 64 bits values being made of two words
+ * @param nwords[in]: number of words
+ */
+void __shield_log_write(uint32_t id, const uint32_t *words, size_t nwords);
+
+/**
+ * @brief emit the log buffer content to the debug output
+ */
+void shield_log_flush(void);
+
+/** start of the format strings section, defined by the linker */
+extern const char __start_shield_log_fmt[];
+
+#define __SHIELD_LOG_CAT_(a, b) a##b
+#define __SHIELD_LOG_CAT(a, b) __SHIELD_LOG_CAT_(a, b)
+
+#define __SHIELD_LOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+#define __SHIELD_LOG_NARGS(...) __SHIELD_LOG_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+
+#define __SHIELD_LOG_MAP0(m)
+#define __SHIELD_LOG_MAP1(m, a) m(a)
+#define __SHIELD_LOG_MAP2(m, a, ...) m(a) __SHIELD_LOG_MAP1(m, __VA_ARGS__)
+#define __SHIELD_LOG_MAP3(m, a, ...) m(a) __SHIELD_LOG_MAP2(m, __VA_ARGS__)
+#define __SHIELD_LOG_MAP4(m, a, ...) m(a) __SHIELD_LOG_MAP3(m, __VA_ARGS__)
+#define __SHIELD_LOG_MAP5(m, a, ...) m(a) __SHIELD_LOG_MAP4(m, __VA_ARGS__)
+#define __SHIELD_LOG_MAP6(m, a, ...) m(a) __SHIELD_LOG_MAP5(m, __VA_ARGS__)
+#define __SHIELD_LOG_MAP7(m, a, ...) m(a) __SHIELD_LOG_MAP6(m, __VA_ARGS__)
+#define __SHIELD_LOG_MAP8(m, a, ...) m(a) __SHIELD_LOG_MAP7(m, __VA_ARGS__)
+#define __SHIELD_LOG_MAP(m, ...) \
+    __SHIELD_LOG_CAT(__SHIELD_LOG_MAP, __SHIELD_LOG_NARGS(__VA_ARGS__))(m, ##__VA_ARGS__)
+
+/*
+ * Each argument is stored with its promoted type (as for a variadic call), as one word,
+ * or two words for 64 bits types.
+ */
+#define __SHIELD_LOG_ARG(a) { \
+    const __typeof__((a) + 0) __shield_log_arg = (a); \
+    __builtin_memcpy(&__shield_log_words[__shield_log_nwords], &__shield_log_arg, sizeof(__shield_log_arg)); \
+    __shield_log_nwords += (sizeof(__shield_log_arg) + sizeof(uint32_t) - 1) / sizeof(uint32_t); \
+}
+
+#define shield_log(fmt, ...) do { \
+    static const char __shield_log_fmt_str[] __attribute__((section("shield_log_fmt"))) = fmt; \
+    uint32_t __shield_log_words[(2 * __SHIELD_LOG_NARGS(__VA_ARGS__)) + 1]; \
+    size_t __shield_log_nwords = 0; \
+    __SHIELD_LOG_MAP(__SHIELD_LOG_ARG, ##__VA_ARGS__) \
+    __shield_log_write((uint32_t)((uintptr_t)__shield_log_fmt_str - (uintptr_t)__start_shield_log_fmt), \
+                       __shield_log_words, __shield_log_nwords); \
+} while (0)
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif/*!SHIELD_LOG_H*/
@@ -0,0 +1,54 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#ifndef SHIELD_POLL_H
+#define SHIELD_POLL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * libshield events multiplexer (non-POSIX).
+ *
+ * shield_poll() allows a single threaded task to serve IPC (SysV messages),
+ * signals and timers from a single loop, with one syscall per wakeup:
+ *
+ * int revents;
+ * while (1) {
+ *     shield_poll(SHIELD_POLL_IPC | SHIELD_POLL_SIG | SHIELD_POLL_TIMER, &revents, -1);
+ *     if (revents & SHIELD_POLL_TIMER) {
+ *         shield_timer_dispatch();
+ *     }
+ *     if (revents & SHIELD_POLL_SIG) {
+ *         sigpending(&set);
+ *         ...
+ *     }
+ *     if (revents & SHIELD_POLL_IPC) {
+ *         msgrcv(qid, buf, sizeof(buf), 0, IPC_NOWAIT);
+ *         ...
+ *     }
+ * }
+ */
+
+#define SHIELD_POLL_IPC    0x1  /* at least one IPC is pending, msgrcv() does not block */
+#define SHIELD_POLL_SIG    0x2  /* at least one signal is pending, see sigpending() */
+#define SHIELD_POLL_TIMER  0x4  /* at least one timer callback waits for shield_timer_dispatch() */
+
+/**
+ * @fn wait for at least one of the requested events to be ready
+ *
+ * @param events[in]: mask of requested events (SHIELD_POLL_*)
+ * @param revents[out]: mask of ready events, may hold events that were not requested
+ * @param timeout[in]: in milliseconds, -1 to wait forever, 0 to return immediately
+ *
+ * @return the number of ready requested event types, 0 on timeout, or -1 with errno set
+ */
+int shield_poll(int events, int *revents, int timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!SHIELD_POLL_H*/
@@ -14,8 +14,28 @@ extern "C" {
 #include <inttypes.h>
 #include <stdbool.h>
 
+/**
+ * printf() family. Formatted output is written to the debug output (printf(), vprintf(),
+ * vdprintf() on stdout or stderr), streamed by chunks of CONFIG_PRINTF_BUF_LEN bytes, or
+ * directly in the caller buffer (snprintf(), vsnprintf()).
+ *
+ * snprintf() and vsnprintf() truncate the output to len - 1 chars, always terminated with a
+ * null char if len is not 0, and return the length of the untruncated output.
+ */
 __attribute__ ((format (printf, 1, 2))) int printf(const char *fmt, ...);
 __attribute__ ((format (printf, 3, 4))) int snprintf(char *dest, size_t len, const char *fmt, ...);
+__attribute__ ((format (printf, 1, 0))) int vprintf(const char *fmt, va_list ap);
+__attribute__ ((format (printf, 2, 0))) int vdprintf(int fd, const char *fmt, va_list ap);
+__attribute__ ((format (printf, 3, 0))) int vsnprintf(char *dest, size_t len, const char *fmt, va_list ap);
+
+#ifdef TEST_MODE
+/* no aliasing */
+__attribute__ ((format (printf, 1, 2))) int shield_printf(const char *fmt, ...);
+__attribute__ ((format (printf, 3, 4))) int shield_snprintf(char *dest, size_t len, const char *fmt, ...);
+__attribute__ ((format (printf, 1, 0))) int shield_vprintf(const char *fmt, va_list ap);
+__attribute__ ((format (printf, 2, 0))) int shield_vdprintf(int fd, const char *fmt, va_list ap);
+__attribute__ ((format (printf, 3, 0))) int shield_vsnprintf(char *dest, size_t len, const char *fmt, va_list ap);
+#endif
 
 #if defined(__cplusplus)
 }
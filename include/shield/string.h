@@ -31,7 +31,7 @@ void *memset(void *s, int c, size_t n);
 #else
 /* no aliasing */
 size_t shield_strlen(const char *s);
-size_t shield_strnlen(const char *s, size_t len)
+size_t shield_strnlen(const char *s, size_t len);
 char *shield_strcpy(char *dest, const char *src);
 int shield_strcmp(const char *str1, const char *str2);
 
@@ -6,26 +6,43 @@
 #define SYS_MSG_H_
 /*
  * This is a ligthway, high performance implementation of the POSIX message passing service.
- * There is, by now, no effective userspace queueing but only kernel queueing and IPC handling.
+ * Received messages are queued in userspace per source task (up to CONFIG_STD_POSIX_SYSV_MSQ_DEPTH
+ * messages each), on top of kernel queueing and IPC handling.
  * The goal here is to abstract the EwoK kernel IPC complexity into a user-friendly interface
  * without reducing their performances.
  *
  * Although, for a more intelligent message passing mechanism (i.e. effective userspace bus)
  * check the liberpes (RPC implementation) instead.
+ *
+ * Wire format: a message is emitted as one or more IPCs, each starting with a 4 bytes
+ * fragment header (message id, flags, offset in the message, little endian), followed by
+ * a part of the message (mtype, then mtext). Even a message held by a single IPC carries
+ * this header. This breaks the compatibility with the former format (raw mtype and mtext
+ * in a single IPC): both peers must be built with this libshield version, IPCs that are
+ * not message fragments being silently dropped at reception.
  */
 
 #include <uapi.h>
+#include <shield/sys/uio.h>
+#include <shield/time.h>
 
 /* messaging mode */
 #define MSG_NOERROR    010000 /* truncate silently message if too long */
 #define MSG_EXCEPT     020000 /* recv any msg excepting specifyed type */
 #define MSG_COPY       040000 /* copy instead of removing queued msg (NOT SUPPORTED) */
+#define MSG_CONFLATE   0100000 /* msgget(): latest-value queue, a msg replaces the unread one of same type (non-POSIX) */
+#define MSG_ABSTIME    0200000 /* timed calls: absolute CLOCK_MONOTONIC timeout (non-POSIX) */
+#define MSG_COMPRESS   0400000 /* send calls: emit the msg LZ-compressed if smaller (non-POSIX) */
 
 #define IPC_CREAT	01000		/* Create key if key does not exist. */
 #define IPC_EXCL	02000		/* Fail if key exists.  */
 #define IPC_NOWAIT	04000		/* Do not wait, return with EAGAIN flag in case of error */
 #define IPC_PRIVATE 0           /* key identifier to create new msgq */
 
+/* msgctl() commands */
+#define IPC_RMID    0           /* remove the queue */
+#define IPC_STAT    2           /* get back the queue status and statistics */
+
 /* generic IPC key_t for EwoK IPC (remote task name) */
 typedef taskh_t key_t;
 
@@ -38,11 +55,11 @@ typedef long ssize_t;
  * is the same:
  * msgsnd() must send typed messages (i.e. data containing a mtype field
  * in its first 4 bytes)
- * msgrcv() get back the mtext content directly, without the mtype field,
- * as the type is requested in argument.
+ * msgrcv() get back the overall struct msgbuf (mtype and mtext), and
+ * returns the number of bytes copied into mtext.
  *
  * The message queue handles messages while not requested by msgrcv() in a
- * local cache.
+ * local per-source queue, in arrival order.
  * Usual SysV message flags (see above) can be used to modify the API behavior
  * w. respect for the POSIX standard. */
 struct msgbuf {
@@ -50,6 +67,50 @@ struct msgbuf {
     char mtext[1];
 };
 
+/**
+ * @def number of residence latency histogram buckets
+ *
+ * bucket 0 counts messages consumed at reception (never queued, or latency < 1us), bucket n
+ * counts latency in [2^(n-1), 2^n[ us, the last bucket counts all latency greater than 2^22 us.
+ */
+#define MSG_STATS_HIST_LEN 24
+
+/*
+ * queue status and statistics, see msgctl(IPC_STAT)
+ *
+ * Received messages are accounted when consumed (msgrcv(), msgrcv_borrow(), msgrcv_batch(),
+ * msgdispatch()). msg_stime, msg_rtime and msg_lat_* fields are only recorded when libshield
+ * is built with CONFIG_STD_POSIX_SYSV_MSG_STATS, they are kept to 0 otherwise. The structure
+ * layout does not depend on the configuration.
+ */
+struct msqid_ds {
+    key_t          msg_key;       /* queue key (peer task handle) */
+    unsigned long  msg_qnum;      /* number of messages currently queued */
+    unsigned long  msg_qmax;      /* queue depth */
+    unsigned long  msg_qhwm;      /* highest number of queued messages (high-water mark) */
+    time_t         msg_stime;     /* time of last emitted message (s, CLOCK_MONOTONIC) */
+    time_t         msg_rtime;     /* time of last consumed message (s, CLOCK_MONOTONIC) */
+    uint32_t       msg_snd_count; /* emitted messages */
+    uint32_t       msg_snd_bytes; /* emitted mtext bytes */
+    uint32_t       msg_snd_drops; /* outbound queued messages refused by the kernel */
+    uint32_t       msg_rcv_count; /* consumed messages */
+    uint32_t       msg_rcv_bytes; /* consumed mtext bytes */
+    uint32_t       msg_drops;     /* received messages dropped (incomplete, oversized, superseded) */
+    uint32_t       msg_e2big;     /* calls rejected with E2BIG */
+    uint32_t       msg_lat_count; /* number of recorded residence latencies */
+    uint32_t       msg_lat_max_us; /* worst residence latency, in us */
+    uint32_t       msg_lat_hist[MSG_STATS_HIST_LEN]; /* log2 scale residence latency histogram */
+};
+
+/*
+ * received message descriptor, see msgrcv_batch()
+ */
+struct msgdesc {
+    int                  msqid; /* queue the message has been received on */
+    const struct msgbuf  *msg;  /* message (mtype and mtext), read-only */
+    size_t               msgsz; /* mtext size */
+};
+
 /*
  * As the following API tries to be rspectful of the POSIX API, return codes and arguments do
  * not used embedded oriented types (typically mbed_error_t and so on).
@@ -67,6 +128,15 @@ struct msgbuf {
  *
  * msgget(taskh, 0);
  *
+ * latest-value queue, for state publishers faster than the receiver:
+ *
+ * msgget(taskh, IPC_CREAT | MSG_CONFLATE);
+ *
+ * A message received on such a queue replaces, at its queue position, the unread message
+ * of the same type if any, so that the queue holds at most one message per type, always
+ * the latest one. The pending IPCs are queued before each receive selection. MSG_CONFLATE
+ * is only considered when the queue is created.
+ *
  * @return msgqid, or -1, with errno set
  */
 int msgget(key_t key, int msgflg);
@@ -76,9 +146,91 @@ int msgget(key_t key, int msgflg);
  *
  * sending a message without blocking
  * msgsnd(qid, buf, msize, IPC_NOWAIT);
+ *
+ * The message is emitted in the fragmented wire format described above, that the receiver
+ * must support.
+ *
+ * With CONFIG_STD_POSIX_SYSV_TXQ, a message that can't be emitted yet in IPC_NOWAIT mode
+ * is queued locally, see msgsnd_flush().
+ *
+ * With CONFIG_STD_POSIX_SYSV_LZ, MSG_COMPRESS (also supported by msgsndv(), msgsnd_timed()
+ * and msgsnd_multi()) emits the message compressed if compression makes it smaller,
+ * reducing the number of IPCs of big repetitive messages (e.g. structured records). Decompression
+ * is transparent at reception, the receiver being built with CONFIG_STD_POSIX_SYSV_LZ too
+ * (compressed messages are dropped otherwise). Without CONFIG_STD_POSIX_SYSV_LZ,
+ * MSG_COMPRESS is ignored.
  */
 int msgsnd(int msqid, const void *msgp, size_t msgsz, int msgflg);
 
+/**
+ * @fn Send a message made of several fragments to the given queue (non-POSIX)
+ *
+ * The message is the concatenation of the iovcnt fragments, that must start with
+ * the mtype field. It is assembled directly in the kernel exchange area, there
+ * is no need for a contiguous user buffer:
+ *
+ * long mtype = MY_TYPE;
+ * struct iovec iov[3] = {
+ *     { .iov_base = &mtype, .iov_len = sizeof(mtype) },
+ *     { .iov_base = &header, .iov_len = sizeof(header) },
+ *     { .iov_base = payload, .iov_len = payload_len },
+ * };
+ * msgsndv(qid, iov, 3, 0);
+ *
+ * @return 0, or -1 with errno set (E2BIG if the mtext is bigger than CONFIG_MAX_SYSV_MSG_LEN)
+ */
+int msgsndv(int msqid, const struct iovec *iov, int iovcnt, int msgflg);
+
+/**
+ * @fn Send a message, retrying for at most the given timeout while the destination is busy (non-POSIX)
+ *
+ * Same timeout semantics as msgrcv_timed(). The other events received while waiting
+ * for the destination are kept pending.
+ *
+ * @return 0, or -1 with errno set (ETIMEDOUT if the destination stayed busy)
+ */
+int msgsnd_timed(int msqid, const void *msgp, size_t msgsz, int msgflg, const struct timespec *timeout);
+
+/**
+ * @fn Send the same message to several queues (non-POSIX)
+ *
+ * Same as calling msgsnd() for each of the n (up to 32) queues of msqids, except that
+ * the message is checked and copied to the kernel exchange area only once (once per
+ * fragment for a message bigger than a single IPC), for all the destinations:
+ *
+ * int qids[3] = { q_a, q_b, q_c };
+ * int errs[3];
+ * if (msgsnd_multi(qids, 3, &state, sizeof(state.mtext), errs, IPC_NOWAIT) < 3) {
+ *     // errs[i] is the errno value of the failed destination i, 0 for the other ones
+ * }
+ *
+ * @param errs[out]: per destination status, 0 or errno value (EINVAL, EPERM, EACCES,
+ *        EAGAIN), may be NULL
+ *
+ * @return the number of destinations the message has been sent to, or -1 with errno set
+ *         if nothing has been sent (EFAULT, EINVAL, E2BIG). E2BIG is counted in the
+ *         statistics of each valid destination, see msgctl(IPC_STAT).
+ */
+int msgsnd_multi(const int *msqids, size_t n, const void *msgp, size_t msgsz, int *errs, int msgflg);
+
+/**
+ * @fn Emit the messages queued for the given queue while its destination was busy (non-POSIX)
+ *
+ * With CONFIG_STD_POSIX_SYSV_TXQ, msgsnd() and msgsndv() in IPC_NOWAIT mode queue the
+ * message locally instead of failing with EAGAIN when the destination is busy (or when
+ * previous messages are still queued), so that messages are never reordered nor lost
+ * under transient congestion. Queued messages are emitted at the next send on the same
+ * queue, at each shield_poll() wakeup, or explicitly (e.g. from a timer callback):
+ *
+ * if (msgsnd_flush(qid) > 0) {
+ *     // destination still busy
+ * }
+ *
+ * @return the number of messages still queued (always 0 without CONFIG_STD_POSIX_SYSV_TXQ),
+ *         or -1 with errno set
+ */
+int msgsnd_flush(int msqid);
+
 /*
  * Receive a message from the given queue
  *
@@ -88,14 +240,143 @@ int msgsnd(int msqid, const void *msgp, size_t msgsz, int msgflg);
  * msgrcv(qid, buf, msgsz, MAGIC_TYPE_X, IPC_NOWAIT| MSG_NOERROR|MSG_EXCEPT);
  *
  * Receive a message of type MAGIC_TYPE_Y only, that can't be truncated.
- * Blocks if no corresponding message upto cache full (in that case return with ENOMEM).
+ * Blocks if no corresponding message upto queue full (in that case return with ENOMEM).
  * If a message of the corresponding type exists but is too big, return with E2BIG.
  *
  * msgrcv(qid, bug, msgsz, MAGIC_TYPE_Y, 0);
  *
+ * Receive the message of the lowest type (i.e. highest priority) among the
+ * types in [1, PRIO_LOWEST], blocking if none.
+ *
+ * msgrcv(qid, buf, msgsz, -PRIO_LOWEST, 0);
+ *
+ * Only messages in the fragmented wire format described above are received, other IPCs
+ * from the queue source are dropped.
  */
 ssize_t msgrcv(int msqid, void *msgp, size_t msgsz, long msgtyp,
                int msgflg);
 
+/**
+ * @fn Receive a message, waiting for at most the given timeout (non-POSIX)
+ *
+ * Same as msgrcv() in blocking mode, the wait being bounded by timeout: a relative
+ * duration, or, with MSG_ABSTIME, an absolute CLOCK_MONOTONIC time (see clock_gettime()).
+ * Timeouts are rounded up to the millisecond. An already pending message is received
+ * even if the timeout has expired.
+ *
+ * struct timespec ts = { .tv_sec = 0, .tv_nsec = 50000000 };
+ * if (msgrcv_timed(qid, &buf, sizeof(buf.mtext), 0, 0, &ts) < 0 && errno == ETIMEDOUT) {
+ *     ...
+ * }
+ *
+ * @return the mtext size, or -1 with errno set (ETIMEDOUT if no message has been received)
+ */
+ssize_t msgrcv_timed(int msqid, void *msgp, size_t msgsz, long msgtyp, int msgflg,
+                     const struct timespec *timeout);
+
+/**
+ * @fn Receive a message without copying it (non-POSIX)
+ *
+ * Same selection and flags as msgrcv(), except MSG_NOERROR that is meaningless here.
+ * Instead of copying the message, a read-only pointer to it is returned in msgp: the
+ * message is lent either directly from the kernel exchange area (no copy at all) or from
+ * the local queue. Only one message can be lent at a time per queue (EBUSY otherwise).
+ *
+ * The message must be given back with msgrcv_release(). It is valid up to this call, and,
+ * if lent from the kernel exchange area, up to the next libshield call that waits for or
+ * sends an event (msgsnd(), msgrcv(), sigpending(), shield_poll()...), whichever comes first.
+ *
+ * const struct msgbuf *msg;
+ * ssize_t len = msgrcv_borrow(qid, &msg, 0, 0);
+ * handle(msg->mtype, msg->mtext, len);
+ * msgrcv_release(qid);
+ *
+ * @return the mtext size, or -1 with errno set
+ */
+ssize_t msgrcv_borrow(int msqid, const struct msgbuf **msgp, long msgtyp, int msgflg);
+
+/**
+ * @fn Give back the message lent by msgrcv_borrow() on the given queue (non-POSIX)
+ *
+ * @return 0, or -1 with errno set (EINVAL if no message is lent)
+ */
+int msgrcv_release(int msqid);
+
+/**
+ * @fn Receive all the pending messages, of all queues, at once (non-POSIX)
+ *
+ * All the IPCs pending in the kernel are received (blocking up to a queued message,
+ * unless IPC_NOWAIT is set), and queued in their source queue.
+ * Then up to count queued messages are lent, through descs, in arrival order for each
+ * queue. As for msgrcv_borrow(), messages are not copied and must be given back with
+ * msgrcv_batch_release() once handled. They are no more selectable by msgrcv() meanwhile.
+ *
+ * struct msgdesc descs[8];
+ * ssize_t num = msgrcv_batch(descs, 8, 0);
+ * for (ssize_t i = 0; i < num; ++i) {
+ *     handle(descs[i].msqid, descs[i].msg->mtype, descs[i].msg->mtext, descs[i].msgsz);
+ * }
+ * msgrcv_batch_release(descs, num);
+ *
+ * @return the number of lent messages, or -1 with errno set (EAGAIN if none)
+ */
+ssize_t msgrcv_batch(struct msgdesc *descs, size_t count, int msgflg);
+
+/**
+ * @fn Give back the messages lent by msgrcv_batch() (non-POSIX)
+ *
+ * @return 0, or -1 with errno set (EINVAL on an invalid descriptor, nothing being released)
+ */
+int msgrcv_batch_release(const struct msgdesc *descs, size_t count);
+
+
+/**
+ * message handler, see msgroute(). msg is read-only, and is valid up to the handler return.
+ * A message dispatched in place (in the kernel exchange area) is overwritten by any libshield
+ * call that sends or waits for an event: it must be read (or copied) before such a call.
+ */
+typedef void (*msg_handler_t)(int msqid, const struct msgbuf *msg, size_t msgsz, void *arg);
+
+/**
+ * @fn Register the handler of the messages of type mtype received on the given queue (non-POSIX)
+ *
+ * mtype 0 registers the default handler of the queue, called for the types without their
+ * own handler. A NULL handler removes the route. Messages without handler are kept queued,
+ * for msgrcv(). Routes are looked up in a hash table of CONFIG_STD_POSIX_SYSV_ROUTES entries.
+ *
+ * msgroute(qid, MSG_TYPE_CMD, on_cmd, &ctx);
+ * msgroute(qid, MSG_TYPE_STATE, on_state, &ctx);
+ * while (1) {
+ *     msgdispatch(0);
+ * }
+ *
+ * @return 0, or -1 with errno set (ENOMEM if the router table is full, ENOENT when
+ *         removing a route that does not exist)
+ */
+int msgroute(int msqid, long mtype, msg_handler_t handler, void *arg);
+
+/**
+ * @fn Dispatch all the received messages to their handler (non-POSIX)
+ *
+ * Queued messages are dispatched first, and then all the pending IPCs, in arrival order
+ * for each queue (blocking up to a dispatched message, unless IPC_NOWAIT is set). Messages
+ * without handler are kept queued and do not end the wait.
+ *
+ * @return the number of dispatched messages, or -1 with errno set (EAGAIN if none)
+ */
+ssize_t msgdispatch(int msgflg);
+
+/**
+ * @fn Queue control
+ *
+ * - IPC_STAT: copy the queue status and statistics to buf. The residence latency is the
+ *   time between the reception of a message by the task and its consumption: a slow
+ *   consumer shows up as a high latency and a high msg_qhwm.
+ * - IPC_RMID: remove the queue, its queued messages and its routes. Fails with EBUSY if a
+ *   message of the queue is lent (msgrcv_borrow(), msgrcv_batch()).
+ *
+ * @return 0, or -1 with errno set
+ */
+int msgctl(int msqid, int cmd, struct msqid_ds *buf);
 
 #endif/*!SYS_MSG_H_*/
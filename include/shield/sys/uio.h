@@ -0,0 +1,18 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#ifndef SHIELD_SYS_UIO_H_
+#define SHIELD_SYS_UIO_H_
+
+#include <stddef.h>
+
+/**
+ * @brief scatter/gather I/O vector element, as defined by POSIX
+ */
+struct iovec {
+    void   *iov_base; /**< base address of the fragment */
+    size_t iov_len;   /**< fragment length */
+};
+
+#endif/*!SHIELD_SYS_UIO_H_*/
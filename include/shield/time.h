@@ -9,6 +9,7 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
 #include <shield/signal.h>
 
 /**
@@ -52,6 +53,23 @@ struct itimerspec {
     struct timespec it_value;
 };
 
+/**
+ * @def POSIX compliant broken-down time structure definition
+ *
+ * Only UTC is supported, tm_isdst is always 0.
+ */
+struct tm {
+    int tm_sec;    /* seconds [0, 60] */
+    int tm_min;    /* minutes [0, 59] */
+    int tm_hour;   /* hours [0, 23] */
+    int tm_mday;   /* day of month [1, 31] */
+    int tm_mon;    /* month of year [0, 11] */
+    int tm_year;   /* years since 1900 */
+    int tm_wday;   /* day of week [0, 6] (Sunday = 0) */
+    int tm_yday;   /* day of year [0, 365] */
+    int tm_isdst;  /* daylight savings flag */
+};
+
 
 /*
  * POSIX-1 2001 and POSIX-1 2008 compliant nanosleep() implementation
@@ -89,6 +107,74 @@ int timer_gettime(timer_t timerid, struct itimerspec *curr_value);
  */
 int clock_gettime(clockid_t clockid, struct timespec *tp);
 
+/*
+ * Convert the calendar time timep to broken-down UTC time in result (POSIX API)
+ */
+struct tm *gmtime_r(const time_t *timep, struct tm *result);
+
+/*
+ * Convert the broken-down UTC time tm to calendar time. tm fields are normalized
+ * (GNU/BSD API, inverse of gmtime_r())
+ */
+time_t timegm(struct tm *tm);
+
+/*
+ * Format the broken-down time tm into s, according to format (POSIX API, subset).
+ * Supported conversions: %a %b %d %e %F %H %j %m %M %S %T %y %Y %z %Z %%
+ */
+size_t strftime(char *s, size_t max, const char *format, const struct tm *tm);
+
+/*
+ * libshield extensions (non-POSIX)
+ */
+
+/**
+ * @def number of lateness histogram buckets
+ *
+ * bucket 0 counts expirations on time (lateness < 1us), bucket n counts lateness
+ * in [2^(n-1), 2^n[ us, the last bucket counts all lateness greater than 2^14 us.
+ */
+#define SHIELD_TIMER_STATS_HIST_LEN 16
+
+/**
+ * @def per timer statistics, see shield_timer_stats()
+ *
+ * late_* fields are only recorded when libshield is built with CONFIG_TIMER_STATS,
+ * they are kept to 0 otherwise. The structure layout does not depend on the
+ * configuration.
+ */
+struct shield_timer_stats {
+    uint64_t cb_total_us;  /* cumulated SIGEV_THREAD callback execution time, in us */
+    uint32_t cb_count;     /* number of executed callbacks */
+    uint32_t cb_last_us;   /* last callback execution time, in us */
+    uint32_t cb_max_us;    /* worst callback execution time, in us */
+    uint32_t cb_overruns;  /* expirations coalesced while the callback was still pending */
+    uint32_t late_count;   /* number of recorded expirations */
+    uint32_t late_max_us;  /* worst expiration lateness, in us, saturated to UINT32_MAX */
+    uint32_t late_overruns; /* expirations late by at least a whole period */
+    uint32_t late_hist[SHIELD_TIMER_STATS_HIST_LEN]; /* log2 scale lateness histogram */
+};
+
+/*
+ * SIGEV_THREAD timers callbacks are not executed by the timer handler. Expired
+ * timers are queued and their callbacks are executed earliest deadline first, by
+ * libshield on return from its blocking waits (msgrcv() family, msgsnd() retries,
+ * sigpending(), nanosleep(), shield_poll() without SHIELD_POLL_TIMER), or by
+ * shield_timer_dispatch(), that a task polling SHIELD_POLL_TIMER calls from its
+ * event loop. Return the number of executed callbacks.
+ */
+int shield_timer_dispatch(void);
+
+/*
+ * Get back the statistics of the given timer in stats.
+ */
+int shield_timer_stats(timer_t timerid, struct shield_timer_stats *stats);
+
+/*
+ * Print the statistics of the given timer on the debug output.
+ */
+int shield_timer_stats_dump(timer_t timerid);
+
 #ifdef __cplusplus
 }
 #endif
@@ -7,6 +7,9 @@
 #include <uapi.h>
 #include "libc_init.h"
 #include "../include/shield/private/rand.h"
+#if CONFIG_LOG_BINARY
+#include <shield/log.h>
+#endif
 
 /**
  * Canari variable, as defined in LLVM & GCC compiler documentation, in order to
@@ -36,6 +39,9 @@ _start(uint32_t const thread_id, uint32_t const seed)
     __shield_rand_set_seed(seed);
     /* calling thread entrypoint. the main function being implemented out of this file, SSP is active */
     task_ret = main();
+#if CONFIG_LOG_BINARY
+    shield_log_flush();
+#endif
     /* End of thread, store exit value in kernel thread information */
 #if CONFIG_WITH_SENTRY
     __sys_exit(task_ret);
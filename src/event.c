@@ -0,0 +1,292 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <shield/string.h>
+#include <shield/signal.h>
+#include <shield/errno.h>
+#include <shield/poll.h>
+#include <shield/private/coreutils.h>
+#include <shield/private/errno.h>
+#include <shield/private/event.h>
+#include <shield/private/msg.h>
+#include <shield/private/timer.h>
+#include <uapi.h>
+
+/**
+ * a pending event, as delivered by the kernel in the SVC exchange area
+ */
+typedef struct event_slot {
+    _Alignas(uint32_t) uint8_t raw[CONFIG_SVC_EXCHANGE_AREA_LEN];
+} event_slot_t;
+
+/**
+ * events demultiplexer context: per event type pending queues
+ */
+typedef struct event_context {
+    event_slot_t ipc[SHIELD_EVENT_IPC_DEPTH];
+    uint8_t      ipc_head;
+    uint8_t      ipc_count;
+    /** bit n set for pending signal n */
+    uint32_t     signals;
+} event_context_t;
+
+/* .bss based, init to 0 */
+static event_context_t event_ctx;
+
+/**
+ * @brief event types to wait for, depending on pending queues state
+ *
+ * When the IPC FIFO is full, IPCs are kept in the kernel queue.
+ */
+static inline uint8_t __event_wait_mask(void)
+{
+    uint8_t mask = EVENT_TYPE_SIGNAL;
+    if (likely(event_ctx.ipc_count < SHIELD_EVENT_IPC_DEPTH)) {
+        mask |= EVENT_TYPE_IPC;
+    }
+    return mask;
+}
+
+/**
+ * @brief route the event received in the SVC exchange area to its pending queue
+ */
+static void __event_route(const exchange_event_t *event)
+{
+    uint32_t signal;
+    size_t len;
+    event_slot_t *slot;
+
+    switch (event->type) {
+        case EVENT_TYPE_IPC:
+            /* free space is guaranteed by __event_wait_mask() */
+            slot = &event_ctx.ipc[(event_ctx.ipc_head + event_ctx.ipc_count) % SHIELD_EVENT_IPC_DEPTH];
+            len = sizeof(exchange_event_t) + event->length;
+            if (unlikely(len > CONFIG_SVC_EXCHANGE_AREA_LEN)) {
+                len = CONFIG_SVC_EXCHANGE_AREA_LEN;
+            }
+            memcpy(&slot->raw[0], event, len);
+            event_ctx.ipc_count++;
+            break;
+        case EVENT_TYPE_SIGNAL:
+            memcpy(&signal, &event->data[0], sizeof(uint32_t));
+            if (signal == SIGNAL_ALARM && timer_armed()) {
+                /* timers bookkeeping only, callbacks are deferred */
+                timer_handler();
+            } else if (likely(signal > 0 && signal <= _SIGNUM)) {
+                event_ctx.signals |= (1UL << signal);
+            }
+            break;
+        default:
+            /* other event types are not handled by libshield */
+            break;
+    }
+}
+
+/**
+ * @brief wait for an IPC event, for at most timeout, or up to deadline if not NULL
+ *
+ * With a deadline, the remaining time is computed again before each kernel wait, so that
+ * other events received in the meantime do not extend the wait.
+ */
+static Status __event_wait_ipc(int32_t timeout, const uint64_t *deadline, const exchange_event_t **event)
+{
+    Status ret;
+    const exchange_event_t *rcv;
+    uint64_t now;
+
+    if (event_ctx.ipc_count > 0) {
+        /* the event is only valid until the next routed IPC, which may reuse its slot */
+        *event = (const exchange_event_t *)&event_ctx.ipc[event_ctx.ipc_head].raw[0];
+        event_ctx.ipc_head = (event_ctx.ipc_head + 1) % SHIELD_EVENT_IPC_DEPTH;
+        event_ctx.ipc_count--;
+        ret = STATUS_OK;
+        goto end;
+    }
+    do {
+        if (deadline != NULL) {
+            if (unlikely(__shield_time_now_ms(&now) < 0)) {
+                ret = STATUS_DENIED;
+                goto end;
+            }
+            /* deadline reached: last check of the already pending events */
+            timeout = WFE_WAIT_NO;
+            if (now < *deadline) {
+                timeout = ((*deadline - now) > INT32_MAX) ? INT32_MAX : (int32_t)(*deadline - now);
+            }
+        }
+        ret = __sys_wait_for_event(EVENT_TYPE_IPC | EVENT_TYPE_SIGNAL, timeout);
+        if (ret == STATUS_AGAIN && deadline != NULL) {
+            ret = STATUS_TIMEOUT;
+        }
+        if (ret != STATUS_OK) {
+            goto end;
+        }
+        rcv = _memarea_get_svcexcange_event();
+        if (rcv->type == EVENT_TYPE_IPC) {
+            /* requested type, delivered in place */
+            *event = rcv;
+            goto end;
+        }
+        __event_route(rcv);
+        /* no event is held here, expired timers callbacks can be executed */
+        timer_dispatch();
+    } while (1);
+end:
+    return ret;
+}
+
+Status __shield_event_wait_ipc(int32_t timeout, const exchange_event_t **event)
+{
+    return __event_wait_ipc(timeout, NULL, event);
+}
+
+Status __shield_event_wait_ipc_until(uint64_t deadline, const exchange_event_t **event)
+{
+    return __event_wait_ipc(0, &deadline, event);
+}
+
+void __shield_event_ipc_unget(const exchange_event_t *event)
+{
+    event_slot_t *slot;
+    size_t len;
+
+    /* there is at least one free cell: the event has just been popped from the FIFO,
+     * or has been delivered in place while the FIFO was empty */
+    event_ctx.ipc_head = (event_ctx.ipc_head + SHIELD_EVENT_IPC_DEPTH - 1) % SHIELD_EVENT_IPC_DEPTH;
+    slot = &event_ctx.ipc[event_ctx.ipc_head];
+    if ((const uint8_t *)event != &slot->raw[0]) {
+        len = sizeof(exchange_event_t) + event->length;
+        if (unlikely(len > CONFIG_SVC_EXCHANGE_AREA_LEN)) {
+            len = CONFIG_SVC_EXCHANGE_AREA_LEN;
+        }
+        memcpy(&slot->raw[0], event, len);
+    }
+    event_ctx.ipc_count++;
+}
+
+Status __shield_event_fetch(int32_t timeout)
+{
+    Status ret;
+
+    ret = __sys_wait_for_event(__event_wait_mask(), timeout);
+    if (ret == STATUS_OK) {
+        __event_route(_memarea_get_svcexcange_event());
+    }
+    return ret;
+}
+
+bool __shield_event_ipc_pending(void)
+{
+    return (event_ctx.ipc_count > 0);
+}
+
+uint32_t __shield_event_signals_take(void)
+{
+    uint32_t signals = event_ctx.signals;
+    event_ctx.signals = 0;
+    return signals;
+}
+
+uint32_t __shield_event_signals_peek(void)
+{
+    return event_ctx.signals;
+}
+
+/**
+ * @brief current ready events mask, in SHIELD_POLL_* format
+ */
+static inline int __poll_ready(void)
+{
+    int ready = 0;
+    if (__shield_event_ipc_pending() || __shield_msg_pending()) {
+        ready |= SHIELD_POLL_IPC;
+    }
+    if (event_ctx.signals != 0) {
+        ready |= SHIELD_POLL_SIG;
+    }
+    if (timer_pending()) {
+        ready |= SHIELD_POLL_TIMER;
+    }
+    return ready;
+}
+
+int shield_poll(int events, int *revents, int timeout)
+{
+    int errcode = -1;
+    int ready;
+    bool waited = false;
+    uint64_t deadline = 0;
+    uint64_t now;
+    Status ret;
+
+    if (unlikely(revents == NULL)) {
+        __shield_set_errno(EFAULT);
+        goto err;
+    }
+    if (timeout > 0) {
+        /* errno is set by the clock on error */
+        if (unlikely(__shield_time_now_ms(&now) < 0)) {
+            goto err;
+        }
+        deadline = now + (uint64_t)timeout;
+    }
+    do {
+        int32_t wait;
+        /* messages queued for a busy destination are retried at each wakeup */
+        const bool tx_pending = __shield_msg_tx_flush();
+
+        if ((events & SHIELD_POLL_TIMER) == 0) {
+            /* timers callbacks are not dispatched by the caller */
+            timer_dispatch();
+        }
+        ready = __poll_ready();
+        if ((ready & events) != 0) {
+            break;
+        }
+        if (timeout < 0) {
+            wait = SHIELD_EVENT_WAIT_FOREVER;
+        } else if (timeout == 0) {
+            /* non blocking: a single check of the events pending in the kernel */
+            if (waited == true) {
+                break;
+            }
+            wait = WFE_WAIT_NO;
+        } else {
+            /* other events received in the meantime do not extend the wait */
+            if (unlikely(__shield_time_now_ms(&now) < 0)) {
+                goto err;
+            }
+            if (now >= deadline) {
+                break;
+            }
+            wait = (int32_t)(deadline - now);
+        }
+        /* while messages are queued, a blocking wait is bounded by the retry period */
+        if (unlikely(tx_pending) &&
+            (wait == SHIELD_EVENT_WAIT_FOREVER || wait > SHIELD_MSG_TX_RETRY_MS)) {
+            wait = SHIELD_MSG_TX_RETRY_MS;
+        }
+        ret = __shield_event_fetch(wait);
+        waited = true;
+        switch (ret) {
+            case STATUS_OK:
+            case STATUS_AGAIN:
+            case STATUS_TIMEOUT:
+                break;
+            case STATUS_DENIED:
+                __shield_set_errno(EACCES);
+                goto err;
+            default:
+                __shield_set_errno(EINVAL);
+                goto err;
+        }
+    } while (1);
+    *revents = ready;
+    errcode = __builtin_popcount(ready & events);
+err:
+    return errcode;
+}
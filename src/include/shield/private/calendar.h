@@ -0,0 +1,144 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#ifndef SHIELD_PRIVATE_CALENDAR_H
+#define SHIELD_PRIVATE_CALENDAR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/** \addtogroup calendar
+ *  @{
+ */
+
+/*
+ * Gregorian calendar conversions, based on C. Neri and L. Schneider,
+ * "Euclidean affine functions and their application to calendar algorithms"
+ * (2022).
+ *
+ * The computation is made in a shifted 'computational calendar', where the
+ * year starts in March (so that the leap day is the last one of the year) and
+ * the day count is made positive by adding CALENDAR_SHIFT 400 years cycles.
+ * There is no loop on years or months and no data dependent branch, and all
+ * arithmetic is made on 32 bits, so that the divisions by constants are lowered
+ * to multiplications (no __aeabi_uldivmod call on ARMv7-M).
+ *
+ * Supported range covers the whole 32 bits unsigned time_t (1970 - 2106).
+ */
+
+#define CALENDAR_SECS_PER_DAY   86400UL
+#define CALENDAR_SECS_PER_HOUR  3600UL
+#define CALENDAR_SECS_PER_MIN   60UL
+
+/** number of 400 years cycles added to keep the computational day count positive */
+#define CALENDAR_SHIFT          82UL
+/** days from 0000-03-01 to 1970-01-01, plus shift */
+#define CALENDAR_EPOCH_OFFSET   (719468UL + (146097UL * CALENDAR_SHIFT))
+/** years shift corresponding to CALENDAR_SHIFT */
+#define CALENDAR_YEAR_SHIFT     (400UL * CALENDAR_SHIFT)
+
+/**
+ * @def broken-down gregorian date, with POSIX struct tm conventions
+ *
+ * year is the effective year (e.g. 2024), month in [1, 12], mday in [1, 31],
+ * wday in [0 (sunday), 6], yday in [0, 365].
+ */
+typedef struct calendar_date {
+    int32_t  year;
+    uint32_t month;
+    uint32_t mday;
+    uint32_t wday;
+    uint32_t yday;
+} calendar_date_t;
+
+/**
+ * @brief return 1 if the given year is a leap year, 0 otherwise
+ */
+static inline uint32_t __calendar_is_leap(uint32_t year)
+{
+    /* multiple of 100 are leap only if multiple of 400 (i.e. 16, as multiple of 25) */
+    return (year % 100) != 0 ? ((year % 4) == 0) : ((year % 16) == 0);
+}
+
+/**
+ * @brief number of days since 1970-01-01 of the given date
+ *
+ * month must be in [1, 12]. mday is not bound-checked: any value is
+ * linearly added to the first day of the month, which allows timegm()
+ * normalization.
+ */
+static inline int32_t __calendar_days_from_civil(int32_t year, uint32_t month, int32_t mday)
+{
+    const uint32_t jan_feb = (month <= 2);
+    const uint32_t y = (uint32_t)year + CALENDAR_YEAR_SHIFT - jan_feb;
+    const uint32_t m = month + (12 * jan_feb);
+    const uint32_t century = y / 100;
+    const uint32_t y_days = ((1461 * y) / 4) - century + (century / 4);
+    const uint32_t m_days = ((979 * m) - 2919) / 32;
+
+    return (int32_t)(y_days + m_days - CALENDAR_EPOCH_OFFSET) + (mday - 1);
+}
+
+/**
+ * @brief gregorian date of the given day count since 1970-01-01
+ */
+static inline void __calendar_civil_from_days(uint32_t days, calendar_date_t *date)
+{
+    const uint32_t n = days + CALENDAR_EPOCH_OFFSET;
+    /* century and day of century */
+    const uint32_t n1 = (4 * n) + 3;
+    const uint32_t century = n1 / 146097;
+    const uint32_t n_c = (n1 % 146097) / 4;
+    /* year of century and day of year (computational calendar, starting in March) */
+    const uint32_t n2 = (4 * n_c) + 3;
+    const uint64_t p2 = (uint64_t)2939745UL * n2;
+    const uint32_t z = (uint32_t)(p2 >> 32);
+    const uint32_t n_y = (uint32_t)p2 / 2939745UL / 4;
+    /* month and day of month */
+    const uint32_t n3 = (2141 * n_y) + 197913;
+    const uint32_t m = n3 >> 16;
+    const uint32_t d = (n3 & 0xffff) / 2141;
+    /* back to gregorian calendar: January and February belong to the next year */
+    const uint32_t jan_feb = (n_y >= 306);
+    const uint32_t y = (100 * century) + z + jan_feb;
+
+    date->year = (int32_t)(y - CALENDAR_YEAR_SHIFT);
+    date->month = m - (12 * jan_feb);
+    date->mday = d + 1;
+    /* 1970-01-01 is a Thursday */
+    date->wday = (days + 4) % 7;
+    /* day of year: n_y counts from March 1st */
+    date->yday = jan_feb ? (n_y - 306) : (n_y + 59 + __calendar_is_leap(y));
+}
+
+/**
+ * @brief split a 32 bits seconds count since epoch into days and time of day
+ */
+static inline void __calendar_split_secs(uint32_t secs, uint32_t *days,
+                                         uint32_t *hour, uint32_t *min, uint32_t *sec)
+{
+    const uint32_t d = secs / CALENDAR_SECS_PER_DAY;
+    const uint32_t sod = secs - (d * CALENDAR_SECS_PER_DAY);
+    const uint32_t h = sod / CALENDAR_SECS_PER_HOUR;
+    const uint32_t soh = sod - (h * CALENDAR_SECS_PER_HOUR);
+    const uint32_t m = soh / CALENDAR_SECS_PER_MIN;
+
+    *days = d;
+    *hour = h;
+    *min = m;
+    *sec = soh - (m * CALENDAR_SECS_PER_MIN);
+}
+
+/** \addtogroup calendar
+ *  @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!SHIELD_PRIVATE_CALENDAR_H*/
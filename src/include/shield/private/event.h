@@ -0,0 +1,108 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#ifndef SHIELD_PRIVATE_EVENT_H
+#define SHIELD_PRIVATE_EVENT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <uapi.h>
+
+/** \addtogroup event
+ *  @{
+ */
+
+/*
+ * libshield events demultiplexer.
+ *
+ * All the libshield modules waiting for kernel events (IPC, signals, timers alarm)
+ * do it through this module. Each wait is made on all the event types libshield
+ * handles, and an event that is not of the requested type is routed to its
+ * pending queue instead of being lost, so that a later wait on its type gets it
+ * back without any syscall:
+ * - IPC events are copied into a small FIFO of raw events
+ * - signals are set in a pending signal mask
+ * - the alarm signal is directly handled by the timers subsystem (timer_handler())
+ *   when timers are armed. Expired SIGEV_THREAD timers callbacks are executed once
+ *   the wait holds no event anymore (see timer_dispatch())
+ */
+
+/**
+ * @def number of IPC events that can be kept pending while waiting for another event type
+ *
+ * When the FIFO is full, IPC events are no more waited for, and are kept in the
+ * kernel queue until the FIFO is consumed.
+ */
+#define SHIELD_EVENT_IPC_DEPTH 2
+
+/**
+ * @def timeout value for a blocking wait, as used by __sys_wait_for_event()
+ */
+#define SHIELD_EVENT_WAIT_FOREVER 0
+
+/**
+ * @brief wait for an IPC event
+ *
+ * If an IPC event is pending, it is returned without any syscall. Otherwise, wait
+ * for the kernel, routing any other event type to its pending queue. An IPC event
+ * received from the kernel is not copied.
+ *
+ * @param timeout[in]: __sys_wait_for_event() timeout, WFE_WAIT_NO for non-blocking mode
+ * @param event[out]: received event. The event content is valid up to the next call to
+ *        the event API (i.e. any libshield blocking call), and must be copied if needed.
+ *
+ * @return STATUS_OK if an event has been received, or the __sys_wait_for_event() error
+ *         (typically STATUS_AGAIN in non-blocking mode)
+ */
+Status __shield_event_wait_ipc(int32_t timeout, const exchange_event_t **event);
+
+/**
+ * @brief wait for an IPC event, up to the given deadline
+ *
+ * Same as __shield_event_wait_ipc(), the wait being bounded by an absolute deadline
+ * instead of a timeout. Events already pending are returned even if the deadline is
+ * reached.
+ *
+ * @param deadline[in]: monotonic time in milliseconds, see __shield_time_now_ms()
+ *
+ * @return STATUS_OK if an event has been received, STATUS_TIMEOUT if the deadline is
+ *         reached, or the __sys_wait_for_event() error
+ */
+Status __shield_event_wait_ipc_until(uint64_t deadline, const exchange_event_t **event);
+
+/**
+ * @brief push back an IPC event at the head of the IPC FIFO
+ *
+ * To be called with the event returned by the last __shield_event_wait_ipc() call, when
+ * it can't be consumed yet. The next __shield_event_wait_ipc() call returns it again.
+ */
+void __shield_event_ipc_unget(const exchange_event_t *event);
+
+/**
+ * @brief wait once for any event type, routing the received event to its pending queue
+ *
+ * @param timeout[in]: __sys_wait_for_event() timeout
+ */
+Status __shield_event_fetch(int32_t timeout);
+
+/**
+ * @brief return true if at least one IPC event is pending in the event FIFO
+ */
+bool __shield_event_ipc_pending(void);
+
+/**
+ * @brief get back and clear the pending signals mask (bit n set for signal n)
+ */
+uint32_t __shield_event_signals_take(void);
+
+/**
+ * @brief return the pending signals mask, without clearing it
+ */
+uint32_t __shield_event_signals_peek(void);
+
+/** \addtogroup event
+ *  @}
+ */
+
+#endif/*!SHIELD_PRIVATE_EVENT_H*/
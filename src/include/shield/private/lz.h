@@ -0,0 +1,403 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#ifndef SHIELD_PRIVATE_LZ_H
+#define SHIELD_PRIVATE_LZ_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/** \addtogroup lz
+ *  @{
+ */
+
+/*
+ * LZ77 byte-oriented compression, LZ4 block format.
+ *
+ * A compressed block is a list of sequences, each made of:
+ * - a token byte: literals length (high nibble) and match length - LZ_MIN_MATCH (low nibble),
+ *   a nibble value of 15 being followed by extra length bytes (255 while the length goes on)
+ * - the literals
+ * - the match offset (2 bytes, little endian) and the match length extra bytes
+ * The last sequence only holds literals, and ends the block.
+ *
+ * Matches are searched through a hash table of the last position of each 4-byte sequence
+ * (no chain, no lazy matching): compression is a single pass with a small constant state,
+ * decompression is a bounded copy loop that never reads nor writes out of the given
+ * buffers, whatever the (untrusted) input is.
+ *
+ * Two modes are supported:
+ * - block: each buffer is compressed independently (__lz_compress(), __lz_decode())
+ * - stream: successive buffers are compressed against a window holding the last
+ *   LZ_WINDOW bytes of the stream (lz_enc_stream_t, lz_dec_stream_t), so that
+ *   repetitions between buffers (e.g. log lines) are found. Both sides update their
+ *   window identically, buffers must be decompressed in order and none can be lost.
+ *
+ * Nothing is allocated, the caller holds the state (typically in .bss).
+ */
+
+/** shortest match */
+#define LZ_MIN_MATCH 4
+/** farthest match */
+#define LZ_MAX_OFFSET 0xffffU
+
+/** hash table size, in bits */
+#ifndef LZ_HASH_BITS
+# define LZ_HASH_BITS 8
+#endif
+#define LZ_HASH_LEN (1U << LZ_HASH_BITS)
+
+/** stream window size, the stream buffers being up to LZ_WINDOW bytes each */
+#ifndef LZ_WINDOW
+# define LZ_WINDOW 256
+#endif
+
+#if LZ_WINDOW > (LZ_MAX_OFFSET / 2)
+# error "LZ stream window can't be bigger than 32767"
+#endif
+
+/**
+ * @def worst case compressed size of len bytes (incompressible input)
+ */
+#define LZ_BOUND(len) ((len) + ((len) / 255) + 16)
+
+/*
+ * stream compressor state. The window holds up to LZ_WINDOW bytes of history, followed by
+ * the buffer being compressed.
+ */
+typedef struct lz_enc_stream {
+    uint8_t  win[2 * LZ_WINDOW];
+    uint16_t hash[LZ_HASH_LEN]; /**< position + 1 in win, 0 if none */
+    uint16_t pos;               /**< end of the stream in win */
+} lz_enc_stream_t;
+
+/*
+ * stream decompressor state
+ */
+typedef struct lz_dec_stream {
+    uint8_t  win[2 * LZ_WINDOW];
+    uint16_t pos;
+} lz_dec_stream_t;
+
+static inline uint32_t __lz_read32(const uint8_t *ptr)
+{
+    uint32_t v;
+
+    memcpy(&v, ptr, sizeof(uint32_t));
+    return v;
+}
+
+static inline uint32_t __lz_hash(uint32_t seq)
+{
+    return (uint32_t)(seq * 2654435761UL) >> (32 - LZ_HASH_BITS);
+}
+
+/**
+ * @brief write a sequence length extension (the token nibble being 15)
+ *
+ * @return false if it does not fit in dst
+ */
+static inline bool __lz_put_len(uint8_t *dst, size_t *op, size_t cap, size_t len)
+{
+    bool res = false;
+
+    while (len >= 255) {
+        if (*op == cap) {
+            goto end;
+        }
+        dst[(*op)++] = 255;
+        len -= 255;
+    }
+    if (*op == cap) {
+        goto end;
+    }
+    dst[(*op)++] = (uint8_t)len;
+    res = true;
+end:
+    return res;
+}
+
+/**
+ * @brief write a sequence (literals, then a match if mlen is not 0)
+ *
+ * @return false if it does not fit in dst
+ */
+static inline bool __lz_put_seq(uint8_t *dst, size_t *op, size_t cap, const uint8_t *lit,
+                                size_t litlen, uint16_t offset, size_t mlen)
+{
+    bool res = false;
+    const size_t mcode = (mlen > 0) ? mlen - LZ_MIN_MATCH : 0;
+    uint8_t token;
+
+    token = (uint8_t)(((litlen >= 15) ? 15 : litlen) << 4);
+    token |= (uint8_t)((mcode >= 15) ? 15 : mcode);
+    if (*op == cap) {
+        goto end;
+    }
+    dst[(*op)++] = token;
+    if (litlen >= 15 && !__lz_put_len(dst, op, cap, litlen - 15)) {
+        goto end;
+    }
+    if (litlen > cap - *op) {
+        goto end;
+    }
+    memcpy(&dst[*op], lit, litlen);
+    *op += litlen;
+    if (mlen > 0) {
+        if (cap - *op < 2) {
+            goto end;
+        }
+        dst[(*op)++] = (uint8_t)(offset & 0xff);
+        dst[(*op)++] = (uint8_t)(offset >> 8);
+        if (mcode >= 15 && !__lz_put_len(dst, op, cap, mcode - 15)) {
+            goto end;
+        }
+    }
+    res = true;
+end:
+    return res;
+}
+
+/**
+ * @brief compress base[start, end[, matches being searched in base[0, end[
+ *
+ * @param hash[in,out]: hash table of positions (+ 1) in base, 0 for none
+ *
+ * @return the compressed length, or 0 if it does not fit in cap bytes
+ */
+static inline size_t __lz_encode(uint16_t *hash, const uint8_t *base, size_t start, size_t end,
+                                 uint8_t *dst, size_t cap)
+{
+    size_t ip = start;
+    size_t anchor = start;
+    size_t op = 0;
+
+    while (ip + LZ_MIN_MATCH <= end) {
+        const uint32_t seq = __lz_read32(&base[ip]);
+        const uint32_t h = __lz_hash(seq);
+        const size_t cand = hash[h];
+        size_t mlen;
+
+        hash[h] = (uint16_t)(ip + 1);
+        if (cand == 0 || ip - (cand - 1) > LZ_MAX_OFFSET || __lz_read32(&base[cand - 1]) != seq) {
+            ip++;
+            continue;
+        }
+        mlen = LZ_MIN_MATCH;
+        while (ip + mlen < end && base[cand - 1 + mlen] == base[ip + mlen]) {
+            mlen++;
+        }
+        if (!__lz_put_seq(dst, &op, cap, &base[anchor], ip - anchor, (uint16_t)(ip - (cand - 1)), mlen)) {
+            op = 0;
+            goto end;
+        }
+        ip += mlen;
+        anchor = ip;
+    }
+    if (!__lz_put_seq(dst, &op, cap, &base[anchor], end - anchor, 0, 0)) {
+        op = 0;
+    }
+end:
+    return op;
+}
+
+/**
+ * @brief read a sequence length extension
+ *
+ * @return false on truncated input
+ */
+static inline bool __lz_get_len(const uint8_t *src, size_t *ip, size_t slen, size_t *len)
+{
+    bool res = false;
+    uint8_t b;
+
+    do {
+        if (*ip == slen) {
+            goto end;
+        }
+        b = src[(*ip)++];
+        *len += b;
+    } while (b == 255);
+    res = true;
+end:
+    return res;
+}
+
+/**
+ * @brief decompress a block into base[start, cap[, matches referencing base[0, cap[
+ *
+ * @param out_len[out]: number of decompressed bytes
+ *
+ * @return false if the block is invalid, or if it does not fit in base
+ */
+static inline bool __lz_decode(const uint8_t *src, size_t slen, uint8_t *base, size_t start,
+                               size_t cap, size_t *out_len)
+{
+    bool res = false;
+    size_t ip = 0;
+    size_t op = start;
+
+    while (ip < slen) {
+        const uint8_t token = src[ip++];
+        size_t litlen = token >> 4;
+        size_t mlen = token & 0xf;
+        size_t offset;
+
+        if (litlen == 15 && !__lz_get_len(src, &ip, slen, &litlen)) {
+            goto end;
+        }
+        if (litlen > slen - ip || litlen > cap - op) {
+            goto end;
+        }
+        memcpy(&base[op], &src[ip], litlen);
+        ip += litlen;
+        op += litlen;
+        if (ip == slen) {
+            /* last sequence */
+            break;
+        }
+        if (slen - ip < 2) {
+            goto end;
+        }
+        offset = (size_t)src[ip] | ((size_t)src[ip + 1] << 8);
+        ip += 2;
+        if (mlen == 15 && !__lz_get_len(src, &ip, slen, &mlen)) {
+            goto end;
+        }
+        mlen += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op || mlen > cap - op) {
+            goto end;
+        }
+        /* byte per byte, the match may overlap the output (repetitions) */
+        for (size_t i = 0; i < mlen; ++i) {
+            base[op + i] = base[op - offset + i];
+        }
+        op += mlen;
+    }
+    *out_len = op - start;
+    res = true;
+end:
+    return res;
+}
+
+/**
+ * @brief compress a buffer independently of any other
+ *
+ * @return the compressed length, or 0 if it does not fit in cap bytes
+ */
+static inline size_t __lz_compress(uint16_t *hash, const uint8_t *src, size_t len, uint8_t *dst, size_t cap)
+{
+    memset(hash, 0, LZ_HASH_LEN * sizeof(uint16_t));
+    return __lz_encode(hash, src, 0, len, dst, cap);
+}
+
+static inline void __lz_enc_stream_init(lz_enc_stream_t *enc)
+{
+    memset(enc->hash, 0, sizeof(enc->hash));
+    enc->pos = 0;
+}
+
+static inline void __lz_dec_stream_init(lz_dec_stream_t *dec)
+{
+    dec->pos = 0;
+}
+
+/**
+ * @brief keep the last LZ_WINDOW bytes of the stream at the window start
+ *
+ * @return the number of bytes the window has been shifted by
+ */
+static inline uint16_t __lz_stream_slide(uint8_t *win, uint16_t *pos)
+{
+    uint16_t delta = 0;
+
+    if (*pos > LZ_WINDOW) {
+        delta = *pos - LZ_WINDOW;
+        memmove(win, &win[delta], LZ_WINDOW);
+        *pos = LZ_WINDOW;
+    }
+    return delta;
+}
+
+/**
+ * @brief compress the next buffer of the stream
+ *
+ * @param len[in]: buffer length, up to LZ_WINDOW
+ * @param dst[out]: compressed buffer, up to len bytes
+ *
+ * @return the compressed length, lower than len, or len if the buffer is stored as is
+ *         (not compressible) in dst
+ */
+static inline size_t __lz_stream_compress(lz_enc_stream_t *enc, const uint8_t *src, size_t len, uint8_t *dst)
+{
+    const size_t start = enc->pos;
+    size_t clen = 0;
+    uint16_t delta;
+
+    memcpy(&enc->win[start], src, len);
+    if (len > 1) {
+        clen = __lz_encode(enc->hash, enc->win, start, start + len, dst, len - 1);
+    }
+    if (clen == 0) {
+        memcpy(dst, src, len);
+        clen = len;
+    }
+    enc->pos = (uint16_t)(start + len);
+    delta = __lz_stream_slide(enc->win, &enc->pos);
+    if (delta > 0) {
+        for (size_t i = 0; i < LZ_HASH_LEN; ++i) {
+            enc->hash[i] = (enc->hash[i] > delta) ? (uint16_t)(enc->hash[i] - delta) : 0;
+        }
+    }
+    return clen;
+}
+
+/**
+ * @brief decompress the next buffer of the stream
+ *
+ * @param slen[in]: compressed length, as returned by __lz_stream_compress()
+ * @param dst[out]: decompressed buffer
+ * @param len[in]: decompressed length, up to LZ_WINDOW
+ *
+ * @return false if the compressed buffer is invalid. The stream can't be decompressed
+ *         any further.
+ */
+static inline bool __lz_stream_decompress(lz_dec_stream_t *dec, const uint8_t *src, size_t slen,
+                                          uint8_t *dst, size_t len)
+{
+    bool res = false;
+    const size_t start = dec->pos;
+    size_t out_len = 0;
+
+    if (len > LZ_WINDOW || slen > len) {
+        goto end;
+    }
+    if (slen == len) {
+        memcpy(&dec->win[start], src, len);
+    } else if (!__lz_decode(src, slen, dec->win, start, start + len, &out_len) || out_len != len) {
+        goto end;
+    }
+    memcpy(dst, &dec->win[start], len);
+    dec->pos = (uint16_t)(start + len);
+    __lz_stream_slide(dec->win, &dec->pos);
+    res = true;
+end:
+    return res;
+}
+
+/** \addtogroup lz
+ *  @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!SHIELD_PRIVATE_LZ_H*/
@@ -0,0 +1,36 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#ifndef SHIELD_PRIVATE_MSG_H
+#define SHIELD_PRIVATE_MSG_H
+
+#include <stdbool.h>
+
+/** \addtogroup msg
+ *  @{
+ */
+
+/**
+ * @brief return true if at least one received message is queued locally, in any queue
+ */
+bool __shield_msg_pending(void);
+
+/**
+ * @def retry period, in milliseconds, of the messages waiting for a busy destination,
+ *      when waiting for events without timeout
+ */
+#define SHIELD_MSG_TX_RETRY_MS 10
+
+/**
+ * @brief emit the messages waiting in the outbound queues, if enabled
+ *
+ * @return true if at least one message is still waiting for a busy destination
+ */
+bool __shield_msg_tx_flush(void);
+
+/** \addtogroup msg
+ *  @}
+ */
+
+#endif/*!SHIELD_PRIVATE_MSG_H*/
@@ -0,0 +1,164 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#ifndef SHIELD_PRIVATE_MSGFRAG_H
+#define SHIELD_PRIVATE_MSGFRAG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <shield/private/msgpool.h>
+
+/** \addtogroup msgfrag
+ *  @{
+ */
+
+/*
+ * SysV message fragmentation.
+ *
+ * A message is emitted as one or more IPCs (fragments), each starting with a fragment
+ * header. The fragments of a given message are emitted in order, though fragments of
+ * messages from different sources may interleave at reception: each source has its own
+ * reassembly state.
+ *
+ * A message is reassembled in a pool block (see msgpool.h), allocated when its first
+ * fragment is received. A fragment that does not follow the message being reassembled
+ * (other message id, unexpected offset) means that the end of this message has been lost
+ * (e.g. sender failure): the message is dropped.
+ */
+
+typedef struct __attribute__((packed)) {
+    uint8_t       msg_id; /**< message identifier, per destination */
+    uint8_t       flags;  /**< MSGFRAG_* flags */
+    uint16_t      offset; /**< fragment offset in the message (mtype included) */
+} msgfrag_hdr_t;
+
+/** last fragment of the message */
+#define MSGFRAG_LAST 0x1
+/**
+ * compressed message (see MSG_COMPRESS), set on all its fragments. The fragments then carry
+ * the message length (mtype included, uint16_t) followed by the LZ-compressed message
+ * (see shield/private/lz.h), fragment offsets being offsets in this compressed payload.
+ */
+#define MSGFRAG_LZ   0x2
+
+/**
+ * message being reassembled
+ */
+typedef struct msgfrag_reasm {
+    uint8_t       *buf;   /**< pool block, NULL if no message is being reassembled */
+    size_t        len;    /**< received bytes, mtype included */
+    uint8_t       msg_id;
+} msgfrag_reasm_t;
+
+typedef enum msgfrag_status {
+    MSGFRAG_READY, /**< the fragment can be appended to the reassembly buffer */
+    MSGFRAG_DROP,  /**< the fragment is dropped, and the message being reassembled if any */
+    MSGFRAG_NOMEM, /**< no free reassembly buffer, the fragment can't be handled yet */
+} msgfrag_status_t;
+
+/**
+ * @brief drop the message being reassembled, if any
+ */
+static inline void __msgfrag_abort(msgfrag_reasm_t *reasm, msgpool_class_t *pool, uint8_t nclasses)
+{
+    if (reasm->buf != NULL) {
+        __msgpool_free(pool, nclasses, reasm->buf);
+        reasm->buf = NULL;
+    }
+}
+
+/**
+ * @brief drop the message being reassembled if the received fragment does not follow it
+ *
+ * @return true if the message being reassembled has been dropped
+ */
+static inline bool __msgfrag_sync(msgfrag_reasm_t *reasm, msgpool_class_t *pool, uint8_t nclasses,
+                                  const msgfrag_hdr_t *hdr)
+{
+    bool dropped = false;
+
+    if (reasm->buf != NULL && (reasm->msg_id != hdr->msg_id || reasm->len != hdr->offset)) {
+        __msgfrag_abort(reasm, pool, nclasses);
+        dropped = true;
+    }
+    return dropped;
+}
+
+/**
+ * @brief get a reassembly buffer with room for the received fragment
+ *
+ * To be called after __msgfrag_sync(). On the first fragment of a message, a buffer of
+ * max_len bytes is allocated. Nothing is changed if no buffer is available, so that the
+ * fragment can be handled again later.
+ *
+ * @param len[in]: fragment content length
+ * @param max_len[in]: maximum message length, mtype included
+ *
+ * @return MSGFRAG_READY, MSGFRAG_DROP if the first fragments of the message have been
+ *         lost or if the message is oversized, or MSGFRAG_NOMEM
+ */
+static inline msgfrag_status_t __msgfrag_start(msgfrag_reasm_t *reasm, msgpool_class_t *pool,
+                                               uint8_t nclasses, const msgfrag_hdr_t *hdr,
+                                               size_t len, size_t max_len)
+{
+    msgfrag_status_t status = MSGFRAG_READY;
+
+    if (reasm->buf == NULL) {
+        if (hdr->offset != 0) {
+            /* first fragments of this message have been lost or dropped */
+            status = MSGFRAG_DROP;
+            goto end;
+        }
+        reasm->buf = (uint8_t *)__msgpool_alloc(pool, nclasses, max_len);
+        if (reasm->buf == NULL) {
+            status = MSGFRAG_NOMEM;
+            goto end;
+        }
+        reasm->msg_id = hdr->msg_id;
+        reasm->len = 0;
+    }
+    if (len > max_len - reasm->len) {
+        __msgfrag_abort(reasm, pool, nclasses);
+        status = MSGFRAG_DROP;
+    }
+end:
+    return status;
+}
+
+/**
+ * @brief append the fragment content, once __msgfrag_start() returned MSGFRAG_READY
+ */
+static inline void __msgfrag_append(msgfrag_reasm_t *reasm, const uint8_t *data, size_t len)
+{
+    memcpy(&reasm->buf[reasm->len], data, len);
+    reasm->len += len;
+}
+
+/**
+ * @brief take the ownership of the reassembled message
+ *
+ * @return the reassembly buffer, holding reasm->len bytes
+ */
+static inline uint8_t *__msgfrag_take(msgfrag_reasm_t *reasm)
+{
+    uint8_t *buf = reasm->buf;
+    reasm->buf = NULL;
+    return buf;
+}
+
+/** \addtogroup msgfrag
+ *  @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!SHIELD_PRIVATE_MSGFRAG_H*/
@@ -0,0 +1,135 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#ifndef SHIELD_PRIVATE_MSGKEY_H
+#define SHIELD_PRIVATE_MSGKEY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/** \addtogroup msgkey
+ *  @{
+ */
+
+/*
+ * SysV message queue key to msqid index.
+ *
+ * Open addressing hash table with linear probing, at least twice as big as the
+ * number of identifiers so that probe sequences stay short. A cell holds id + 1,
+ * 0 if empty, and the key of each identifier is kept along the table so that a
+ * lookup never reads the queues. Removal uses backward shift deletion: the
+ * following keys of the probe sequence are moved back, so that no lookup is broken
+ * and no tombstone is needed.
+ */
+
+#ifndef MSGKEY_IDS
+# define MSGKEY_IDS CONFIG_MAX_TASKS
+#endif
+
+#if MSGKEY_IDS <= 8
+# define MSGKEY_INDEX_BITS 4
+#elif MSGKEY_IDS <= 16
+# define MSGKEY_INDEX_BITS 5
+#elif MSGKEY_IDS <= 32
+# define MSGKEY_INDEX_BITS 6
+#elif MSGKEY_IDS <= 64
+# define MSGKEY_INDEX_BITS 7
+#else
+# error "SysV message queues key index supports up to 64 identifiers"
+#endif
+#define MSGKEY_INDEX_LEN (1UL << MSGKEY_INDEX_BITS)
+#define MSGKEY_INDEX_MASK (MSGKEY_INDEX_LEN - 1)
+
+typedef struct msgkey_index {
+    uint32_t keys[MSGKEY_IDS];            /**< key of each indexed identifier */
+    uint8_t  cells[MSGKEY_INDEX_LEN];     /**< id + 1, 0 for an empty cell */
+} msgkey_index_t;
+
+/**
+ * @brief key hash (Fibonacci hashing), keys being 32 bits task handles
+ */
+static inline uint32_t __msgkey_hash(uint32_t key)
+{
+    /* product truncated to 32 bits whatever the long size */
+    return (uint32_t)(key * 0x9e3779b1UL) >> (32 - MSGKEY_INDEX_BITS);
+}
+
+/**
+ * @brief get back the identifier associated to the given key
+ *
+ * @return the identifier, or -1 if key is not indexed
+ */
+static inline int __msgkey_lookup(const msgkey_index_t *idx, uint32_t key)
+{
+    int id = -1;
+    uint32_t cell = __msgkey_hash(key);
+
+    /* the index is never full, an empty cell ends the probe sequence */
+    while (idx->cells[cell] != 0) {
+        if (idx->keys[idx->cells[cell] - 1] == key) {
+            id = idx->cells[cell] - 1;
+            break;
+        }
+        cell = (cell + 1) & MSGKEY_INDEX_MASK;
+    }
+    return id;
+}
+
+/**
+ * @brief associate the given identifier to key
+ *
+ * The identifier must not be already indexed, and the key not associated to
+ * another identifier.
+ */
+static inline void __msgkey_insert(msgkey_index_t *idx, uint8_t id, uint32_t key)
+{
+    uint32_t cell = __msgkey_hash(key);
+
+    while (idx->cells[cell] != 0) {
+        cell = (cell + 1) & MSGKEY_INDEX_MASK;
+    }
+    idx->keys[id] = key;
+    idx->cells[cell] = id + 1;
+}
+
+/**
+ * @brief remove the given indexed identifier from the index
+ */
+static inline void __msgkey_remove(msgkey_index_t *idx, uint8_t id)
+{
+    uint32_t cell = __msgkey_hash(idx->keys[id]);
+    uint32_t next;
+
+    while (idx->cells[cell] != id + 1) {
+        cell = (cell + 1) & MSGKEY_INDEX_MASK;
+    }
+    next = cell;
+    do {
+        uint32_t home;
+        next = (next + 1) & MSGKEY_INDEX_MASK;
+        if (idx->cells[next] == 0) {
+            break;
+        }
+        home = __msgkey_hash(idx->keys[idx->cells[next] - 1]);
+        /* move back the key only if its home cell is not in (cell, next] */
+        if (((next - home) & MSGKEY_INDEX_MASK) >= ((next - cell) & MSGKEY_INDEX_MASK)) {
+            idx->cells[cell] = idx->cells[next];
+            cell = next;
+        }
+    } while (1);
+    idx->cells[cell] = 0;
+}
+
+/** \addtogroup msgkey
+ *  @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!SHIELD_PRIVATE_MSGKEY_H*/
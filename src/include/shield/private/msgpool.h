@@ -0,0 +1,85 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#ifndef SHIELD_PRIVATE_MSGPOOL_H
+#define SHIELD_PRIVATE_MSGPOOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** \addtogroup msgpool
+ *  @{
+ */
+
+/*
+ * Size-classed fixed blocks pool, for SysV messages storage.
+ *
+ * The pool is made of a few classes of fixed size blocks, sorted by increasing
+ * block size. A request is served by the smallest class whose blocks are big
+ * enough and not all used, so that a small message never holds a big block while
+ * small blocks are available. Each class tracks its used blocks in a bitmap
+ * (up to 32 blocks per class): alloc and free are constant time, without any
+ * fragmentation.
+ */
+
+typedef struct msgpool_class {
+    uint8_t  *blocks;    /**< num contiguous blocks of block_len bytes */
+    size_t   block_len;
+    uint8_t  num;        /**< number of blocks, up to 32 */
+    uint32_t used;       /**< bit n set if block n is allocated */
+} msgpool_class_t;
+
+/**
+ * @brief allocate a block of at least len bytes
+ *
+ * @param pool[in]: pool classes, sorted by increasing block_len
+ *
+ * @return the allocated block, or NULL if no block is big enough and free
+ */
+static inline void *__msgpool_alloc(msgpool_class_t *pool, uint8_t nclasses, size_t len)
+{
+    void *block = NULL;
+
+    for (uint8_t c = 0; c < nclasses; ++c) {
+        msgpool_class_t *cls = &pool[c];
+        const uint32_t all = (cls->num == 32) ? 0xffffffffUL : ((1UL << cls->num) - 1);
+        if (cls->block_len >= len && cls->used != all) {
+            const uint8_t id = (uint8_t)__builtin_ctz(~cls->used);
+            cls->used |= (1UL << id);
+            block = &cls->blocks[id * cls->block_len];
+            break;
+        }
+    }
+    return block;
+}
+
+/**
+ * @brief free a block allocated with __msgpool_alloc()
+ */
+static inline void __msgpool_free(msgpool_class_t *pool, uint8_t nclasses, const void *block)
+{
+    const uint8_t *ptr = (const uint8_t *)block;
+
+    for (uint8_t c = 0; c < nclasses; ++c) {
+        msgpool_class_t *cls = &pool[c];
+        if (ptr >= cls->blocks && ptr < &cls->blocks[cls->num * cls->block_len]) {
+            cls->used &= ~(1UL << ((size_t)(ptr - cls->blocks) / cls->block_len));
+            break;
+        }
+    }
+}
+
+/** \addtogroup msgpool
+ *  @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!SHIELD_PRIVATE_MSGPOOL_H*/
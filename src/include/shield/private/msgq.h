@@ -0,0 +1,329 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#ifndef SHIELD_PRIVATE_MSGQ_H
+#define SHIELD_PRIVATE_MSGQ_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** \addtogroup msgq
+ *  @{
+ */
+
+/*
+ * SysV message queue index.
+ *
+ * A queue is a set of MSGQ_DEPTH message slots (the message content is stored
+ * by the caller, in a slot-indexed array). Each queued message is linked in:
+ * - the arrival list, for msgtyp == 0 and MSG_EXCEPT selections
+ * - a type bucket list (mtype hash, arrival order), for msgtyp > 0 selection
+ * - a binary min-heap ordered on (mtype, arrival), for msgtyp < 0 selection
+ *   (lowest type first, i.e. message priorities)
+ *
+ * so that a selection never reads the message contents, and costs O(1) for the
+ * usual cases (first message, exact type without bucket collision, lowest type),
+ * insertion and removal being O(log n).
+ */
+
+#ifndef MSGQ_DEPTH
+# define MSGQ_DEPTH CONFIG_STD_POSIX_SYSV_MSQ_DEPTH
+#endif
+
+#if MSGQ_DEPTH > 32
+# error "message queue depth can't be bigger than 32"
+#endif
+
+/** number of type buckets, power of 2 */
+#define MSGQ_TYPE_BUCKETS 8
+/** no slot */
+#define MSGQ_NIL 0xffU
+/** used slots mask when all the slots are used */
+#define MSGQ_USED_ALL ((MSGQ_DEPTH == 32) ? 0xffffffffUL : ((1UL << (MSGQ_DEPTH & 31)) - 1))
+
+typedef struct msgq_node {
+    long     mtype;
+    uint32_t seq;      /**< arrival sequence number */
+    uint8_t  prev;     /**< arrival list */
+    uint8_t  next;
+    uint8_t  tprev;    /**< type bucket list */
+    uint8_t  tnext;
+    uint8_t  heap_pos; /**< position in the heap */
+} msgq_node_t;
+
+typedef struct msgq_index {
+    msgq_node_t nodes[MSGQ_DEPTH];
+    uint8_t     heap[MSGQ_DEPTH];
+    uint8_t     bucket_head[MSGQ_TYPE_BUCKETS];
+    uint8_t     bucket_tail[MSGQ_TYPE_BUCKETS];
+    uint32_t    used;  /**< bit n set if slot n holds a message, queued or detached */
+    uint32_t    seq;   /**< next arrival sequence number */
+    uint8_t     head;  /**< arrival list */
+    uint8_t     tail;
+    uint8_t     count; /**< number of queued messages */
+} msgq_index_t;
+
+static inline uint8_t __msgq_bucket(long mtype)
+{
+    return (uint8_t)((unsigned long)mtype & (MSGQ_TYPE_BUCKETS - 1));
+}
+
+static inline void __msgq_init(msgq_index_t *q)
+{
+    for (uint8_t i = 0; i < MSGQ_TYPE_BUCKETS; ++i) {
+        q->bucket_head[i] = MSGQ_NIL;
+        q->bucket_tail[i] = MSGQ_NIL;
+    }
+    q->used = 0;
+    q->seq = 0;
+    q->head = MSGQ_NIL;
+    q->tail = MSGQ_NIL;
+    q->count = 0;
+}
+
+/**
+ * @brief return true if no slot is free, detached slots being still in use
+ */
+static inline bool __msgq_full(const msgq_index_t *q)
+{
+    return (q->used == MSGQ_USED_ALL);
+}
+
+/**
+ * @brief heap order: lowest mtype first, then arrival order
+ */
+static inline bool __msgq_heap_before(const msgq_index_t *q, uint8_t a, uint8_t b)
+{
+    const msgq_node_t *na = &q->nodes[a];
+    const msgq_node_t *nb = &q->nodes[b];
+
+    if (na->mtype != nb->mtype) {
+        return (na->mtype < nb->mtype);
+    }
+    /* wrapping-safe, there is never more than MSGQ_DEPTH in-flight sequence numbers */
+    return ((int32_t)(na->seq - nb->seq) < 0);
+}
+
+static inline void __msgq_heap_set(msgq_index_t *q, uint8_t pos, uint8_t slot)
+{
+    q->heap[pos] = slot;
+    q->nodes[slot].heap_pos = pos;
+}
+
+static inline void __msgq_heap_up(msgq_index_t *q, uint8_t pos)
+{
+    const uint8_t slot = q->heap[pos];
+
+    while (pos > 0) {
+        uint8_t parent = (pos - 1) / 2;
+        if (!__msgq_heap_before(q, slot, q->heap[parent])) {
+            break;
+        }
+        __msgq_heap_set(q, pos, q->heap[parent]);
+        pos = parent;
+    }
+    __msgq_heap_set(q, pos, slot);
+}
+
+static inline void __msgq_heap_down(msgq_index_t *q, uint8_t pos)
+{
+    const uint8_t slot = q->heap[pos];
+
+    do {
+        uint8_t child = (2 * pos) + 1;
+        if (child >= q->count) {
+            break;
+        }
+        if (child + 1 < q->count && __msgq_heap_before(q, q->heap[child + 1], q->heap[child])) {
+            child++;
+        }
+        if (!__msgq_heap_before(q, q->heap[child], slot)) {
+            break;
+        }
+        __msgq_heap_set(q, pos, q->heap[child]);
+        pos = child;
+    } while (1);
+    __msgq_heap_set(q, pos, slot);
+}
+
+/**
+ * @brief queue a message of the given type
+ *
+ * @return the slot in which the message content must be stored, or MSGQ_NIL if the queue is full
+ */
+static inline uint8_t __msgq_insert(msgq_index_t *q, long mtype)
+{
+    uint8_t slot = MSGQ_NIL;
+    uint8_t bucket;
+    msgq_node_t *node;
+
+    if (__msgq_full(q)) {
+        goto end;
+    }
+    slot = (uint8_t)__builtin_ctz(~q->used);
+    node = &q->nodes[slot];
+    node->mtype = mtype;
+    node->seq = q->seq++;
+    /* arrival list tail */
+    node->prev = q->tail;
+    node->next = MSGQ_NIL;
+    if (q->tail != MSGQ_NIL) {
+        q->nodes[q->tail].next = slot;
+    } else {
+        q->head = slot;
+    }
+    q->tail = slot;
+    /* type bucket tail */
+    bucket = __msgq_bucket(mtype);
+    node->tprev = q->bucket_tail[bucket];
+    node->tnext = MSGQ_NIL;
+    if (q->bucket_tail[bucket] != MSGQ_NIL) {
+        q->nodes[q->bucket_tail[bucket]].tnext = slot;
+    } else {
+        q->bucket_head[bucket] = slot;
+    }
+    q->bucket_tail[bucket] = slot;
+    /* heap */
+    q->used |= (1UL << slot);
+    q->heap[q->count] = slot;
+    q->count++;
+    __msgq_heap_up(q, q->count - 1);
+end:
+    return slot;
+}
+
+/**
+ * @brief unlink the message held in the given slot from the queue, without freeing the slot
+ *
+ * The message is no more selectable, and its content is kept up to __msgq_free().
+ */
+static inline void __msgq_detach(msgq_index_t *q, uint8_t slot)
+{
+    msgq_node_t *node = &q->nodes[slot];
+    const uint8_t bucket = __msgq_bucket(node->mtype);
+    uint8_t pos = node->heap_pos;
+
+    /* arrival list */
+    if (node->prev != MSGQ_NIL) {
+        q->nodes[node->prev].next = node->next;
+    } else {
+        q->head = node->next;
+    }
+    if (node->next != MSGQ_NIL) {
+        q->nodes[node->next].prev = node->prev;
+    } else {
+        q->tail = node->prev;
+    }
+    /* type bucket list */
+    if (node->tprev != MSGQ_NIL) {
+        q->nodes[node->tprev].tnext = node->tnext;
+    } else {
+        q->bucket_head[bucket] = node->tnext;
+    }
+    if (node->tnext != MSGQ_NIL) {
+        q->nodes[node->tnext].tprev = node->tprev;
+    } else {
+        q->bucket_tail[bucket] = node->tprev;
+    }
+    /* heap: the last element replaces the removed one, and is moved up or down */
+    q->count--;
+    if (pos < q->count) {
+        const uint8_t last = q->heap[q->count];
+        __msgq_heap_set(q, pos, last);
+        __msgq_heap_down(q, pos);
+        if (q->heap[pos] == last) {
+            __msgq_heap_up(q, pos);
+        }
+    }
+}
+
+/**
+ * @brief free a detached slot
+ */
+static inline void __msgq_free(msgq_index_t *q, uint8_t slot)
+{
+    q->used &= ~(1UL << slot);
+}
+
+/**
+ * @brief remove the message held in the given slot from the queue
+ */
+static inline void __msgq_remove(msgq_index_t *q, uint8_t slot)
+{
+    __msgq_detach(q, slot);
+    __msgq_free(q, slot);
+}
+
+/**
+ * @brief return true if a message of type mtype matches the msgtyp selection
+ *
+ * To be used on a message that is not queued yet, when no queued message matches: it is
+ * then the one __msgq_select() would return once queued.
+ */
+static inline bool __msgq_match(long mtype, long msgtyp, bool except)
+{
+    bool res;
+
+    if (msgtyp == 0) {
+        res = true;
+    } else if (msgtyp < 0) {
+        res = (mtype <= ((msgtyp < -__LONG_MAX__) ? __LONG_MAX__ : -msgtyp));
+    } else {
+        res = except ? (mtype != msgtyp) : (mtype == msgtyp);
+    }
+    return res;
+}
+
+/**
+ * @brief select the message to receive, using SysV msgrcv() semantics
+ *
+ * - msgtyp == 0: first message in arrival order
+ * - msgtyp > 0: first message of type msgtyp, or, if except is set, first message
+ *   of any other type
+ * - msgtyp < 0: first message of the lowest type, if lower than or equal to |msgtyp|
+ *
+ * @return the selected slot, or MSGQ_NIL if no queued message matches
+ */
+static inline uint8_t __msgq_select(const msgq_index_t *q, long msgtyp, bool except)
+{
+    uint8_t slot;
+
+    if (msgtyp == 0) {
+        slot = q->head;
+    } else if (msgtyp < 0) {
+        /* |LONG_MIN| does not fit in a long, any type is lower anyway */
+        const long bound = (msgtyp < -__LONG_MAX__) ? __LONG_MAX__ : -msgtyp;
+        slot = MSGQ_NIL;
+        if (q->count > 0 && q->nodes[q->heap[0]].mtype <= bound) {
+            slot = q->heap[0];
+        }
+    } else if (except) {
+        for (slot = q->head; slot != MSGQ_NIL; slot = q->nodes[slot].next) {
+            if (q->nodes[slot].mtype != msgtyp) {
+                break;
+            }
+        }
+    } else {
+        for (slot = q->bucket_head[__msgq_bucket(msgtyp)]; slot != MSGQ_NIL; slot = q->nodes[slot].tnext) {
+            if (q->nodes[slot].mtype == msgtyp) {
+                break;
+            }
+        }
+    }
+    return slot;
+}
+
+/** \addtogroup msgq
+ *  @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!SHIELD_PRIVATE_MSGQ_H*/
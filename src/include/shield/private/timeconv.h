@@ -0,0 +1,162 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#ifndef SHIELD_PRIVATE_TIMECONV_H
+#define SHIELD_PRIVATE_TIMECONV_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/** \addtogroup timeconv
+ *  @{
+ */
+
+/*
+ * Division-free time unit conversions.
+ *
+ * On ARMv7-M, any 64 bits division or modulo is a call to __aeabi_uldivmod,
+ * that costs hundreds of cycles. Dividing by a constant is replaced here by a
+ * multiplication by its fixed-point reciprocal (Granlund-Montgomery method).
+ * The power of two part of the divisor is removed with a shift first, so that
+ * the magic number fits in 64 bits and the result is exact on the whole input
+ * range (see tests/test_time for the host side exhaustive check).
+ */
+
+/**
+ * @brief high 64 bits of the 128 bits product a * b
+ *
+ * Built on 32x32->64 multiplications only (UMULL on ARMv7-M), no
+ * compiler runtime call.
+ */
+static inline uint64_t __time_umulh64(uint64_t a, uint64_t b)
+{
+    uint64_t a_lo = (uint32_t)a;
+    uint64_t a_hi = a >> 32;
+    uint64_t b_lo = (uint32_t)b;
+    uint64_t b_hi = b >> 32;
+    uint64_t lolo = a_lo * b_lo;
+    uint64_t hilo = a_hi * b_lo;
+    uint64_t lohi = a_lo * b_hi;
+    uint64_t hihi = a_hi * b_hi;
+    /* can't overflow: lohi <= (2^32 - 1)^2 and the two other terms are < 2^32 */
+    uint64_t cross = (lolo >> 32) + (uint32_t)hilo + lohi;
+
+    return hihi + (hilo >> 32) + (cross >> 32);
+}
+
+/**
+ * @brief exact x / 1000 for any 64 bits value (1000 = 2^3 * 125)
+ */
+static inline uint64_t __time_udiv1000_u64(uint64_t x)
+{
+    return __time_umulh64(x >> 3, 0x20c49ba5e353f7cfULL) >> 4;
+}
+
+/**
+ * @brief exact x / 1000000 for any 64 bits value (1000000 = 2^6 * 15625)
+ */
+static inline uint64_t __time_udiv1000000_u64(uint64_t x)
+{
+    return __time_umulh64(x >> 6, 0x218def416bdb1a7ULL) >> 7;
+}
+
+/**
+ * @brief exact x / 1000000000 for any 64 bits value (1000000000 = 2^9 * 1953125)
+ */
+static inline uint64_t __time_udiv1000000000_u64(uint64_t x)
+{
+    return __time_umulh64(x >> 9, 0x44b82fa09b5a53ULL) >> 11;
+}
+
+/**
+ * @brief exact x / 1000 for any 32 bits value, using a single 32x32->64 multiply
+ */
+static inline uint32_t __time_udiv1000_u32(uint32_t x)
+{
+    return (uint32_t)(((uint64_t)x * 0x10624dd3UL) >> 38);
+}
+
+/**
+ * @brief exact x / 1000000 for any 32 bits value, using a single 32x32->64 multiply
+ */
+static inline uint32_t __time_udiv1000000_u32(uint32_t x)
+{
+    return (uint32_t)(((uint64_t)x * 0x431bde83UL) >> 50);
+}
+
+/**
+ * @brief convert a duration in microseconds to seconds and nanoseconds complement
+ *
+ * @param us[in]: duration in microseconds
+ * @param sec[out]: number of seconds
+ * @param nsec[out]: nanoseconds complement to sec, always lower than 1 second
+ */
+static inline void __time_us_to_sec_nsec(uint64_t us, uint64_t *sec, uint32_t *nsec)
+{
+    uint64_t s = __time_udiv1000000_u64(us);
+    /* remainder is lower than 10^6, only the low word is required */
+    uint32_t rem = (uint32_t)us - ((uint32_t)s * 1000000UL);
+
+    *sec = s;
+    *nsec = rem * 1000UL;
+}
+
+/**
+ * @brief convert a duration in nanoseconds to seconds and nanoseconds complement
+ */
+static inline void __time_ns_to_sec_nsec(uint64_t ns, uint64_t *sec, uint32_t *nsec)
+{
+    uint64_t s = __time_udiv1000000000_u64(ns);
+
+    *sec = s;
+    *nsec = (uint32_t)ns - ((uint32_t)s * 1000000000UL);
+}
+
+/**
+ * @brief convert a duration in milliseconds to seconds and nanoseconds complement
+ */
+static inline void __time_ms_to_sec_nsec(uint32_t ms, uint32_t *sec, uint32_t *nsec)
+{
+    uint32_t s = __time_udiv1000_u32(ms);
+
+    *sec = s;
+    *nsec = (ms - (s * 1000UL)) * 1000000UL;
+}
+
+/**
+ * @brief convert a nanosecond count (e.g. a tv_nsec field) to milliseconds
+ */
+static inline uint32_t __time_ns_to_ms(uint32_t nsec)
+{
+    return __time_udiv1000000_u32(nsec);
+}
+
+/**
+ * @brief convert a nanosecond count (e.g. a tv_nsec field) to microseconds
+ */
+static inline uint32_t __time_ns_to_us(uint32_t nsec)
+{
+    return __time_udiv1000_u32(nsec);
+}
+
+/**
+ * @brief convert milliseconds to microseconds, without 32 bits overflow
+ */
+static inline uint64_t __time_ms_to_us(uint32_t ms)
+{
+    return (uint64_t)ms * 1000UL;
+}
+
+/** \addtogroup timeconv
+ *  @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!SHIELD_PRIVATE_TIMECONV_H*/
@@ -9,8 +9,46 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
+#include <stdint.h>
 
 void timer_initialize(void);
-void timer_handler(void);
+int timer_handler(void);
+
+/**
+ * @brief return true if at least one timer is set and waits for the kernel alarm
+ */
+bool timer_armed(void);
+
+/**
+ * @brief return true if at least one callback waits for shield_timer_dispatch()
+ */
+bool timer_pending(void);
+
+/**
+ * @brief execute the pending SIGEV_THREAD callbacks, if any
+ *
+ * Called by libshield on return from its blocking waits, so that callbacks are
+ * executed without any shield_timer_dispatch() call from the task.
+ */
+void timer_dispatch(void);
+
+/**
+ * @brief get back the current monotonic time in milliseconds, as used for deadlines
+ *
+ * @return 0, or -1 with errno set
+ */
+int __shield_time_now_ms(uint64_t *now);
+
+/**
+ * @brief get back the current monotonic time in microseconds
+ *
+ * @return 0, or -1 with errno set
+ */
+int __shield_time_now_us(uint64_t *now);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif/*!__TIMER_H*/
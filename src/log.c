@@ -0,0 +1,122 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+/**
+ * @file
+ *
+ * Deferred binary logging, see shield/log.h.
+ *
+ * Log entries are recorded in a .bss buffer as:
+ * - the number of argument words (1 byte)
+ * - the format string identifier (4 bytes, little endian)
+ * - the argument words (4 bytes each, little endian)
+ *
+ * and the buffer is emitted to the debug output as frames made of:
+ * - LOG_BIN_MAGIC0, LOG_BIN_MAGIC1
+ * - the frame data length (1 byte)
+ * - whole log entries, up to the SVC exchange area length
+ *
+ * As for compressed printf() frames, the leading escape char lets the host decoder
+ * separate binary frames from the text output on the debug output.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <shield/log.h>
+#include <shield/string.h>
+#include <shield/private/coreutils.h>
+#include <uapi.h>
+
+#define LOG_BIN_MAGIC0   0x1bU
+#define LOG_BIN_MAGIC1   'B'
+#define LOG_BIN_HDR_LEN  3
+#define LOG_BIN_FRAME_DATA_LEN (CONFIG_SVC_EXCHANGE_AREA_LEN - LOG_BIN_HDR_LEN)
+
+/** entry header: number of words, format string identifier */
+#define LOG_BIN_ENTRY_HDR_LEN 5
+#define LOG_BIN_WORD_LEN      4
+#define LOG_BIN_ENTRY_MAX_LEN (LOG_BIN_ENTRY_HDR_LEN + (2 * SHIELD_LOG_MAX_ARGS * LOG_BIN_WORD_LEN))
+
+#if LOG_BIN_ENTRY_MAX_LEN > LOG_BIN_FRAME_DATA_LEN || LOG_BIN_ENTRY_MAX_LEN > CONFIG_LOG_BINARY_BUF_LEN
+# error "binary log frames and buffer must be able to hold the biggest log entry"
+#endif
+
+#if LOG_BIN_FRAME_DATA_LEN > 255
+# error "binary log frame data length is encoded on one byte"
+#endif
+
+static uint8_t log_buf[CONFIG_LOG_BINARY_BUF_LEN];
+static size_t log_buf_len;
+static uint8_t log_frame[CONFIG_SVC_EXCHANGE_AREA_LEN];
+
+static inline void log_put_word(uint8_t *dst, uint32_t word)
+{
+    dst[0] = (uint8_t)word;
+    dst[1] = (uint8_t)(word >> 8);
+    dst[2] = (uint8_t)(word >> 16);
+    dst[3] = (uint8_t)(word >> 24);
+}
+
+static void log_emit_frame(size_t len)
+{
+    log_frame[0] = LOG_BIN_MAGIC0;
+    log_frame[1] = LOG_BIN_MAGIC1;
+    log_frame[2] = (uint8_t)len;
+    if (unlikely(copy_to_kernel(log_frame, LOG_BIN_HDR_LEN + len) != STATUS_OK)) {
+        /* should not happen */
+        /*@ assert(false); */
+        goto err;
+    }
+    __sys_log(LOG_BIN_HDR_LEN + len);
+err:
+    return;
+}
+
+void shield_log_flush(void)
+{
+    size_t offset = 0;
+    size_t flen = 0;
+
+    while (offset < log_buf_len) {
+        const size_t elen = LOG_BIN_ENTRY_HDR_LEN + (log_buf[offset] * LOG_BIN_WORD_LEN);
+        /* entries are never split between frames */
+        if (flen + elen > LOG_BIN_FRAME_DATA_LEN) {
+            log_emit_frame(flen);
+            flen = 0;
+        }
+        memcpy(&log_frame[LOG_BIN_HDR_LEN + flen], &log_buf[offset], elen);
+        flen += elen;
+        offset += elen;
+    }
+    if (flen > 0) {
+        log_emit_frame(flen);
+    }
+    log_buf_len = 0;
+}
+
+void __shield_log_write(uint32_t id, const uint32_t *words, size_t nwords)
+{
+    size_t elen;
+    uint8_t *entry;
+
+    if (unlikely(nwords > (2 * SHIELD_LOG_MAX_ARGS))) {
+        /* can't be made through shield_log() */
+        goto err;
+    }
+    elen = LOG_BIN_ENTRY_HDR_LEN + (nwords * LOG_BIN_WORD_LEN);
+    if (log_buf_len + elen > sizeof(log_buf)) {
+        shield_log_flush();
+    }
+    entry = &log_buf[log_buf_len];
+    entry[0] = (uint8_t)nwords;
+    log_put_word(&entry[1], id);
+    for (size_t i = 0; i < nwords; ++i) {
+        log_put_word(&entry[LOG_BIN_ENTRY_HDR_LEN + (i * LOG_BIN_WORD_LEN)], words[i]);
+    }
+    log_buf_len += elen;
+err:
+    return;
+}
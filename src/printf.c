@@ -6,23 +6,92 @@
 #include <shield/string.h>
 #include <shield/stdio.h>
 #include <shield/private/coreutils.h>
+#include <shield/errno.h>
+#include <shield/private/errno.h>
 #include <uapi.h>
 #include "printf_lexer.h"
 
-/**
- * log_lexer delivered printf POSIX compliant implementation
+#if defined(CONFIG_LOG_LZ)
+#include <shield/private/lz.h>
+#endif
+#if defined(CONFIG_LOG_BINARY)
+#include <shield/log.h>
+#endif
+
+#if defined(CONFIG_PRINTF_BUF_LEN)
+# define BUF_MAX CONFIG_PRINTF_BUF_LEN
+#else
+# define BUF_MAX 128
+#endif
+
+/* file descriptors of the debug output, see vdprintf() */
+#define PRINTF_FD_STDOUT 1
+#define PRINTF_FD_STDERR 2
+
+/*
+ * debug output buffer, .bss based. Only used by the debug output functions, formatting
+ * to a caller buffer is made in place.
  */
-uint8_t print_with_len(const char *fmt, va_list *args, size_t *sizew);
+static char dbgbuf[BUF_MAX];
 
-uint16_t log_get_dbgbuf_offset(void);
-uint8_t* log_get_dbgbuf(void);
-void dbgbuffer_flush(void);
+#if defined(CONFIG_LOG_LZ)
+/*
+ * Compressed log output. The output of each printf() call is emitted as one or more
+ * frames made of:
+ * - LOG_LZ_MAGIC0, LOG_LZ_MAGIC1
+ * - the frame raw length (1 byte)
+ * - the frame compressed length (1 byte), equal to the raw length if the frame is
+ *   stored as is
+ * - the compressed data
+ * Frames are compressed against the previous ones (see lz stream mode in
+ * shield/private/lz.h), so that repetitive log lines cost a few bytes each. The host
+ * decoder must receive all the frames of the task, in order, from the task start.
+ */
+#define LOG_LZ_MAGIC0   0x1bU
+#define LOG_LZ_MAGIC1   'Z'
+#define LOG_LZ_HDR_LEN  4
+#define LOG_LZ_FRAME_DATA_LEN (CONFIG_SVC_EXCHANGE_AREA_LEN - LOG_LZ_HDR_LEN)
 
+#if LOG_LZ_FRAME_DATA_LEN > LZ_WINDOW || LOG_LZ_FRAME_DATA_LEN > 255
+# error "compressed log frames are limited to the LZ window and to 255 bytes"
+#endif
+
+/*
+ * .bss based, init to 0, which is the initial stream state
+ */
+static lz_enc_stream_t log_lz;
+static uint8_t log_lz_frame[CONFIG_SVC_EXCHANGE_AREA_LEN];
+
+static void dbgbuffer_display(const uint8_t *buf, uint16_t len)
+{
+    while (len > 0) {
+        const uint8_t chunk = (len > LOG_LZ_FRAME_DATA_LEN) ? LOG_LZ_FRAME_DATA_LEN : (uint8_t)len;
+        const size_t clen = __lz_stream_compress(&log_lz, buf, chunk, &log_lz_frame[LOG_LZ_HDR_LEN]);
+
+        log_lz_frame[0] = LOG_LZ_MAGIC0;
+        log_lz_frame[1] = LOG_LZ_MAGIC1;
+        log_lz_frame[2] = chunk;
+        log_lz_frame[3] = (uint8_t)clen;
+        if (unlikely(copy_to_kernel(log_lz_frame, LOG_LZ_HDR_LEN + clen) != STATUS_OK)) {
+            /* should not happen */
+            /*@ assert(false); */
+            goto err;
+        }
+        __sys_log(LOG_LZ_HDR_LEN + clen);
+        buf += chunk;
+        len -= chunk;
+    }
+err:
+    return;
+}
+#else
+#if defined(CONFIG_PRINTF_BUF_LEN) && (CONFIG_PRINTF_BUF_LEN > CONFIG_SVC_EXCHANGE_AREA_LEN)
+# error "printf() buffer can't be bigger than the SVC exchange area"
+#endif
 
-static inline void dbgbuffer_display(void)
+static void dbgbuffer_display(const uint8_t *buf, uint16_t len)
 {
-    uint16_t len = log_get_dbgbuf_offset();
-    if (unlikely(copy_to_kernel(log_get_dbgbuf(), len) != STATUS_OK)) {
+    if (unlikely(copy_to_kernel(buf, len) != STATUS_OK)) {
         /* should not happen */
         /*@ assert(false); */
         goto err;
@@ -31,77 +100,136 @@ static inline void dbgbuffer_display(void)
 err:
     return;
 }
+#endif
 
 /*************************************************************
  * libstream exported API implementation: POSIX compilant API
  ************************************************************/
 
+/*
+ * debug output sink drain: emit the buffer content each time it is full
+ */
+static void dbgbuffer_drain(print_sink_t *sink)
+{
+    dbgbuffer_display((const uint8_t *)sink->buf, (uint16_t)sink->offset);
+    sink->offset = 0;
+}
+
 /*
  * Linux-like printk() API (no kernel tagging by now)
+ *
+ * The output is streamed to the debug output by chunks, each time the buffer is full,
+ * so that it is never truncated. On format error, already emitted chunks are not reverted.
  */
-__attribute__ ((format (printf, 1, 2))) int shield_printf(const char *fmt, ...)
+__attribute__ ((format (printf, 1, 0))) int shield_vprintf(const char *fmt, va_list ap)
 {
+    print_sink_t sink = {
+        .buf = dbgbuf,
+        .len = sizeof(dbgbuf),
+        .offset = 0,
+        .total = 0,
+        .drain = dbgbuffer_drain,
+    };
     va_list args;
     size_t  len;
     int res = -1;
 
-    dbgbuffer_flush();
     if (fmt == NULL) {
         goto err;
     }
-    /*
-     * if there is some asyncrhonous printf to pass to the kernel, do it
-     * before execute the current printf command
-     */
-    va_start(args, fmt);
-    if (print_with_len(fmt, &args, &len) == 0) {
+#if defined(CONFIG_LOG_BINARY)
+    /* keep the binary log entries and the text output in order */
+    shield_log_flush();
+#endif
+    va_copy(args, ap);
+    if (print_with_len(&sink, fmt, &args, &len) == 0) {
         res = (int)len;
     }
     va_end(args);
     if (res == -1) {
-        dbgbuffer_flush();
         goto err;
     }
-    /* display to debug output */
-    dbgbuffer_display();
+    /* display the last chunk to debug output */
+    dbgbuffer_display((const uint8_t *)sink.buf, (uint16_t)sink.offset);
 err:
-    dbgbuffer_flush();
     return res;
 }
 
-__attribute__ ((format (printf, 3, 4))) int shield_snprintf(char*dest, size_t dlen, const char *fmt, ...)
+__attribute__ ((format (printf, 1, 2))) int shield_printf(const char *fmt, ...)
 {
+    va_list args;
+    int res;
+
+    va_start(args, fmt);
+    res = shield_vprintf(fmt, args);
+    va_end(args);
+    return res;
+}
+
+/*
+ * the only supported file descriptors are stdout and stderr, both being the debug output
+ */
+__attribute__ ((format (printf, 2, 0))) int shield_vdprintf(int fd, const char *fmt, va_list ap)
+{
+    int res = -1;
+
+    if (unlikely(fd != PRINTF_FD_STDOUT && fd != PRINTF_FD_STDERR)) {
+        __shield_set_errno(EBADF);
+        goto err;
+    }
+    res = shield_vprintf(fmt, ap);
+err:
+    return res;
+}
+
+/*
+ * The output is formatted directly in dest, truncated to dlen - 1 chars and always
+ * terminated with a null char (if dlen is not 0). As for POSIX snprintf(), the
+ * returned length is the one of the untruncated output.
+ */
+__attribute__ ((format (printf, 3, 0))) int shield_vsnprintf(char *dest, size_t dlen, const char *fmt, va_list ap)
+{
+    print_sink_t sink = {
+        .buf = dest,
+        .len = (dlen > 0) ? dlen - 1 : 0,
+        .offset = 0,
+        .total = 0,
+        .drain = NULL,
+    };
     va_list args;
     size_t  len;
     int res = -1;
 
-    dbgbuffer_flush();
-    if (fmt == NULL) {
+    if (unlikely(fmt == NULL || (dest == NULL && dlen > 0))) {
         goto err;
     }
-    /*
-     * if there is some asyncrhonous printf to pass to the kernel, do it
-     * before execute the current printf command
-     */
-    va_start(args, fmt);
-    if (print_with_len(fmt, &args, &len) == 0) {
+    va_copy(args, ap);
+    if (print_with_len(&sink, fmt, &args, &len) == 0) {
         res = (int)len;
     }
     va_end(args);
-    if (res == -1) {
-        dbgbuffer_flush();
-        goto err;
+    if (dlen > 0) {
+        dest[sink.offset] = '\0';
     }
-    if (len > dlen) {
-        len = dlen;
-    }
-    memcpy(dest, log_get_dbgbuf(), len);
 err:
-    dbgbuffer_flush();
+    return res;
+}
+
+__attribute__ ((format (printf, 3, 4))) int shield_snprintf(char*dest, size_t dlen, const char *fmt, ...)
+{
+    va_list args;
+    int res;
+
+    va_start(args, fmt);
+    res = shield_vsnprintf(dest, dlen, fmt, args);
+    va_end(args);
     return res;
 }
 
 #ifndef TEST_MODE
 __attribute__ ((format (printf, 1, 2))) int printf(const char *fmt, ...) __attribute__((alias("shield_printf")));
 __attribute__ ((format (printf, 3, 4))) int snprintf(char*dest, size_t dlen, const char *fmt, ...) __attribute__((alias("shield_snprintf")));
+__attribute__ ((format (printf, 1, 0))) int vprintf(const char *fmt, va_list ap) __attribute__((alias("shield_vprintf")));
+__attribute__ ((format (printf, 2, 0))) int vdprintf(int fd, const char *fmt, va_list ap) __attribute__((alias("shield_vdprintf")));
+__attribute__ ((format (printf, 3, 0))) int vsnprintf(char *dest, size_t dlen, const char *fmt, va_list ap) __attribute__((alias("shield_vsnprintf")));
 #endif
@@ -24,634 +24,511 @@
 #include <inttypes.h>
 #include <stdbool.h>
 
+#include "printf_lexer.h"
+
 /*********************************************
- * Ring buffer and ring buffer utility functions
+ * Output sink utility functions
  */
 
-// FIXME: must be Kconfig based
-#define BUF_MAX 128
-
 /*
- * .bss based, init to 0
+ * add a char to the output sink.
+ *
+ * When the sink buffer is full, its content is given to the sink drain callback,
+ * if any, that empties it, so that the output is streamed by chunks of the buffer
+ * size. Without drain callback, the char is discarded (truncated output). In both
+ * cases, the char is accounted in the sink total length.
+ *
+ * WARNING: this function is the only one holding the sink buffer full
+ * flag detection. As a consequence, any write access to the sink buffer
+ * must be done through this function *exclusively*.
  */
-typedef struct debug_buffer {
-    uint16_t offset;
-    char buf[BUF_MAX];
-} debug_buffer_t;
-
-static debug_buffer_t dbgbuf;
-
-
-uint16_t log_get_dbgbuf_offset(void)
+static inline void dbgbuffer_write_char(print_sink_t *sink, const char c)
 {
-    return dbgbuf.offset;
+    sink->total++;
+    if (sink->offset == sink->len) {
+        if (sink->drain == NULL) {
+            goto end;
+        }
+        sink->drain(sink);
+    }
+    sink->buf[sink->offset++] = c;
+ end:
+    return;
 }
 
-uint8_t* log_get_dbgbuf(void)
+/*
+ * copy a span of chars to the output sink, by bounded chunks.
+ *
+ * This is the bulk version of dbgbuffer_write_char(), with the same sink full
+ * handling: each chunk fills the sink buffer room, so that the span is copied with
+ * one memcpy() per buffer drain instead of one sink check per char.
+ */
+ /*@
+   requires \valid_read(str + (0 .. len - 1));
+  */
+static inline void dbgbuffer_write_span(print_sink_t *sink, const char *str, size_t len)
 {
-    return &dbgbuf.buf[0];
+    sink->total += len;
+    while (len > 0) {
+        size_t room = sink->len - sink->offset;
+        if (room == 0) {
+            if (sink->drain == NULL) {
+                goto end;
+            }
+            sink->drain(sink);
+            room = sink->len - sink->offset;
+        }
+        if (room > len) {
+            room = len;
+        }
+        memcpy(&sink->buf[sink->offset], str, room);
+        sink->offset += room;
+        str += room;
+        len -= room;
+    }
+end:
+    return;
 }
 
-void dbgbuffer_flush(void)
+/*
+ * write count times the given char to the output sink (padding)
+ */
+static inline void dbgbuffer_write_pad(print_sink_t *sink, const char c, uint8_t count)
 {
-    memset(&dbgbuf.buf[0], 0x0, BUF_MAX);
-    dbgbuf.offset = 0;
+    for (uint8_t i = 0; i < count; ++i) {
+        dbgbuffer_write_char(sink, c);
+    }
 }
 
+/*********************************************
+ * integer conversion utility functions
+ *
+ * Digits are written backward, from the given end of a local buffer, and the
+ * functions return the first digit position, so that the number length is known
+ * once converted, without any other pass. No 64 bits division is made per digit:
+ * - hexadecimal and octal digits are extracted by shift and mask
+ * - decimal digits are extracted two by two, using a multiplication by the
+ *   reciprocal of 100 and a two digits lookup table, 64 bits values being split
+ *   in 9 digits chunks first
+ */
+
+/* 64 bits value in octal */
+#define FS_NUM_MAX_DIGITS 22
+
+static const char fs_hex_digits[] = "0123456789abcdef";
+
+static const char fs_dec_pairs[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
 
 /*
- * add a char in the ring buffer.
- *
- * INFO: by now, there is no bound check here. As a consequence, if
- * the ring buffer is full,
- *
- * WARNING: this function is the only one holding the ring buffer full
- * flag detection. As a consequence, any write access to the ring buffer
- * must be done through this function *exclusively*.
+ * Write the decimal digits of a 32 bits value. For any 32 bits v,
+ * (v * 0x51eb851f) >> 37 is v / 100.
  */
-static inline void dbgbuffer_write_char(const char c)
+static inline char *print_dec_u32(char *end, uint32_t value)
 {
-    /* if the buffer is full when we try to put char in it,
-     * the char is discared, waiting for the ring buffer to be flushed.
-     */
-    if (dbgbuf.offset == BUF_MAX) {
-        goto end;
+    char *ptr = end;
+
+    while (value >= 100U) {
+        const uint32_t quot = (uint32_t)(((uint64_t)value * 0x51eb851fULL) >> 37);
+        const uint32_t rem = value - (quot * 100U);
+        ptr -= 2;
+        memcpy(ptr, &fs_dec_pairs[2U * rem], 2);
+        value = quot;
     }
-    dbgbuf.buf[dbgbuf.offset++] = c;
- end:
-    return;
+    if (value >= 10U) {
+        ptr -= 2;
+        memcpy(ptr, &fs_dec_pairs[2U * value], 2);
+    } else {
+        *--ptr = (char)('0' + value);
+    }
+    return ptr;
 }
 
-/*
- * Write a digit to the ring buffer.
- * This function convert a basic digit into a printable one.
- *
- * This function support usual bases such as binary
- *
- * INFO: this function can write digits in base up to hexadecimal one.
- * Bases bigger than hex are not supported.
- *
- */
-static inline void dbgbuffer_write_digit(uint8_t digit)
+static inline char *print_dec_u64(char *end, uint64_t value)
 {
-    if (digit < 0xa) {
-        digit += '0';
-        dbgbuffer_write_char(digit);
-    } else if (digit <= 0xf) {
-        digit += 'a' - 0xa;
-        dbgbuffer_write_char(digit);
+    char *ptr = end;
+
+    /* at most two 64 bits divisions, for the lower 9 digits chunks */
+    while (value > UINT32_MAX) {
+        const uint64_t quot = value / 1000000000U;
+        char *chunk = print_dec_u32(ptr, (uint32_t)(value - (quot * 1000000000U)));
+        /* inner chunks are zero filled */
+        while (ptr - chunk < 9) {
+            *--chunk = '0';
+        }
+        ptr = chunk;
+        value = quot;
     }
+    return print_dec_u32(ptr, (uint32_t)value);
 }
 
 /*
- * copy a string to the ring buffer. This is an abstraction of the
- * dbgbuffer_write_char() function.
- *
- * This function is a helper function above dbgbuffer_write_char().
+ * Write the digits of a value in a power of 2 base (2^shift)
  */
- /*@
-   requires \valid_read(str);
-  */
-static inline void dbgbuffer_write_string(char *str, uint32_t len)
+static inline char *print_pow2_u64(char *end, uint64_t value, uint8_t shift)
 {
-    for (uint32_t i = 0; (i < len) && (str[i]); ++i) {
-        dbgbuffer_write_char(str[i]);
+    const uint32_t mask = (1U << shift) - 1U;
+    char *ptr = end;
+
+    while (value > UINT32_MAX) {
+        *--ptr = fs_hex_digits[(uint32_t)value & mask];
+        value >>= shift;
     }
-    return;
+    /* 32 bits shifts for the remaining digits */
+    uint32_t low = (uint32_t)value;
+    do {
+        *--ptr = fs_hex_digits[low & mask];
+        low >>= shift;
+    } while (low != 0);
+    return ptr;
 }
 
+/**************************************************
+ * printf lexer implementation
+ *************************************************/
+
+typedef enum {
+    FS_LEN_DEFAULT,
+    FS_LEN_CHAR,        /* hh */
+    FS_LEN_SHORT,       /* h */
+    FS_LEN_LONG,        /* l */
+    FS_LEN_LONGLONG,    /* ll */
+} fs_length_t;
+
+/*
+ * Format specification, parsed once from the format string, between the '%' char
+ * and the conversion char: %[0][width][length]conversion
+ */
+typedef struct {
+    bool        attr_0len;  /* zero padding */
+    uint8_t     width;      /* minimum output width, 0 if not set */
+    fs_length_t length;
+} fs_spec_t;
+
+/*
+ * conversion handler, called with the argument list positioned on its argument.
+ * Returns 0 on success, 1 if the format specification is invalid for this conversion.
+ */
+typedef uint8_t (*fs_conv_fn)(print_sink_t *sink, const fs_spec_t *spec, va_list *args);
 
-static uint8_t number[64];
 /*
- * Write a number in the ring buffer.
- * This function is a helper function above dbgbuffer_write_char().
+ * Fetch a signed integer argument, considering the length modifier
  */
-static inline void dbgbuffer_write_u64(uint64_t value, const uint32_t base)
+static inline int64_t print_arg_signed(const fs_spec_t *spec, va_list *args)
 {
-    /* we define a local storage to hold the digits list
-     * in any possible base up to base 2 (64 bits) */
+    int64_t val;
+
+    switch (spec->length) {
+        case FS_LEN_LONGLONG:
+            val = va_arg(*args, long long);
+            break;
+        case FS_LEN_LONG:
+            val = va_arg(*args, long);
+            break;
+        case FS_LEN_SHORT:
+            val = (short)va_arg(*args, int);
+            break;
+        case FS_LEN_CHAR:
+            val = (signed char)va_arg(*args, int);
+            break;
+        default:
+            val = va_arg(*args, int);
+            break;
+    }
+    return val;
+}
 
-    uint8_t     index = 0;
-    if ((base != 10) && (base != 8) && (base != 16)) {
-        goto end;
+/*
+ * Fetch an unsigned integer argument, considering the length modifier
+ */
+static inline uint64_t print_arg_unsigned(const fs_spec_t *spec, va_list *args)
+{
+    uint64_t val;
+
+    switch (spec->length) {
+        case FS_LEN_LONGLONG:
+            val = va_arg(*args, unsigned long long);
+            break;
+        case FS_LEN_LONG:
+            val = va_arg(*args, unsigned long);
+            break;
+        case FS_LEN_SHORT:
+            val = (unsigned short)va_arg(*args, unsigned int);
+            break;
+        case FS_LEN_CHAR:
+            val = (unsigned char)va_arg(*args, unsigned int);
+            break;
+        default:
+            val = va_arg(*args, unsigned int);
+            break;
     }
+    return val;
+}
 
-    for (; (value / base) != 0; value /= base) {
-        number[index++] = value % base;
-        if (index >= 64) {
-            goto end;
-        }
+/*
+ * Write an integer with its optional prefix (sign or 0x), padded up to the
+ * specification width: with 0s between the prefix and the digits if zero padding
+ * is set, with spaces before the prefix otherwise.
+ */
+static void print_integer(print_sink_t *sink, const fs_spec_t *spec, uint64_t value,
+                          uint8_t base, const char *prefix, uint8_t prefix_len)
+{
+    char digits[FS_NUM_MAX_DIGITS];
+    char *const end = &digits[FS_NUM_MAX_DIGITS];
+    const char *start;
+    uint8_t len;
+    uint8_t pad;
+
+    switch (base) {
+        case 16:
+            start = print_pow2_u64(end, value, 4);
+            break;
+        case 8:
+            start = print_pow2_u64(end, value, 3);
+            break;
+        default:
+            start = (value > UINT32_MAX) ? print_dec_u64(end, value) : print_dec_u32(end, (uint32_t)value);
+            break;
+    }
+    len = (uint8_t)(end - start) + prefix_len;
+    pad = (spec->width > len) ? spec->width - len : 0;
+
+    if (spec->attr_0len) {
+        dbgbuffer_write_span(sink, prefix, prefix_len);
+        dbgbuffer_write_pad(sink, '0', pad);
+    } else {
+        dbgbuffer_write_pad(sink, ' ', pad);
+        dbgbuffer_write_span(sink, prefix, prefix_len);
     }
+    dbgbuffer_write_span(sink, start, (size_t)(end - start));
+}
 
-    /* finishing with most significant unit */
-    number[index] = value % base;
+static uint8_t print_conv_signed(print_sink_t *sink, const fs_spec_t *spec, va_list *args)
+{
+    const int64_t val = print_arg_signed(spec, args);
 
-    /* now we can print out, starting with the most significant unit */
-    for (; ; index--) {
-        dbgbuffer_write_digit(number[index]);
-        if (index == 0) {
-            goto end;
-        }
+    if (val < 0) {
+        /* unsigned negation, INT64_MIN safe */
+        print_integer(sink, spec, 0 - (uint64_t)val, 10, "-", 1);
+    } else {
+        print_integer(sink, spec, (uint64_t)val, 10, NULL, 0);
     }
-end:
-    return;
+    return 0;
 }
 
-static inline void dbgbuffer_write_u32(uint32_t value, const uint32_t base)
+static uint8_t print_conv_unsigned(print_sink_t *sink, const fs_spec_t *spec, va_list *args)
 {
-    dbgbuffer_write_u64((uint64_t)value, base);
+    print_integer(sink, spec, print_arg_unsigned(spec, args), 10, NULL, 0);
+    return 0;
 }
 
-static inline void dbgbuffer_write_u16(uint16_t value, const uint32_t base)
+static uint8_t print_conv_hex(print_sink_t *sink, const fs_spec_t *spec, va_list *args)
 {
-    dbgbuffer_write_u64((uint64_t)value, base);
+    print_integer(sink, spec, print_arg_unsigned(spec, args), 16, NULL, 0);
+    return 0;
 }
 
-
-/*********************************************
- * other, not ring-buffer associated local utility functions
- */
+static uint8_t print_conv_octal(print_sink_t *sink, const fs_spec_t *spec, va_list *args)
+{
+    print_integer(sink, spec, print_arg_unsigned(spec, args), 8, NULL, 0);
+    return 0;
+}
 
 /*
- * Return the number of digits of the given number, considering
- * the base in which the number is encoded.
+ * Handling pointers. Include 0x prefix, as if using %#x format string in POSIX printf.
+ * The width does not include the prefix.
  */
-static uint8_t dbgbuffer_get_number_len(unsigned long value, uint8_t base)
+static uint8_t print_conv_pointer(print_sink_t *sink, const fs_spec_t *spec, va_list *args)
 {
-    /* at least, if value is 0, its lenght is 1 digit */
-    uint8_t len = 1;
+    fs_spec_t ptr_spec = *spec;
+    const uintptr_t val = (uintptr_t)va_arg(*args, void *);
 
-    /* now we calculate the number of digits in the number */
-    for (; (value / base) != 0; value /= base) {
-        len++;
+    if (ptr_spec.width > 0 && ptr_spec.width < UINT8_MAX - 2) {
+        ptr_spec.width += 2;
     }
-    return len;
+    print_integer(sink, &ptr_spec, val, 16, "0x", 2);
+    return 0;
 }
 
-/**************************************************
- * printf lexer implementation
- *************************************************/
+static uint8_t print_conv_string(print_sink_t *sink, const fs_spec_t *spec, va_list *args)
+{
+    uint8_t status = 1;
+    const char *str = va_arg(*args, const char *);
+    size_t len;
 
-typedef enum {
-    FS_NUM_DECIMAL,
-    FS_NUM_HEX,
-    FS_NUM_UCHAR,
-    FS_NUM_SHORT,
-    FS_NUM_LONG,
-    FS_NUM_UNSIGNEDLONG,
-    FS_NUM_LONGLONG,
-    FS_NUM_UNSIGNEDLONGLONG,
-    FS_NUM_UNSIGNED,
-} fs_num_mode_t;
+    /* no 0len attribute for strings */
+    if (spec->attr_0len) {
+        goto err;
+    }
+    if (str == NULL) {
+        str = "(null)";
+    }
+    /* the string is streamed up to its end, whatever the buffer size is */
+    len = strlen(str);
+    if (spec->width > len) {
+        dbgbuffer_write_pad(sink, ' ', spec->width - (uint8_t)len);
+    }
+    dbgbuffer_write_span(sink, str, len);
+    status = 0;
+err:
+    return status;
+}
 
-typedef struct {
-    bool    attr_0len;
-    bool    attr_size;
-    uint8_t size;
-    fs_num_mode_t numeric_mode;
-    bool    started;
-    uint8_t consumed;
-    uint32_t strlen;
-} fs_properties_t;
+static uint8_t print_conv_char(print_sink_t *sink, const fs_spec_t *spec, va_list *args)
+{
+    uint8_t status = 1;
+    const unsigned char val = (unsigned char)va_arg(*args, int);
 
+    /* no 0len attribute for chars */
+    if (spec->attr_0len) {
+        goto err;
+    }
+    if (spec->width > 1) {
+        dbgbuffer_write_pad(sink, ' ', spec->width - 1);
+    }
+    dbgbuffer_write_char(sink, (char)val);
+    status = 0;
+err:
+    return status;
+}
+
+/*
+ * Conversion chars dispatch table, from FS_CONV_FIRST to FS_CONV_LAST.
+ * Unsupported conversions are NULL.
+ */
+#define FS_CONV_FIRST 'c'
+#define FS_CONV_LAST  'x'
+
+static const fs_conv_fn fs_conv_table[FS_CONV_LAST - FS_CONV_FIRST + 1] = {
+    ['c' - FS_CONV_FIRST] = print_conv_char,
+    ['d' - FS_CONV_FIRST] = print_conv_signed,
+    ['i' - FS_CONV_FIRST] = print_conv_signed,
+    ['o' - FS_CONV_FIRST] = print_conv_octal,
+    ['p' - FS_CONV_FIRST] = print_conv_pointer,
+    ['s' - FS_CONV_FIRST] = print_conv_string,
+    ['u' - FS_CONV_FIRST] = print_conv_unsigned,
+    ['x' - FS_CONV_FIRST] = print_conv_hex,
+};
 
 /*
  * Handle one format string (starting with '%' char).
  *
  * This function transform a format string into an effective content using given
- * va_list argument.
+ * va_list argument: the format specification is parsed once, in a single pass, and
+ * the conversion is dispatched through the conversion table.
  *
  * The function updated the consumed argument with the number of char consumed
  * by the format string itself, and return 0 if the format string has been
  * correctly parsed, or 1 if the format string parsing failed.
  */
-static uint8_t print_handle_format_string(const char *fmt, va_list *args,
-                                          uint8_t * consumed,
-                                          uint32_t * out_str_len)
+static uint8_t print_handle_format_string(print_sink_t *sink, const char *fmt, va_list *args,
+                                          size_t *consumed)
 {
     uint8_t status = 1; /* invalid */
-    fs_properties_t fs_prop = {
+    fs_spec_t spec = {
         .attr_0len = false,
-        .attr_size = false,
-        .size = 0,
-        .numeric_mode = FS_NUM_DECIMAL, /*default */
-        .started = false,
-        .consumed = 0,
-        .strlen = 0
+        .width = 0,
+        .length = FS_LEN_DEFAULT,
     };
-
-    /*
-     * Sanitation
-     */
-    if (!fmt || !consumed) {
-        return 1;
+    size_t i = 1; /* fmt[0] is '%' */
+    fs_conv_fn conv = NULL;
+
+    if (fmt[i] == '%') {
+        /* detecting '%' just after '%' */
+        dbgbuffer_write_char(sink, '%');
+        i++;
+        status = 0;
+        goto end;
     }
-
-    /* Let parse the format string ... */
-    do {
-        /*
-         * Handling '%' character
-         */
-        switch (fmt[fs_prop.consumed]) {
-            case '%':
-                {
-                    if (fs_prop.started == false) {
-                        /* starting string format parsing */
-                        fs_prop.started = true;
-                    } else if (fs_prop.consumed == 1) {
-                        /* detecting '%' just after '%' */
-                        dbgbuffer_write_char('%');
-                        fs_prop.strlen++;
-                        /* => end of format string */
-                        goto end;
-                    } else {
-                        /* invalid: there is content before two '%' chars
-                         * in the same format_string (e.g. %02%) */
-                        goto err;
-                    }
-                    break;
-                }
-            case '0':
-                {
-                    /*
-                     * Handling '0' character
-                     */
-                    if (fs_prop.started == false) {
-                        goto err;
-                    }
-                    fs_prop.attr_0len = true;
-                    /* 0 must be completed with size content. We check it now */
-                    while ((fmt[fs_prop.consumed + 1] >= '0') &&
-                           (fmt[fs_prop.consumed + 1] <= '9')) {
-                        /* getting back the size. Here only decimal values are handled */
-                        fs_prop.size =
-                            (fs_prop.size * 10) +
-			    (fmt[fs_prop.consumed + 1] - '0');
-                        fs_prop.consumed++;
-                    }
-                    /* if digits have been found after the 0len format string, attr_size is
-                     * set to true
-                     */
-                    if (fs_prop.size != 0) {
-                        fs_prop.attr_size = true;
-                    }
-                    break;
-                }
-            case 'd':
-            case 'i':
-                {
-                    /*
-                     * Handling integers
-                     */
-                    if (fs_prop.started == false) {
-                        goto err;
-                    }
-                    fs_prop.numeric_mode = FS_NUM_DECIMAL;
-                    int     val = va_arg(*args, int);
-                    uint8_t len = dbgbuffer_get_number_len(val, 10);
-
-                    if (val < 0 ) {
-                        dbgbuffer_write_char('-');
-                        val = -val;
-                        fs_prop.strlen++;
-                    }
-                    if (fs_prop.attr_size && fs_prop.attr_0len) {
-                        /* we have to pad with 0 the number to reach
-                         * the desired size */
-                        for (uint32_t i = len; i < fs_prop.size; ++i) {
-                            dbgbuffer_write_char('0');
-                            fs_prop.strlen++;
-                        }
-                    }
-                    /* now we can print the number in argument */
-                    dbgbuffer_write_u32((uint32_t)val, 10);
-                    fs_prop.strlen += len;
-                    /* => end of format string */
-                    goto end;
-                }
-            case 'l':
-                {
-                    /*
-                     * Handling long and long long int
-                     */
-                    long    lval = 0;
-                    long long llval = 0;
-                    unsigned long    luval = 0;
-                    unsigned long long lluval = 0;
-                    uint8_t len = 0;
-
-                    if (fs_prop.started == false) {
-                        goto err;
-                    }
-                    fs_prop.numeric_mode = FS_NUM_LONG;
-                    /* detecting long long */
-                    if (fmt[fs_prop.consumed + 1] == 'l') {
-                        fs_prop.numeric_mode = FS_NUM_LONGLONG;
-                        fs_prop.consumed++;
-                    }
-                    /* detecting long (long) unsigned */
-                    if (fmt[fs_prop.consumed + 1] == 'u') {
-                        if (fs_prop.numeric_mode == FS_NUM_LONG) {
-                            fs_prop.numeric_mode = FS_NUM_UNSIGNEDLONG;
-                        } else {
-                            fs_prop.numeric_mode = FS_NUM_UNSIGNEDLONGLONG;
-                        }
-                        fs_prop.consumed++;
-                    }
-                    switch (fs_prop.numeric_mode) {
-                        case FS_NUM_LONG:
-                            lval = va_arg(*args, long);
-                            len = dbgbuffer_get_number_len(lval, 10);
-                            break;
-                        case FS_NUM_LONGLONG:
-                            llval = va_arg(*args, long long);
-                            len = dbgbuffer_get_number_len(llval, 10);
-                            break;
-                        case FS_NUM_UNSIGNEDLONG:
-                            luval = va_arg(*args, unsigned long);
-                            len = dbgbuffer_get_number_len(luval, 10);
-                            break;
-                        case FS_NUM_UNSIGNEDLONGLONG:
-                            lluval = va_arg(*args, unsigned long long);
-                            len = dbgbuffer_get_number_len(lluval, 10);
-                            break;
-                        default:
-                            __builtin_unreachable();
-                            break;
-                    }
-                    if (fs_prop.attr_size && fs_prop.attr_0len) {
-                        /* we have to pad with 0 the number to reach
-                         * the desired size */
-                        for (uint32_t i = len; i < fs_prop.size; ++i) {
-                            dbgbuffer_write_char('0');
-                            fs_prop.strlen++;
-                        }
-                    }
-                    /* now we can print the number in argument */
-                    switch (fs_prop.numeric_mode) {
-                        case FS_NUM_LONG:
-                            dbgbuffer_write_u32(lval, 10);
-                            break;
-                        case FS_NUM_LONGLONG:
-                            dbgbuffer_write_u64(llval, 10);
-                            break;
-                        case FS_NUM_UNSIGNEDLONG:
-                            dbgbuffer_write_u32(luval, 10);
-                            break;
-                        case FS_NUM_UNSIGNEDLONGLONG:
-                            dbgbuffer_write_u64(lluval, 10);
-                            break;
-                        default:
-                            __builtin_unreachable();
-                            break;
-                    }
-                    fs_prop.strlen += len;
-                    /* => end of format string */
-                    goto end;
-                }
-            case 'h':
-                {
-                    /*
-                     * Handling long and long long int
-                     */
-                    short   s_val = 0;
-                    unsigned char uc_val = 0;
-                    uint8_t len = 0;
-
-                    if (fs_prop.started == false) {
-                        goto err;
-                    }
-                    fs_prop.numeric_mode = FS_NUM_SHORT;
-                    /* detecting long long */
-                    if (fmt[fs_prop.consumed + 1] == 'h') {
-                        fs_prop.numeric_mode = FS_NUM_UCHAR;
-                        fs_prop.consumed++;
-                    }
-                    if (fs_prop.numeric_mode == FS_NUM_SHORT) {
-                        s_val = (short) va_arg(*args, int);
-
-                        len = dbgbuffer_get_number_len(s_val, 10);
-                    } else {
-                        uc_val = (unsigned char) va_arg(*args, int);
-
-                        len = dbgbuffer_get_number_len(uc_val, 10);
-                    }
-                    if (fs_prop.attr_size && fs_prop.attr_0len) {
-                        /* we have to pad with 0 the number to reach
-                         * the desired size */
-                        for (uint32_t i = len; i < fs_prop.size; ++i) {
-                            dbgbuffer_write_char('0');
-                            fs_prop.strlen++;
-                        }
-                    }
-                    /* now we can print the number in argument */
-                    if (fs_prop.numeric_mode == FS_NUM_SHORT) {
-                        dbgbuffer_write_u16((uint16_t)s_val, 10);
-                    } else {
-                        dbgbuffer_write_u16((uint16_t)uc_val, 10);
-                    }
-                    fs_prop.strlen += len;
-                    /* => end of format string */
-                    goto end;
-                }
-            case 'u':
-                {
-                    /*
-                     * Handling unsigned
-                     */
-                    if (fs_prop.started == false) {
-                        goto err;
-                    }
-                    fs_prop.numeric_mode = FS_NUM_UNSIGNED;
-                    uint32_t val = va_arg(*args, uint32_t);
-                    uint8_t len = dbgbuffer_get_number_len(val, 10);
-
-                    if (fs_prop.attr_size && fs_prop.attr_0len) {
-                        /* we have to pad with 0 the number to reach
-                         * the desired size */
-                        for (uint32_t i = len; i < fs_prop.size; ++i) {
-                            dbgbuffer_write_char('0');
-                            fs_prop.strlen++;
-                        }
-                    }
-                    /* now we can print the number in argument */
-                    dbgbuffer_write_u32(val, 10);
-                    fs_prop.strlen += len;
-                    /* => end of format string */
-                    goto end;
-                }
-            case 'p':
-                {
-                    /*
-                     * Handling pointers. Include 0x prefix, as if using
-                     * %#x format string in POSIX printf.
-                     */
-                    if (fs_prop.started == false) {
-                        goto err;
-                    }
-                    unsigned long val = va_arg(*args, unsigned long);
-                    uint8_t len = dbgbuffer_get_number_len(val, 16);
-
-                    dbgbuffer_write_string("0x", 2);
-                    for (uint32_t i = len; i < fs_prop.size; ++i) {
-                        dbgbuffer_write_char('0');
-                        fs_prop.strlen++;
-                    }
-                    /* now we can print the number in argument */
-                    dbgbuffer_write_u64(val, 16);
-                    fs_prop.strlen += len;
-                    /* => end of format string */
-                    goto end;
-                }
-
-            case 'x':
-                {
-                    /*
-                     * Handling hexadecimal
-                     */
-                    if (fs_prop.started == false) {
-                        goto err;
-                    }
-                    fs_prop.numeric_mode = FS_NUM_UNSIGNED;
-                    uint32_t val = va_arg(*args, uint32_t);
-                    uint8_t len = dbgbuffer_get_number_len(val, 16);
-
-                    if (fs_prop.attr_size && fs_prop.attr_0len) {
-                        /* we have to pad with 0 the number to reach
-                         * the desired size */
-                        for (uint32_t i = len; i < fs_prop.size; ++i) {
-                            dbgbuffer_write_char('0');
-                            fs_prop.strlen++;
-                        }
-                    }
-                    /* now we can print the number in argument */
-                    dbgbuffer_write_u32(val, 16);
-                    fs_prop.strlen += len;
-                    /* => end of format string */
-                    goto end;
-                }
-            case 'o':
-                {
-                    /*
-                     * Handling octal
-                     */
-                    if (fs_prop.started == false) {
-                        goto err;
-                    }
-                    fs_prop.numeric_mode = FS_NUM_UNSIGNED;
-                    uint32_t val = va_arg(*args, uint32_t);
-                    uint8_t len = dbgbuffer_get_number_len(val, 8);
-
-                    if (fs_prop.attr_size && fs_prop.attr_0len) {
-                        /* we have to pad with 0 the number to reach
-                         * the desired size */
-                        for (uint32_t i = len; i < fs_prop.size; ++i) {
-                            dbgbuffer_write_char('0');
-                            fs_prop.strlen++;
-                        }
-                    }
-                    /* now we can print the number in argument */
-                    dbgbuffer_write_u32(val, 8);
-                    fs_prop.strlen += len;
-
-                    /* => end of format string */
-                    goto end;
-                }
-            case 's':
-                {
-                    /*
-                     * Handling strings
-                     */
-                    if (fs_prop.started == false) {
-                        goto err;
-                    }
-                    /* no size or 0len attribute for strings */
-                    if (fs_prop.attr_size && fs_prop.attr_0len) {
-                        goto err;
-                    }
-                    char   *str = va_arg(*args, char *);
-                    if (str == NULL) {
-                        dbgbuffer_write_string("(null)", 6);
-                        fs_prop.strlen += 6;
-                    } else {
-                        /* now we can print the number in argument. The strnlen is
-                           more a best practice than a real protection as whatever the size is,
-                           the buffer never write more than its own size */
-                        dbgbuffer_write_string(str, strnlen(str, BUF_MAX));
-                        fs_prop.strlen += strnlen(str, BUF_MAX);
-                    }
-                    /* => end of format string */
-                    goto end;
-                }
-            case 'c':
-                {
-                    /*
-                     * Handling chars
-                     */
-                    if (fs_prop.started == false) {
-                        goto err;
-                    }
-                    /* no size or 0len attribute for strings */
-                    if (fs_prop.attr_size && fs_prop.attr_0len) {
-                        goto err;
-                    }
-                    unsigned char val = (unsigned char) va_arg(*args, int);
-
-                    /* now we can print the number in argument */
-                    dbgbuffer_write_char(val);
-
-                    /* => end of format string */
-                    goto end;
-                }
-
-                /* none of the above. Unsupported format */
-            default:
-                /* should not happend, unable to parse format string */
-                goto err;
-
+    /* flag */
+    if (fmt[i] == '0') {
+        spec.attr_0len = true;
+        i++;
+    }
+    /* width, only decimal values are handled */
+    while (fmt[i] >= '0' && fmt[i] <= '9') {
+        const uint32_t width = (spec.width * 10U) + (uint32_t)(fmt[i] - '0');
+        if (width > UINT8_MAX) {
+            goto end;
+        }
+        spec.width = (uint8_t)width;
+        i++;
+    }
+    /* length modifier */
+    if (fmt[i] == 'l') {
+        spec.length = FS_LEN_LONG;
+        i++;
+        if (fmt[i] == 'l') {
+            spec.length = FS_LEN_LONGLONG;
+            i++;
+        }
+    } else if (fmt[i] == 'h') {
+        spec.length = FS_LEN_SHORT;
+        i++;
+        if (fmt[i] == 'h') {
+            spec.length = FS_LEN_CHAR;
+            i++;
         }
-        fs_prop.consumed++;
-    } while (fmt[fs_prop.consumed]);
+    }
+    /* conversion */
+    if (fmt[i] >= FS_CONV_FIRST && fmt[i] <= FS_CONV_LAST) {
+        conv = fs_conv_table[fmt[i] - FS_CONV_FIRST];
+    }
+    if (conv == NULL) {
+        /* none of the above. Unsupported format */
+        goto end;
+    }
+    i++;
+    status = conv(sink, &spec, args);
 end:
-    status = 0;
-err:
-    *out_str_len += fs_prop.strlen;
-    *consumed = fs_prop.consumed + 1;   /* consumed is starting with 0 */
+    *consumed = i;
     return status;
 }
 
 
 /*
- * Print a given fmt string, considering variable arguments given in args.
- * This function *does not* flush the ring buffer, but only fullfill it.
+ * Print a given fmt string to the given sink, considering variable arguments given in args.
+ * This function *does not* drain the sink buffer once done, but only fullfill it.
+ * sizew is set to the formatted string length, including the chars discarded by
+ * a sink without drain callback (i.e. the length of the untruncated output).
+ *
+ * The format string is read once: each literal span up to the next '%' char is
+ * copied to the sink as a whole.
  */
 /*@
+   requires \valid(sink);
    requires \valid_read(fmt);
    requires \valid(sizew);
 */
-uint8_t print_with_len(const char *fmt, va_list *args, size_t *sizew)
+uint8_t print_with_len(print_sink_t *sink, const char *fmt, va_list *args, size_t *sizew)
 {
     uint8_t status = 1;
-    int     i = 0;
-    uint8_t consumed = 0;
-    uint32_t out_str_s = 0;
+    size_t i = 0;
+    size_t consumed = 0;
+    const size_t start = sink->total;
 
     while (fmt[i]) {
+        size_t span = i;
+        while (fmt[span] != '\0' && fmt[span] != '%') {
+            span++;
+        }
+        dbgbuffer_write_span(sink, &fmt[i], span - i);
+        i = span;
         if (fmt[i] == '%') {
-            status = print_handle_format_string(&(fmt[i]), args, &consumed, &out_str_s);
+            status = print_handle_format_string(sink, &fmt[i], args, &consumed);
             if (status != 0) {
                 /* the string format parsing has failed ! */
                 goto err;
             }
             i += consumed;
-            consumed = 0;
-        } else {
-            out_str_s++;
-            dbgbuffer_write_char(fmt[i++]);
         }
     }
     status = 0;
 err:
-    *sizew = out_str_s;
+    *sizew = sink->total - start;
     return status;
 }
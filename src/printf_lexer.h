@@ -5,13 +5,26 @@
 #ifndef LOG_LEXER_H
 #define LOG_LEXER_H
 
+#include <stdarg.h>
+#include <stddef.h>
 #include <inttypes.h>
 #include <stdbool.h>
 
-uint8_t print_with_len(const char *fmt, va_list *args, size_t *sizew);
+/*
+ * printf output sink: the formatted output is written once, in buf, by the lexer.
+ *
+ * When buf is full, drain is called to consume its content, and must set offset back
+ * to 0. With a NULL drain, the output is truncated to the buffer size. total counts
+ * all the formatted chars, written or discarded.
+ */
+typedef struct print_sink {
+    char   *buf;
+    size_t len;     /* buf size */
+    size_t offset;  /* chars currently held in buf */
+    size_t total;
+    void   (*drain)(struct print_sink *sink);
+} print_sink_t;
 
-uint16_t log_get_dbgbuf_offset(void);
-uint8_t* log_get_dbgbuf(void);
-void dbgbuffer_flush(void);
+uint8_t print_with_len(print_sink_t *sink, const char *fmt, va_list *args, size_t *sizew);
 
 #endif/*!LOG_LEXER_H*/
@@ -8,35 +8,31 @@
 #include <shield/string.h>
 #include <shield/private/errno.h>
 #include <shield/private/coreutils.h>
+#include <shield/private/event.h>
+#include <shield/private/timer.h>
 
 int sigpending(sigset_t *set)
 {
     int res = -1;
-    exchange_event_t * event = _memarea_get_svcexcange_event();
-    Status sysres;
-    uint32_t signal;
+    uint32_t signals;
 
     if (unlikely(set == NULL)) {
         __shield_set_errno(EFAULT);
         goto end;
     }
-    /* we may have more that one single signal pending. Checking while there are some pending sigs found */
-    do {
-        if (unlikely((sysres = __sys_wait_for_event(EVENT_TYPE_SIGNAL, WFE_WAIT_NO)) != STATUS_OK)) {
-            res = 0;
-            goto end;
-        }
-        if (event->type != EVENT_TYPE_SIGNAL) {
-            __shield_set_errno(EINVAL);
-            goto end;
-        }
-        signal = *(uint32_t*)&event->data[0];
-        if (signal > _SIGNUM) {
-            __shield_set_errno(EINVAL);
-            goto end;
+    /* we may have more that one single signal pending. Fetching while there are some pending
+     * events, the events demultiplexer keeps the other event types (IPC) pending */
+    while (__shield_event_fetch(WFE_WAIT_NO) == STATUS_OK) {
+        ;
+    }
+    timer_dispatch();
+    /* signals may also have been received while waiting for another event type */
+    signals = __shield_event_signals_take();
+    for (uint8_t signal = 1; signal <= _SIGNUM; ++signal) {
+        if (signals & (1UL << signal)) {
+            set->__val[signal-1] = true;
         }
-        set->__val[signal-1] = true;
-    } while (sysres == STATUS_OK);
+    }
     res = 0;
 end:
     return res;
@@ -4,7 +4,9 @@
 
 /*
  * This is a ligthway, high performance implementation of the POSIX message passing service.
- * There is, by now, no effective userspace queueing but only kernel queueing and IPC handling.
+ * Received messages are queued in userspace per source task (up to CONFIG_STD_POSIX_SYSV_MSQ_DEPTH
+ * messages each), on top of kernel queueing and IPC handling. Messages bigger than an IPC are
+ * emitted as framed fragments, reassembled at reception.
  * The goal here is to abstract the EwoK kernel IPC complexity into a user-friendly interface
  * without reducing their performances.
  *
@@ -20,41 +22,141 @@
 
 #include <shield/private/errno.h>
 #include <shield/private/coreutils.h>
+#include <shield/private/event.h>
+#include <shield/private/lz.h>
+#include <shield/private/msg.h>
+#include <shield/private/msgq.h>
+#include <shield/private/msgpool.h>
+#include <shield/private/msgkey.h>
+#include <shield/private/msgfrag.h>
+#include <shield/private/timeconv.h>
+#include <shield/private/timer.h>
 
 /**
  * the SVC exhcange area must hold:
  * - the exchange header set by the kernel
- * - the mtype field (long)
- * - the effective message content
+ * - the fragment header
+ * - the fragment content (mtype field and effective message content)
  */
-#define MAX_IPC_MSG_SIZE (CONFIG_SVC_EXCHANGE_AREA_LEN - sizeof(exchange_event_t) - sizeof(long))
-/* max number of cached messages per source task */
-#define CONFIG_STD_POSIX_SYSV_MSQ_DEPTH 1
-#define CONFIG_MAX_SYSV_MSG_LEN 1024
+#define QMSG_FRAG_DATA_LEN (CONFIG_SVC_EXCHANGE_AREA_LEN - sizeof(exchange_event_t) - sizeof(msgfrag_hdr_t))
+/** biggest mtext that fits in a single IPC */
+#define MAX_IPC_MSG_SIZE (QMSG_FRAG_DATA_LEN - sizeof(long))
 
-/* A message received by the kernel genuine type is char*. Though, its effective type here is struct msgbuf.
- * We use an union for clean cast. */
-typedef union {
-  struct msgbuf msgbuf;
-  char          msg[CONFIG_MAX_SYSV_MSG_LEN];
-} qsmsg_msgbuf_data_t;
+#if CONFIG_MAX_SYSV_MSG_LEN > 0xffff
+# error "SysV message size can't be bigger than 65535"
+#endif
 
-typedef struct __attribute__((packed)) {
+#if CONFIG_STD_POSIX_SYSV_MSQ_DEPTH > 32
+# error "SysV message queue depth can't be bigger than 32"
+#endif
 
-  bool                set;
-} qmsg_msgbuf_t;
+/** maximum number of destinations of msgsnd_multi() */
+#define QMSG_MULTI_MAX 32
 
-typedef struct __attribute__((packed)) {
+/**
+ * Messages are stored in a pool of fixed size blocks shared by all the queues, allocated
+ * when a message is queued (see shield/private/msgpool.h), with three block sizes:
+ * - small messages
+ * - messages received in a single IPC
+ * - messages received in several fragments (reassembly buffers)
+ * Blocks hold the overall message (mtype included), and are long-aligned.
+ */
+#define QMSG_POOL_BLOCK_LEN(len) (((len) + sizeof(long) - 1) & ~(sizeof(long) - 1))
+#define QMSG_POOL_SMALL_LEN QMSG_POOL_BLOCK_LEN(sizeof(long) + 24)
+#define QMSG_POOL_IPC_LEN   QMSG_POOL_BLOCK_LEN(QMSG_FRAG_DATA_LEN)
+#define QMSG_POOL_LARGE_LEN QMSG_POOL_BLOCK_LEN(sizeof(long) + CONFIG_MAX_SYSV_MSG_LEN)
+
+#if CONFIG_STD_POSIX_SYSV_POOL_SMALL_NUM > 32 || CONFIG_STD_POSIX_SYSV_POOL_IPC_NUM > 32 || \
+    CONFIG_STD_POSIX_SYSV_POOL_LARGE_NUM > 32
+# error "SysV message pool can't hold more than 32 blocks per size"
+#endif
+
+/**
+ * a locally queued message
+ */
+typedef struct {
+    struct msgbuf *msg;      /**< message content, including mtype, in a pool block */
+    size_t        msg_size;  /**< mtext size */
+#if defined(CONFIG_STD_POSIX_SYSV_MSG_STATS)
+    uint64_t      rx_us;     /**< reception time, for residence latency */
+#endif
+} qmsg_slot_t;
+
+#if defined(CONFIG_STD_POSIX_SYSV_TXQ)
+/**
+ * message waiting in the outbound queue of its destination, while the destination is busy
+ */
+typedef struct {
+    struct msgbuf *msg;    /**< message content, including mtype, in a pool block */
+    size_t        len;     /**< message length, mtype included */
+    size_t        offset;  /**< already emitted bytes (fragments), resumed from there */
+    uint8_t       msg_id;
+    uint8_t       flags;   /**< MSGFRAG_LZ if the message is compressed */
+} qmsg_tx_t;
+#endif
+
+/**
+ * queue counters, named after their struct msqid_ds field (see msgctl(IPC_STAT))
+ *
+ * The timestamps and the residence latency histogram are only kept with
+ * CONFIG_STD_POSIX_SYSV_MSG_STATS.
+ */
+typedef struct {
+    uint32_t      msg_snd_count;
+    uint32_t      msg_snd_bytes;
+    uint32_t      msg_snd_drops;
+    uint32_t      msg_rcv_count;
+    uint32_t      msg_rcv_bytes;
+    uint32_t      msg_drops;
+    uint32_t      msg_e2big;
+    uint8_t       msg_qhwm;
+#if defined(CONFIG_STD_POSIX_SYSV_MSG_STATS)
+    time_t        msg_stime;
+    time_t        msg_rtime;
+    uint32_t      msg_lat_count;
+    uint32_t      msg_lat_max_us;
+    uint32_t      msg_lat_hist[MSG_STATS_HIST_LEN];
+#endif
+} qmsg_stats_t;
+
+/**
+ * A message queue is a set of message slots, indexed by arrival order and by type (see
+ * shield/private/msgq.h). Selecting a message never reads nor moves the message contents.
+ */
+typedef struct {
     uint32_t      msg_lspid; /**< for broadcasting recv queue, id of the last sender */
-    uint32_t      msg_stime; /**< time of last snd event */
-    uint32_t      msg_rtime; /**< time of last rcv event */
-    qsmsg_msgbuf_data_t msg; /**< message content (for caching) */
-    size_t        msg_size;  /**< current message size, upto msgsz */
+    qmsg_stats_t  stats;    /**< counters, see msgctl(IPC_STAT) */
+    qmsg_slot_t   slots[CONFIG_STD_POSIX_SYSV_MSQ_DEPTH]; /**< queued messages */
+    msgq_index_t  index;    /**< queued messages index */
+    msgfrag_reasm_t reasm;  /**< message being reassembled, see shield/private/msgfrag.h */
+    uint8_t       borrowed; /**< slot lent by msgrcv_borrow(), QMSG_BORROW_NONE or QMSG_BORROW_IPC */
     uint16_t      msg_perm; /**< queue permission, used for the broadcast recv queue case (send forbidden) */
+    uint8_t       tx_msg_id; /**< identifier of the next emitted message */
+    bool          conflate; /**< latest-value mode, a message replaces the unread one of the same type */
+#if defined(CONFIG_STD_POSIX_SYSV_TXQ)
+    qmsg_tx_t     txq[CONFIG_STD_POSIX_SYSV_TXQ_DEPTH]; /**< outbound queue, messages not emitted yet */
+    uint8_t       tx_head;
+    uint8_t       tx_count;
+#endif
     bool          set;
     key_t         key;
 } qmsg_entry_t;
 
+/** no message lent by msgrcv_borrow() */
+#define QMSG_BORROW_NONE MSGQ_NIL
+/** message lent in place, from the events demultiplexer */
+#define QMSG_BORROW_IPC  (MSGQ_NIL - 1)
+
+/**
+ * a selected message, either queued (slot), or received and not queued yet (event)
+ */
+typedef struct {
+    const struct msgbuf     *msg;      /**< message, including mtype */
+    size_t                  msg_size;  /**< mtext size */
+    uint8_t                 slot;      /**< queue slot, MSGQ_NIL if not queued */
+    const exchange_event_t  *event;    /**< received IPC, if not queued */
+} qmsg_desc_t;
+
 /*
  * list of all msg queues. If key == 0, the message queue is not initalised.
  *
@@ -62,12 +164,504 @@ typedef struct __attribute__((packed)) {
  */
 static qmsg_entry_t qmsg_vector[CONFIG_MAX_TASKS];
 
+/* messages storage, shared by all the queues */
+static _Alignas(long) uint8_t qmsg_pool_small[CONFIG_STD_POSIX_SYSV_POOL_SMALL_NUM * QMSG_POOL_SMALL_LEN];
+static _Alignas(long) uint8_t qmsg_pool_ipc[CONFIG_STD_POSIX_SYSV_POOL_IPC_NUM * QMSG_POOL_IPC_LEN];
+static _Alignas(long) uint8_t qmsg_pool_large[CONFIG_STD_POSIX_SYSV_POOL_LARGE_NUM * QMSG_POOL_LARGE_LEN];
+
+#define QMSG_POOL_CLASSES 3
+
+/* sorted by increasing block size */
+static msgpool_class_t qmsg_pool[QMSG_POOL_CLASSES] = {
+    { .blocks = qmsg_pool_small, .block_len = QMSG_POOL_SMALL_LEN, .num = CONFIG_STD_POSIX_SYSV_POOL_SMALL_NUM, .used = 0 },
+    { .blocks = qmsg_pool_ipc, .block_len = QMSG_POOL_IPC_LEN, .num = CONFIG_STD_POSIX_SYSV_POOL_IPC_NUM, .used = 0 },
+    { .blocks = qmsg_pool_large, .block_len = QMSG_POOL_LARGE_LEN, .num = CONFIG_STD_POSIX_SYSV_POOL_LARGE_NUM, .used = 0 },
+};
+
+/* key to msqid index, see shield/private/msgkey.h */
+static msgkey_index_t qmsg_key_index;
+
+/**
+ * message handler registered for a (msqid, mtype) couple, see msgroute()
+ */
+typedef struct {
+    long          mtype;   /**< 0 for the queue default handler */
+    msg_handler_t handler; /**< NULL for an empty cell */
+    void          *arg;
+    uint8_t       msqid;
+} qmsg_route_t;
+
+/*
+ * router table: open addressing hash table with linear probing on (msqid, mtype), at
+ * least twice as big as the maximum number of routes
+ */
+#if CONFIG_STD_POSIX_SYSV_ROUTES <= 8
+# define QMSG_ROUTE_BITS 4
+#elif CONFIG_STD_POSIX_SYSV_ROUTES <= 16
+# define QMSG_ROUTE_BITS 5
+#elif CONFIG_STD_POSIX_SYSV_ROUTES <= 32
+# define QMSG_ROUTE_BITS 6
+#elif CONFIG_STD_POSIX_SYSV_ROUTES <= 64
+# define QMSG_ROUTE_BITS 7
+#else
+# error "SysV message router supports up to 64 routes"
+#endif
+#define QMSG_ROUTE_LEN (1UL << QMSG_ROUTE_BITS)
+
+static qmsg_route_t qmsg_routes[QMSG_ROUTE_LEN];
+static uint8_t qmsg_routes_num;
+
+#if defined(CONFIG_STD_POSIX_SYSV_LZ)
+/* compressed message being emitted: message length, then the LZ block */
+static uint8_t qmsg_lz_buf[sizeof(uint16_t) + sizeof(long) + CONFIG_MAX_SYSV_MSG_LEN];
+static uint16_t qmsg_lz_hash[LZ_HASH_LEN];
+#endif
+
 /*
  * Zeroify properly the qmsg_vector. This function is called at task early init state, before main,
  * by the zeroify_libc_globals() callback.
  */
 static inline void msg_zeroify(void) {
     memset((void*)qmsg_vector, 0x0, (CONFIG_MAX_TASKS * sizeof(qmsg_entry_t)));
+    memset((void*)&qmsg_key_index, 0x0, sizeof(qmsg_key_index));
+    memset((void*)qmsg_routes, 0x0, sizeof(qmsg_routes));
+    qmsg_routes_num = 0;
+    for (uint8_t c = 0; c < QMSG_POOL_CLASSES; ++c) {
+        qmsg_pool[c].used = 0;
+    }
+}
+
+/**
+ * @brief get back the msqid of the queue associated to the given key
+ *
+ * @return the msqid, or -1 if no queue is associated to key
+ */
+static inline int __msg_key_lookup(key_t key)
+{
+    return __msgkey_lookup(&qmsg_key_index, key);
+}
+
+/**
+ * @brief associate the given msqid to its queue key in the key index
+ */
+static inline void __msg_key_insert(uint8_t msqid)
+{
+    __msgkey_insert(&qmsg_key_index, msqid, qmsg_vector[msqid].key);
+}
+
+/**
+ * @brief remove the given msqid from the key index
+ */
+static inline void __msg_key_remove(uint8_t msqid)
+{
+    __msgkey_remove(&qmsg_key_index, msqid);
+}
+
+#if defined(CONFIG_STD_POSIX_SYSV_MSG_STATS)
+/**
+ * @brief current time in us for statistics, 0 if not readable
+ */
+static inline uint64_t __msg_stats_now_us(void)
+{
+    uint64_t now = 0;
+    __shield_time_now_us(&now);
+    return now;
+}
+#endif
+
+/**
+ * @brief account a newly queued message in the given slot
+ */
+static inline void __msg_stats_queued(qmsg_entry_t *entry, uint8_t slot_id)
+{
+    if (entry->index.count > entry->stats.msg_qhwm) {
+        entry->stats.msg_qhwm = entry->index.count;
+    }
+#if defined(CONFIG_STD_POSIX_SYSV_MSG_STATS)
+    entry->slots[slot_id].rx_us = __msg_stats_now_us();
+#else
+    (void)slot_id;
+#endif
+}
+
+/**
+ * @brief account a consumed message, queued in slot_id, or consumed at reception if MSGQ_NIL
+ */
+static void __msg_stats_rcv(qmsg_entry_t *entry, uint8_t slot_id, size_t msg_size)
+{
+    entry->stats.msg_rcv_count++;
+    entry->stats.msg_rcv_bytes += msg_size;
+#if defined(CONFIG_STD_POSIX_SYSV_MSG_STATS)
+    const uint64_t now = __msg_stats_now_us();
+    uint32_t lat_us = 0;
+    uint8_t bucket = 0;
+
+    if (slot_id != MSGQ_NIL && now > entry->slots[slot_id].rx_us) {
+        lat_us = (uint32_t)(now - entry->slots[slot_id].rx_us);
+        /* log2 bucket: number of significant bits of the latency */
+        bucket = 32 - __builtin_clz(lat_us);
+        if (bucket >= MSG_STATS_HIST_LEN) {
+            bucket = MSG_STATS_HIST_LEN - 1;
+        }
+    }
+    entry->stats.msg_rtime = __time_udiv1000000_u64(now);
+    entry->stats.msg_lat_count++;
+    entry->stats.msg_lat_hist[bucket]++;
+    if (lat_us > entry->stats.msg_lat_max_us) {
+        entry->stats.msg_lat_max_us = lat_us;
+    }
+#else
+    (void)slot_id;
+#endif
+}
+
+/**
+ * @brief account an emitted message, of len bytes (mtype included)
+ */
+static inline void __msg_stats_snd(qmsg_entry_t *entry, size_t len)
+{
+    entry->stats.msg_snd_count++;
+    entry->stats.msg_snd_bytes += len - sizeof(long);
+#if defined(CONFIG_STD_POSIX_SYSV_MSG_STATS)
+    entry->stats.msg_stime = __time_udiv1000000_u64(__msg_stats_now_us());
+#endif
+}
+
+/**
+ * @brief get back the message carried by an IPC made of a single fragment
+ *
+ * The IPC comes from the source of entry. The message being reassembled for this source,
+ * if any, is dropped if the IPC does not follow it, so that an interrupted message never
+ * keeps its reassembly buffer while the source only sends single IPC messages.
+ *
+ * @return true if the IPC holds a whole uncompressed message, returned in msg and msg_size
+ *         (mtext size)
+ */
+static bool __msg_frag_single(qmsg_entry_t *entry, const exchange_event_t *event,
+                              const struct msgbuf **msg, size_t *msg_size)
+{
+    bool res = false;
+    msgfrag_hdr_t hdr;
+
+    if (unlikely(event->length < sizeof(msgfrag_hdr_t))) {
+        goto end;
+    }
+    memcpy(&hdr, &event->data[0], sizeof(msgfrag_hdr_t));
+    if (__msgfrag_sync(&entry->reasm, qmsg_pool, QMSG_POOL_CLASSES, &hdr)) {
+        /* interrupted message */
+        entry->stats.msg_drops++;
+    }
+    if (event->length >= sizeof(msgfrag_hdr_t) + sizeof(long) &&
+        hdr.offset == 0 && (hdr.flags & (MSGFRAG_LAST | MSGFRAG_LZ)) == MSGFRAG_LAST) {
+        *msg = (const struct msgbuf *)&event->data[sizeof(msgfrag_hdr_t)];
+        *msg_size = event->length - sizeof(msgfrag_hdr_t) - sizeof(long);
+        if (unlikely(*msg_size > MAX_IPC_MSG_SIZE)) {
+            *msg_size = MAX_IPC_MSG_SIZE;
+        }
+        res = true;
+    }
+end:
+    return res;
+}
+
+/**
+ * @brief get back the used slot holding the given message
+ *
+ * @return the slot index, or MSGQ_NIL
+ */
+static uint8_t __msg_slot_lookup(const qmsg_entry_t *entry, const struct msgbuf *msg)
+{
+    uint8_t slot_id = MSGQ_NIL;
+
+    for (uint8_t i = 0; i < CONFIG_STD_POSIX_SYSV_MSQ_DEPTH; ++i) {
+        if ((entry->index.used & (1UL << i)) && entry->slots[i].msg == msg) {
+            slot_id = i;
+            break;
+        }
+    }
+    return slot_id;
+}
+
+/**
+ * @brief free a detached queue slot, and its message storage
+ */
+static void __msg_slot_free(qmsg_entry_t *entry, uint8_t slot_id)
+{
+    __msgpool_free(qmsg_pool, QMSG_POOL_CLASSES, entry->slots[slot_id].msg);
+    entry->slots[slot_id].msg = NULL;
+    __msgq_free(&entry->index, slot_id);
+}
+
+/**
+ * @brief queued message to replace with a new message of type mtype
+ *
+ * @return the slot of the unread message of type mtype of a conflating queue, or MSGQ_NIL
+ *         if the new message must be queued behind the others
+ */
+static inline uint8_t __msg_conflate_slot(const qmsg_entry_t *entry, long mtype)
+{
+    uint8_t slot_id = MSGQ_NIL;
+
+    if (unlikely(entry->conflate)) {
+        slot_id = __msgq_select(&entry->index, mtype, false);
+    }
+    return slot_id;
+}
+
+#if defined(CONFIG_STD_POSIX_SYSV_LZ)
+/**
+ * @brief handle the last fragment of a compressed message
+ *
+ * The message is decompressed from the reassembly buffer (previous fragments, if any)
+ * followed by the fragment content, to a pool block sized on the message. A compressed
+ * message of a conflating queue is never queued while the queue is full, its type being
+ * only known once decompressed.
+ *
+ * @param len[in]: fragment content length, the reassembly buffer having room for it
+ *
+ * @return false if the fragment can't be handled yet (no free pool block, or full queue).
+ */
+static bool __msg_lz_input(qmsg_entry_t *entry, const exchange_event_t *event, size_t len)
+{
+    bool res = true;
+    msgfrag_reasm_t *reasm = &entry->reasm;
+    const uint8_t *payload = &event->data[sizeof(msgfrag_hdr_t)];
+    struct msgbuf *block = NULL;
+    qmsg_slot_t *slot;
+    uint8_t slot_id;
+    uint16_t msg_len;
+    size_t out_len;
+
+    if (unlikely(__msgq_full(&entry->index))) {
+        __shield_event_ipc_unget(event);
+        res = false;
+        goto end;
+    }
+    if (reasm->buf != NULL) {
+        /* appended behind the previous fragments, the reassembly length is kept as is
+         * up to the message completion so that the fragment can still be pushed back */
+        memcpy(&reasm->buf[reasm->len], payload, len);
+        payload = reasm->buf;
+        len += reasm->len;
+    }
+    if (unlikely(len < sizeof(uint16_t))) {
+        goto drop;
+    }
+    memcpy(&msg_len, payload, sizeof(uint16_t));
+    if (unlikely(msg_len < sizeof(long) || msg_len > sizeof(long) + CONFIG_MAX_SYSV_MSG_LEN)) {
+        goto drop;
+    }
+    block = __msgpool_alloc(qmsg_pool, QMSG_POOL_CLASSES, msg_len);
+    if (unlikely(block == NULL)) {
+        __shield_event_ipc_unget(event);
+        res = false;
+        goto end;
+    }
+    if (unlikely(!__lz_decode(&payload[sizeof(uint16_t)], len - sizeof(uint16_t), (uint8_t *)block,
+                              0, msg_len, &out_len) || out_len != msg_len)) {
+        __msgpool_free(qmsg_pool, QMSG_POOL_CLASSES, block);
+        goto drop;
+    }
+    __msgfrag_abort(reasm, qmsg_pool, QMSG_POOL_CLASSES);
+    slot_id = __msg_conflate_slot(entry, block->mtype);
+    if (slot_id != MSGQ_NIL) {
+        /* the unread message is superseded, in place */
+        __msgpool_free(qmsg_pool, QMSG_POOL_CLASSES, entry->slots[slot_id].msg);
+        entry->stats.msg_drops++;
+    } else {
+        slot_id = __msgq_insert(&entry->index, block->mtype);
+    }
+    slot = &entry->slots[slot_id];
+    slot->msg = block;
+    slot->msg_size = msg_len - sizeof(long);
+    __msg_stats_queued(entry, slot_id);
+    goto end;
+drop:
+    __msgfrag_abort(reasm, qmsg_pool, QMSG_POOL_CLASSES);
+    entry->stats.msg_drops++;
+end:
+    return res;
+}
+#else
+/**
+ * @brief compressed messages are not supported, dropped
+ */
+static bool __msg_lz_input(qmsg_entry_t *entry, const exchange_event_t *event, size_t len)
+{
+    (void)event;
+    (void)len;
+    __msgfrag_abort(&entry->reasm, qmsg_pool, QMSG_POOL_CLASSES);
+    entry->stats.msg_drops++;
+    return true;
+}
+#endif
+
+/**
+ * @brief handle a fragment of a message received in several IPCs
+ *
+ * The reassembly itself is made by the shield/private/msgfrag.h helpers, the message
+ * being queued once complete.
+ *
+ * @return false if the fragment can't be handled yet (no free reassembly buffer, or
+ *         full queue for the last fragment). The IPC is then kept pending in the events
+ *         demultiplexer, up to the next receive.
+ */
+static bool __msg_reasm_input(qmsg_entry_t *entry, const exchange_event_t *event)
+{
+    bool res = true;
+    msgfrag_hdr_t hdr;
+    msgfrag_reasm_t *reasm = &entry->reasm;
+    qmsg_slot_t *slot;
+    uint8_t slot_id;
+    long mtype;
+    const size_t len = event->length - sizeof(msgfrag_hdr_t);
+
+    memcpy(&hdr, &event->data[0], sizeof(msgfrag_hdr_t));
+    if (__msgfrag_sync(reasm, qmsg_pool, QMSG_POOL_CLASSES, &hdr)) {
+        /* interrupted message */
+        entry->stats.msg_drops++;
+    }
+    if (reasm->buf == NULL && hdr.offset == 0 &&
+        (hdr.flags & (MSGFRAG_LAST | MSGFRAG_LZ)) == (MSGFRAG_LAST | MSGFRAG_LZ)) {
+        /* compressed message held by a single IPC, decompressed without reassembly */
+        res = __msg_lz_input(entry, event, len);
+        goto end;
+    }
+    switch (__msgfrag_start(reasm, qmsg_pool, QMSG_POOL_CLASSES, &hdr, len,
+                            sizeof(long) + CONFIG_MAX_SYSV_MSG_LEN)) {
+        case MSGFRAG_READY:
+            break;
+        case MSGFRAG_NOMEM:
+            __shield_event_ipc_unget(event);
+            res = false;
+            goto end;
+        case MSGFRAG_DROP:
+        default:
+            entry->stats.msg_drops++;
+            goto end;
+    }
+    if (hdr.flags & MSGFRAG_LZ) {
+        if (hdr.flags & MSGFRAG_LAST) {
+            res = __msg_lz_input(entry, event, len);
+            goto end;
+        }
+    } else if (hdr.flags & MSGFRAG_LAST) {
+        /* mtype is held by the first fragment */
+        if (unlikely(__msgq_full(&entry->index)) &&
+            (reasm->len < sizeof(long) ||
+             __msg_conflate_slot(entry, ((struct msgbuf *)reasm->buf)->mtype) == MSGQ_NIL)) {
+            /* the fragment is not consumed, the buffer is kept as is */
+            __shield_event_ipc_unget(event);
+            res = false;
+            goto end;
+        }
+    }
+    __msgfrag_append(reasm, &event->data[sizeof(msgfrag_hdr_t)], len);
+    if (!(hdr.flags & MSGFRAG_LAST)) {
+        goto end;
+    }
+    if (unlikely(reasm->len < sizeof(long))) {
+        __msgfrag_abort(reasm, qmsg_pool, QMSG_POOL_CLASSES);
+        entry->stats.msg_drops++;
+        goto end;
+    }
+    /* the queue slot takes the buffer ownership */
+    mtype = ((struct msgbuf *)reasm->buf)->mtype;
+    slot_id = __msg_conflate_slot(entry, mtype);
+    if (slot_id != MSGQ_NIL) {
+        /* the unread message is superseded, in place */
+        __msgpool_free(qmsg_pool, QMSG_POOL_CLASSES, entry->slots[slot_id].msg);
+        entry->stats.msg_drops++;
+    } else {
+        slot_id = __msgq_insert(&entry->index, mtype);
+    }
+    slot = &entry->slots[slot_id];
+    slot->msg_size = reasm->len - sizeof(long);
+    slot->msg = (struct msgbuf *)__msgfrag_take(reasm);
+    __msg_stats_queued(entry, slot_id);
+end:
+    return res;
+}
+
+/**
+ * @brief queue the given IPC to the message queue of its source
+ *
+ * @return false if the source queue is full. The IPC is then kept pending in the events
+ *         demultiplexer, up to the next receive.
+ */
+static bool __msg_enqueue(const exchange_event_t *event)
+{
+    bool res = true;
+    qmsg_entry_t *entry = NULL;
+    qmsg_slot_t *slot;
+    const struct msgbuf *msg;
+    struct msgbuf *block;
+    size_t msg_size;
+    uint8_t slot_id;
+    long mtype;
+    int msqid;
+
+    msqid = __msg_key_lookup(event->source);
+    if (likely(msqid >= 0)) {
+        entry = &qmsg_vector[msqid];
+    }
+    /** WARN: if an IPC from a source from which a msgget() has never been
+     * made is received, or if the IPC is not a message fragment, the IPC content is discarded */
+    if (unlikely(entry == NULL || event->length < sizeof(msgfrag_hdr_t))) {
+        goto end;
+    }
+    if (__msg_frag_single(entry, event, &msg, &msg_size) == false) {
+        res = __msg_reasm_input(entry, event);
+        goto end;
+    }
+    /* IPC data is not long-aligned */
+    memcpy(&mtype, msg, sizeof(long));
+    slot_id = __msg_conflate_slot(entry, mtype);
+    if (unlikely(slot_id == MSGQ_NIL && __msgq_full(&entry->index))) {
+        __shield_event_ipc_unget(event);
+        res = false;
+        goto end;
+    }
+    if (slot_id != MSGQ_NIL) {
+        /* the unread message is superseded, its storage can be used for the new one */
+        __msgpool_free(qmsg_pool, QMSG_POOL_CLASSES, entry->slots[slot_id].msg);
+        entry->slots[slot_id].msg = NULL;
+        entry->stats.msg_drops++;
+    }
+    /* message storage sized on the message, not on the IPC */
+    block = __msgpool_alloc(qmsg_pool, QMSG_POOL_CLASSES, sizeof(long) + msg_size);
+    if (unlikely(block == NULL)) {
+        if (slot_id != MSGQ_NIL) {
+            /* superseded message already dropped */
+            __msgq_remove(&entry->index, slot_id);
+        }
+        __shield_event_ipc_unget(event);
+        res = false;
+        goto end;
+    }
+    if (slot_id == MSGQ_NIL) {
+        slot_id = __msgq_insert(&entry->index, mtype);
+    }
+    slot = &entry->slots[slot_id];
+    memcpy(block, msg, sizeof(long) + msg_size);
+    slot->msg = block;
+    slot->msg_size = msg_size;
+    __msg_stats_queued(entry, slot_id);
+end:
+    return res;
+}
+
+bool __shield_msg_pending(void)
+{
+    bool res = false;
+
+    for (uint8_t i = 0; i < CONFIG_MAX_TASKS; ++i) {
+        if (qmsg_vector[i].index.count > 0) {
+            res = true;
+            break;
+        }
+    }
+    return res;
 }
 
 /*
@@ -82,23 +676,16 @@ int msgget(key_t key, int msgflg)
     /*
      * 1. Is there a previously cached qmsg id for the given key ?
      */
-    /*@
-      @ loop invariant \valid_read(qmsg_vector[0..CONFIG_MAXTASKS]);
-      @ loop invariant 0 <= i <= CONFIG_MAXTASKS+1;
-      @ loop assigns i;
-      @ loop variant ((CONFIG_MAXTASKS+1) - errcode);
-      */
-    for (uint8_t i = 0; i <= CONFIG_MAX_TASKS; ++i) {
-        if (unlikely(qmsg_vector[i].key == key && qmsg_vector[i].set == true)) {
-            if (msgflg & IPC_EXCL) {
-                /* fails if key exists */
-                errcode = -1; /* POSIX Compliance */
-                __shield_set_errno(EEXIST);
-            } else {
-                errcode = i;
-            }
-            goto err;
+    tid = __msg_key_lookup(key);
+    if (tid >= 0) {
+        if (msgflg & IPC_EXCL) {
+            /* fails if key exists */
+            errcode = -1; /* POSIX Compliance */
+            __shield_set_errno(EEXIST);
+        } else {
+            errcode = tid;
         }
+        goto err;
     }
 
     /*
@@ -124,328 +711,1492 @@ int msgget(key_t key, int msgflg)
     }
     qmsg_vector[tid].key = key;
     qmsg_vector[tid].msg_perm = 0x666; /* unicast communication. Permission is handled by kernel */
-    qmsg_vector[tid].msg_stime = 0;
-    qmsg_vector[tid].msg_rtime = 0;
-    qmsg_vector[tid].msg_size = 0;
+    memset(&qmsg_vector[tid].stats, 0x0, sizeof(qmsg_stats_t));
+    __msgq_init(&qmsg_vector[tid].index);
+    qmsg_vector[tid].borrowed = QMSG_BORROW_NONE;
+    qmsg_vector[tid].tx_msg_id = 0;
+    qmsg_vector[tid].reasm.buf = NULL;
+    qmsg_vector[tid].conflate = !!(msgflg & MSG_CONFLATE);
+#if defined(CONFIG_STD_POSIX_SYSV_TXQ)
+    qmsg_vector[tid].tx_head = 0;
+    qmsg_vector[tid].tx_count = 0;
+#endif
     qmsg_vector[tid].set = true;
+    __msg_key_insert(tid);
     errcode = tid;
 err:
     return errcode;
 }
 
-/*
- * Sending message msgp of size msgsz to 'msqid'.
+/**
+ * @brief check a send queue identifier
+ *
+ * @return 0, or the errno value
  */
-int msgsnd(int msqid, const void *msgp, size_t msgsz, int msgflg)
+static int __msg_snd_check(int msqid)
 {
-    int errcode = -1;
-    Status ret;
-    const uint8_t *__msgp = msgp;
-    size_t chunk_offset = 0;
-    size_t chunk_size;
-    /* total number of bytes to emit */
-    size_t __msgsz = msgsz + sizeof(long);
+    int err = 0;
 
-    if (msgp == NULL) {
-        errcode = -1; /* POSIX Compliance */
-        __shield_set_errno(EFAULT);
-        goto err;
-    }
-    if (msqid < 0 || msqid > CONFIG_MAX_TASKS) {
-        errcode = -1; /* POSIX Compliance */
-        __shield_set_errno(EINVAL);
-        goto err;
-    }
-    if (qmsg_vector[msqid].set == false) {
-        errcode = -1; /* POSIX Compliance */
-        __shield_set_errno(EINVAL);
-        goto err;
-    }
-    if (msgsz > MAX_IPC_MSG_SIZE) {
-        errcode = -1; /* POSIX Compliance */
-        __shield_set_errno(E2BIG);
-        goto err;
+    if (msqid < 0 || msqid >= CONFIG_MAX_TASKS) {
+        err = EINVAL;
+    } else if (qmsg_vector[msqid].set == false) {
+        err = EINVAL;
+    } else if (qmsg_vector[msqid].msg_perm == 0x444) {
+        err = EPERM;
     }
-    if (qmsg_vector[msqid].msg_perm == 0x444) {
-        errcode = -1; /* POSIX Compliance */
-        __shield_set_errno(EPERM);
+    return err;
+}
+
+/**
+ * @brief check a send queue identifier
+ *
+ * @return the queue entry, or NULL with errno set
+ */
+static qmsg_entry_t *__msg_snd_entry(int msqid)
+{
+    qmsg_entry_t *entry = NULL;
+    int err;
+
+    err = __msg_snd_check(msqid);
+    if (unlikely(err != 0)) {
+        __shield_set_errno(err);
         goto err;
     }
-    /* sending size+mtype field (long), possibly with multiple IPCs */
-    chunk_size = (__msgsz % MAX_IPC_MSG_SIZE);
-    do {
-        copy_to_kernel(__msgp, chunk_size);
-        ret = __sys_send_ipc(qmsg_vector[msqid].key, chunk_size);
-        __msgp += chunk_size;
-        __msgsz -= chunk_size;
-        if (__msgsz < chunk_size) {
-            /* support for residual */
-            chunk_size = __msgsz;
-        }
-    } while(__msgsz > 0);
-    /* clear queue once emitted */
-    memset(&qmsg_vector[msqid], 0x0, sizeof(qmsg_entry_t));
+    entry = &qmsg_vector[msqid];
+err:
+    return entry;
+}
+
+/**
+ * @brief errno value of a __sys_send_ipc() status
+ */
+static int __msg_emit_errno(Status ret)
+{
+    int err;
 
     switch (ret) {
-        case STATUS_INVALID:
-            errcode = -1; /* POSIX Compliance */
-            __shield_set_errno(EINVAL);
-            goto err;
+        case STATUS_OK:
+            err = 0;
             break;
         case STATUS_DENIED:
-            errcode = -1; /* POSIX Compliance */
-            __shield_set_errno(EACCES);
-            goto err;
+            err = EACCES;
             break;
         case STATUS_BUSY:
-            errcode = -1; /* POSIX Compliance */
-            __shield_set_errno(EAGAIN);
-            goto err;
-        case STATUS_OK:
+            err = EAGAIN;
             break;
+        case STATUS_INVALID:
         default:
             /* abnormal other return code, should not happen */
-            errcode = -1; /* POSIX Compliance */
-            __shield_set_errno(EINVAL);
-            goto err;
+            err = EINVAL;
             break;
     }
-    /* default on success */
-    errcode = 0;
-err:
-    return errcode;
+    return err;
 }
 
-/*
- * msgrcv return in msgp the content of mtext[]. The mtype field is ignored
- * as used as a discriminant for message selection purpose.
- * Although, as msgsnd()/msgrcv() API is **not** a kernel API, the received
- * buffer content the overall data (including mtype), as the kernel as no
- * idea of the msgbuf structure.
+/**
+ * @brief emit the IPC of len bytes already stored in the SVC exchange area
  *
- * As a consequence, we can't recv the content directly in msgp, as msgp
- * (and msgz) may be too short to recv the buffer including the mtype.
- *
- * A possible way, here is to:
- * - if the local msgbuf vector is full and mtype does not match any of the
- *   stored message, returns ENOMEM
- * - check the local msgbuf vector if there is a pending message with the
- *   corresponding mtype. If yes, returns it.
- * - If not, get back an IPC from the kernel
- *   gave back and:
- *      * if the mtype flags match the msgtyp argument, copy back the mtext content
- *        to msgp
- *      * if the mtype flag does not match the msgtyp argument, store the overall
- *        msgbuf content localy to a msgbuf vector, and:
- *          -> if IPC_NOWAIT is not set, try agin (blocking mode)
- *          -> in IPC_NOWAIT is set, return EGAIN (using waitforevent timeout=1).
+ * @return the __sys_send_ipc() status, errno being set if not STATUS_OK
  */
-ssize_t msgrcv(int msqid,
-               void *msgp,
-               size_t msgsz,
-               long msgtyp,
-               int msgflg)
+static Status __msg_emit(const qmsg_entry_t *entry, size_t len)
 {
-    ssize_t errcode = -1;
     Status ret;
-    int tid = msqid;
-    uint8_t i = 0;
-    uint8_t free_cell = 0;
-    int32_t timeout = 0;
-    size_t __msgsz = msgsz + sizeof(long);
-    uint8_t *__msgp = msgp;
-    size_t chunk_offset;
 
-    /* sanitation */
-    if (msgsz > CONFIG_MAX_SYSV_MSG_LEN) {
-        if (!(msgflg & MSG_NOERROR)) {
-            /* msgsz bigger than max transmittable content and truncate (NOERROR)
-             * not allowed */
-            errcode = -1; /* POSIX Compliance */
-            __shield_set_errno(EINVAL);
-            goto err;
-        }
+    ret = __sys_send_ipc(entry->key, len);
+    if (unlikely(ret != STATUS_OK)) {
+        __shield_set_errno(__msg_emit_errno(ret));
+    }
+    return ret;
+}
+
+/**
+ * @brief emit the message (mtype and mtext) made of the concatenation of the iov fragments
+ *
+ * Each fragment is assembled directly in the SVC exchange area (where copy_to_kernel()
+ * would have copied a contiguous buffer), behind its fragment header, without any
+ * intermediate buffer.
+ *
+ * If an IPC emission fails in the middle of a message, the already emitted fragments
+ * are dropped by the receiver when the next message is received, unless the emission
+ * is resumed, with the same msg_id, from the failed fragment.
+ *
+ * @param iov[in]: message content, starting at offset
+ * @param len[in]: message length, mtype included, checked by the caller
+ * @param flags[in]: MSGFRAG_LZ if iov holds a compressed message payload, whose mtype has
+ *        been checked by the caller
+ * @param offset[in,out]: already emitted bytes, updated with the newly emitted ones
+ *
+ * @return STATUS_OK, or the failure status (STATUS_INVALID on invalid mtype), errno being set
+ */
+static Status __msg_send_iov(qmsg_entry_t *entry, const struct iovec *iov, int iovcnt, size_t len,
+                             uint8_t msg_id, uint8_t flags, size_t *offset)
+{
+    Status ret = STATUS_OK;
+    uint8_t *area = (uint8_t *)_memarea_get_svcexcange_event();
+    uint8_t *frag = &area[sizeof(msgfrag_hdr_t)];
+    msgfrag_hdr_t hdr;
+    size_t iov_offset = 0;
+    int i = 0;
+    long mtype;
+
+    hdr.msg_id = msg_id;
+    do {
+        size_t chunk = len - *offset;
+        size_t fill = 0;
+
+        if (chunk > QMSG_FRAG_DATA_LEN) {
+            chunk = QMSG_FRAG_DATA_LEN;
+        }
+        /* gather the fragment content */
+        while (fill < chunk && i < iovcnt) {
+            size_t n = iov[i].iov_len - iov_offset;
+            if (n > chunk - fill) {
+                n = chunk - fill;
+            }
+            memcpy(&frag[fill], (const uint8_t *)iov[i].iov_base + iov_offset, n);
+            fill += n;
+            iov_offset += n;
+            if (iov_offset == iov[i].iov_len) {
+                i++;
+                iov_offset = 0;
+            }
+        }
+        if (unlikely(fill < chunk)) {
+            /* iov shorter than len, should not happen */
+            __shield_set_errno(EINVAL);
+            ret = STATUS_INVALID;
+            goto err;
+        }
+        if (*offset == 0 && !(flags & MSGFRAG_LZ)) {
+            /* the first fragment holds at least the whole mtype field */
+            memcpy(&mtype, frag, sizeof(long));
+            if (mtype < 1) {
+                /* mtype must be positive, negative msgtyp being used for selection at receive time */
+                __shield_set_errno(EINVAL);
+                ret = STATUS_INVALID;
+                goto err;
+            }
+        }
+        hdr.offset = *offset;
+        hdr.flags = flags | ((*offset + chunk == len) ? MSGFRAG_LAST : 0);
+        memcpy(area, &hdr, sizeof(msgfrag_hdr_t));
+        ret = __msg_emit(entry, sizeof(msgfrag_hdr_t) + chunk);
+        if (ret != STATUS_OK) {
+            goto err;
+        }
+        *offset += chunk;
+    } while (*offset < len);
+    __msg_stats_snd(entry, len);
+err:
+    return ret;
+}
+
+#if defined(CONFIG_STD_POSIX_SYSV_TXQ)
+/**
+ * @brief copy the message to the outbound queue of its destination
+ *
+ * @param flags[in]: MSGFRAG_LZ for a compressed message payload
+ * @param offset[in]: already emitted bytes, the emission being resumed from there
+ *
+ * @return 0, or -1 with errno set (EAGAIN if the outbound queue or the messages pool is full)
+ */
+static int __msg_tx_queue(qmsg_entry_t *entry, const struct iovec *iov, int iovcnt, size_t len,
+                          uint8_t msg_id, uint8_t flags, size_t offset)
+{
+    int errcode = -1;
+    qmsg_tx_t *tx;
+    uint8_t *block;
+    size_t fill = 0;
+
+    if (unlikely(entry->tx_count == CONFIG_STD_POSIX_SYSV_TXQ_DEPTH)) {
+        __shield_set_errno(EAGAIN);
+        goto err;
+    }
+    block = __msgpool_alloc(qmsg_pool, QMSG_POOL_CLASSES, len);
+    if (unlikely(block == NULL)) {
+        __shield_set_errno(EAGAIN);
+        goto err;
+    }
+    for (int i = 0; i < iovcnt; ++i) {
+        memcpy(&block[fill], iov[i].iov_base, iov[i].iov_len);
+        fill += iov[i].iov_len;
+    }
+    if (unlikely(!(flags & MSGFRAG_LZ) && ((struct msgbuf *)block)->mtype < 1)) {
+        __msgpool_free(qmsg_pool, QMSG_POOL_CLASSES, block);
+        __shield_set_errno(EINVAL);
+        goto err;
+    }
+    tx = &entry->txq[(entry->tx_head + entry->tx_count) % CONFIG_STD_POSIX_SYSV_TXQ_DEPTH];
+    tx->msg = (struct msgbuf *)block;
+    tx->len = len;
+    tx->offset = offset;
+    tx->msg_id = msg_id;
+    tx->flags = flags;
+    entry->tx_count++;
+    errcode = 0;
+err:
+    return errcode;
+}
+
+/**
+ * @brief emit the messages of the outbound queue, in order, up to the first busy emission
+ *
+ * A message refused by the kernel for another reason than a busy destination (e.g. the
+ * destination has exited) can't be emitted later: it is dropped.
+ *
+ * @return the number of messages still queued
+ */
+static uint8_t __msg_tx_flush(qmsg_entry_t *entry)
+{
+    qmsg_tx_t *tx;
+    struct iovec iov;
+    Status ret;
+
+    while (entry->tx_count > 0) {
+        tx = &entry->txq[entry->tx_head];
+        iov.iov_base = (uint8_t *)tx->msg + tx->offset;
+        iov.iov_len = tx->len - tx->offset;
+        ret = __msg_send_iov(entry, &iov, 1, tx->len, tx->msg_id, tx->flags, &tx->offset);
+        if (ret == STATUS_BUSY) {
+            break;
+        }
+        if (unlikely(ret != STATUS_OK)) {
+            entry->stats.msg_snd_drops++;
+        }
+        __msgpool_free(qmsg_pool, QMSG_POOL_CLASSES, tx->msg);
+        tx->msg = NULL;
+        entry->tx_head = (entry->tx_head + 1) % CONFIG_STD_POSIX_SYSV_TXQ_DEPTH;
+        entry->tx_count--;
+    }
+    return entry->tx_count;
+}
+#endif
+
+bool __shield_msg_tx_flush(void)
+{
+    bool res = false;
+#if defined(CONFIG_STD_POSIX_SYSV_TXQ)
+    for (uint8_t i = 0; i < CONFIG_MAX_TASKS; ++i) {
+        if (qmsg_vector[i].set == true && __msg_tx_flush(&qmsg_vector[i]) > 0) {
+            res = true;
+        }
+    }
+#endif
+    return res;
+}
+
+#if defined(CONFIG_STD_POSIX_SYSV_LZ)
+/**
+ * @brief compress the message made of the concatenation of the iov fragments
+ *
+ * The message is compressed in qmsg_lz_buf. A message made of several iov fragments is
+ * first gathered in a pool block, the compressor needing a contiguous input.
+ *
+ * @return the compressed payload length, or 0 if the message is emitted uncompressed
+ *         (invalid mtype, no free pool block, or not smaller once compressed)
+ */
+static size_t __msg_lz_compress(const struct iovec *iov, int iovcnt, size_t len)
+{
+    const uint8_t *msg = (const uint8_t *)iov[0].iov_base;
+    uint8_t *block = NULL;
+    const uint16_t msg_len = (uint16_t)len;
+    size_t clen = 0;
+    size_t fill = 0;
+    long mtype;
+
+    if (iovcnt > 1) {
+        block = __msgpool_alloc(qmsg_pool, QMSG_POOL_CLASSES, len);
+        if (unlikely(block == NULL)) {
+            goto end;
+        }
+        for (int i = 0; i < iovcnt; ++i) {
+            memcpy(&block[fill], iov[i].iov_base, iov[i].iov_len);
+            fill += iov[i].iov_len;
+        }
+        msg = block;
+    }
+    memcpy(&mtype, msg, sizeof(long));
+    if (unlikely(mtype < 1)) {
+        /* rejected by the uncompressed emission */
+        goto end;
+    }
+    /* the payload must be smaller than the message, and thus fit in a reassembly buffer */
+    if (len > sizeof(uint16_t) + 1) {
+        clen = __lz_compress(qmsg_lz_hash, msg, len, &qmsg_lz_buf[sizeof(uint16_t)],
+                             len - sizeof(uint16_t) - 1);
+    }
+    if (clen > 0) {
+        memcpy(qmsg_lz_buf, &msg_len, sizeof(uint16_t));
+        clen += sizeof(uint16_t);
+    }
+end:
+    if (block != NULL) {
+        __msgpool_free(qmsg_pool, QMSG_POOL_CLASSES, block);
+    }
+    return clen;
+}
+#endif
+
+/**
+ * @brief substitute the compressed message to the iov fragments, if MSG_COMPRESS is set
+ *
+ * @param lz_iov[out]: storage of the compressed message iov
+ *
+ * @return MSGFRAG_LZ if iov, iovcnt and len have been replaced by the compressed payload,
+ *         or 0
+ */
+static inline uint8_t __msg_lz_iov(const struct iovec **iov, int *iovcnt, size_t *len, int msgflg,
+                                   struct iovec *lz_iov)
+{
+    uint8_t flags = 0;
+#if defined(CONFIG_STD_POSIX_SYSV_LZ)
+    size_t clen;
+
+    if (msgflg & MSG_COMPRESS) {
+        clen = __msg_lz_compress(*iov, *iovcnt, *len);
+        if (clen > 0) {
+            lz_iov->iov_base = qmsg_lz_buf;
+            lz_iov->iov_len = clen;
+            *iov = lz_iov;
+            *iovcnt = 1;
+            *len = clen;
+            flags = MSGFRAG_LZ;
+        }
+    }
+#else
+    (void)iov;
+    (void)iovcnt;
+    (void)len;
+    (void)msgflg;
+    (void)lz_iov;
+#endif
+    return flags;
+}
+
+/**
+ * @brief send a message, through the outbound queue of the destination if enabled
+ *
+ * When the outbound queue is enabled, messages already queued for the destination are
+ * emitted first. In IPC_NOWAIT mode, a message that can't be emitted (destination busy, or
+ * previous messages still queued) is queued and reported as sent. Otherwise, the caller gets
+ * EAGAIN, and no message is emitted out of order.
+ *
+ * @return 0, or -1 with errno set
+ */
+static int __msg_send(qmsg_entry_t *entry, const struct iovec *iov, int iovcnt, size_t len, int msgflg)
+{
+    int errcode = -1;
+    struct iovec lz_iov;
+    size_t offset = 0;
+    uint8_t msg_id;
+    uint8_t flags;
+    Status ret;
+
+#if defined(CONFIG_STD_POSIX_SYSV_TXQ)
+    if (unlikely(entry->tx_count > 0 && __msg_tx_flush(entry) > 0)) {
+        if (msgflg & IPC_NOWAIT) {
+            flags = __msg_lz_iov(&iov, &iovcnt, &len, msgflg, &lz_iov);
+            errcode = __msg_tx_queue(entry, iov, iovcnt, len, entry->tx_msg_id++, flags, 0);
+        } else {
+            __shield_set_errno(EAGAIN);
+        }
+        goto err;
+    }
+#endif
+    flags = __msg_lz_iov(&iov, &iovcnt, &len, msgflg, &lz_iov);
+    msg_id = entry->tx_msg_id++;
+    ret = __msg_send_iov(entry, iov, iovcnt, len, msg_id, flags, &offset);
+#if defined(CONFIG_STD_POSIX_SYSV_TXQ)
+    if (ret == STATUS_BUSY && (msgflg & IPC_NOWAIT)) {
+        /* resumed from the failed fragment at flush time */
+        errcode = __msg_tx_queue(entry, iov, iovcnt, len, msg_id, flags, offset);
+        goto err;
+    }
+#endif
+    if (ret != STATUS_OK) {
+        goto err;
+    }
+    errcode = 0;
+err:
+    return errcode;
+}
+
+/*
+ * Sending message msgp of size msgsz to 'msqid'.
+ *
+ * msgp is a struct msgbuf, msgsz being the mtext size. The message (mtype included)
+ * is emitted as a single IPC if it fits, or as several framed fragments otherwise,
+ * up to CONFIG_MAX_SYSV_MSG_LEN bytes of mtext.
+ */
+int msgsnd(int msqid, const void *msgp, size_t msgsz, int msgflg)
+{
+    int errcode = -1;
+    qmsg_entry_t *entry;
+    struct iovec iov;
+
+    if (msgp == NULL) {
+        errcode = -1; /* POSIX Compliance */
+        __shield_set_errno(EFAULT);
+        goto err;
+    }
+    entry = __msg_snd_entry(msqid);
+    if (unlikely(entry == NULL)) {
+        errcode = -1; /* POSIX Compliance */
+        goto err;
+    }
+    if (msgsz > CONFIG_MAX_SYSV_MSG_LEN) {
+        errcode = -1; /* POSIX Compliance */
+        entry->stats.msg_e2big++;
+        __shield_set_errno(E2BIG);
+        goto err;
+    }
+    /* sending size+mtype field (long). The queue content (locally queued received messages)
+     * is not impacted */
+    iov.iov_base = (void *)msgp;
+    iov.iov_len = msgsz + sizeof(long);
+    errcode = __msg_send(entry, &iov, 1, iov.iov_len, msgflg);
+err:
+    return errcode;
+}
+
+/*
+ * Sending the concatenation of the iov fragments, as a single message, to 'msqid'.
+ */
+int msgsndv(int msqid, const struct iovec *iov, int iovcnt, int msgflg)
+{
+    int errcode = -1;
+    qmsg_entry_t *entry;
+    size_t len = 0;
+
+    if (unlikely(iov == NULL)) {
+        __shield_set_errno(EFAULT);
+        goto err;
+    }
+    if (unlikely(iovcnt <= 0)) {
+        __shield_set_errno(EINVAL);
+        goto err;
+    }
+    entry = __msg_snd_entry(msqid);
+    if (unlikely(entry == NULL)) {
+        goto err;
+    }
+    for (int i = 0; i < iovcnt; ++i) {
+        if (unlikely(iov[i].iov_len > (sizeof(long) + CONFIG_MAX_SYSV_MSG_LEN - len))) {
+            entry->stats.msg_e2big++;
+            __shield_set_errno(E2BIG);
+            goto err;
+        }
+        if (unlikely(iov[i].iov_base == NULL && iov[i].iov_len > 0)) {
+            __shield_set_errno(EFAULT);
+            goto err;
+        }
+        len += iov[i].iov_len;
+    }
+    if (unlikely(len < sizeof(long))) {
+        /* no room for mtype */
+        __shield_set_errno(EINVAL);
+        goto err;
+    }
+    errcode = __msg_send(entry, iov, iovcnt, len, msgflg);
+err:
+    return errcode;
+}
+
+/**
+ * @brief compute the deadline (monotonic time in ms) of a timed call
+ *
+ * @param timeout[in]: relative timeout, or absolute CLOCK_MONOTONIC time with MSG_ABSTIME,
+ *        rounded up to the next millisecond
+ *
+ * @return 0, or -1 with errno set
+ */
+static int __msg_deadline(const struct timespec *timeout, int msgflg, uint64_t *deadline)
+{
+    int errcode = -1;
+    uint64_t now = 0;
+    uint64_t ms;
+
+    if (unlikely(timeout == NULL)) {
+        __shield_set_errno(EFAULT);
+        goto err;
+    }
+    if (unlikely(timeout->tv_nsec < 0 || timeout->tv_nsec >= 1000000000L)) {
+        __shield_set_errno(EINVAL);
+        goto err;
+    }
+    ms = ((uint64_t)timeout->tv_sec * 1000ULL) + __time_ns_to_ms((uint32_t)timeout->tv_nsec + 999999UL);
+    if (!(msgflg & MSG_ABSTIME) && unlikely(__shield_time_now_ms(&now) < 0)) {
+        goto err;
+    }
+    *deadline = now + ms;
+    errcode = 0;
+err:
+    return errcode;
+}
+
+/*
+ * Sending message msgp of size msgsz to 'msqid', retrying while the destination is busy,
+ * up to timeout.
+ *
+ * There is no kernel event for a destination that is no more busy: between two emissions,
+ * events are waited for (and kept pending by the demultiplexer) for up to
+ * SHIELD_MSG_TX_RETRY_MS. A fragmented message is resumed from the refused fragment.
+ */
+int msgsnd_timed(int msqid, const void *msgp, size_t msgsz, int msgflg, const struct timespec *timeout)
+{
+    int errcode = -1;
+    qmsg_entry_t *entry;
+    const struct iovec *msg_iov;
+    struct iovec lz_iov;
+    struct iovec iov;
+    uint64_t deadline;
+    uint64_t now;
+    size_t offset = 0;
+    size_t len;
+    int iovcnt = 1;
+    uint8_t msg_id;
+    uint8_t flags;
+    Status ret;
+
+    if (unlikely(msgp == NULL)) {
+        __shield_set_errno(EFAULT);
+        goto err;
+    }
+    entry = __msg_snd_entry(msqid);
+    if (unlikely(entry == NULL)) {
+        goto err;
+    }
+    if (unlikely(msgsz > CONFIG_MAX_SYSV_MSG_LEN)) {
+        entry->stats.msg_e2big++;
+        __shield_set_errno(E2BIG);
+        goto err;
+    }
+    if (unlikely(__msg_deadline(timeout, msgflg, &deadline) < 0)) {
+        goto err;
+    }
+    iov.iov_base = (void *)msgp;
+    iov.iov_len = msgsz + sizeof(long);
+    msg_iov = &iov;
+    len = iov.iov_len;
+    flags = __msg_lz_iov(&msg_iov, &iovcnt, &len, msgflg, &lz_iov);
+    msgp = msg_iov->iov_base;
+    msg_id = entry->tx_msg_id++;
+    do {
+#if defined(CONFIG_STD_POSIX_SYSV_TXQ)
+        /* previously queued messages first, never reordered */
+        if (entry->tx_count > 0 && __msg_tx_flush(entry) > 0) {
+            ret = STATUS_BUSY;
+        } else
+#endif
+        {
+            iov.iov_base = (uint8_t *)msgp + offset;
+            iov.iov_len = len - offset;
+            ret = __msg_send_iov(entry, &iov, 1, len, msg_id, flags, &offset);
+        }
+        if (ret != STATUS_BUSY) {
+            break;
+        }
+        if (unlikely(__shield_time_now_ms(&now) < 0)) {
+            goto err;
+        }
+        if (now >= deadline) {
+            __shield_set_errno(ETIMEDOUT);
+            goto err;
+        }
+        __shield_event_fetch(((deadline - now) < SHIELD_MSG_TX_RETRY_MS) ?
+                             (int32_t)(deadline - now) : SHIELD_MSG_TX_RETRY_MS);
+        timer_dispatch();
+    } while (1);
+    if (ret != STATUS_OK) {
+        goto err;
+    }
+    errcode = 0;
+err:
+    return errcode;
+}
+
+/**
+ * @brief record the send status of the destination i of msgsnd_multi()
+ */
+static inline void __msg_multi_result(int *errs, size_t i, int err)
+{
+    if (errs != NULL) {
+        errs[i] = err;
+    }
+}
+
+/*
+ * Sending message msgp of size msgsz to each queue of msqids.
+ *
+ * Each fragment of the message is copied once in the SVC exchange area, and then
+ * emitted to all the destinations that did not fail yet, only the fragment header
+ * message identifier being updated between two destinations.
+ */
+int msgsnd_multi(const int *msqids, size_t n, const void *msgp, size_t msgsz, int *errs, int msgflg)
+{
+    int errcode = -1;
+    uint8_t *area = (uint8_t *)_memarea_get_svcexcange_event();
+    uint8_t msg_ids[QMSG_MULTI_MAX];
+    uint32_t active = 0;
+    const struct iovec *msg_iov;
+    struct iovec lz_iov;
+    struct iovec iov;
+    msgfrag_hdr_t hdr;
+    qmsg_entry_t *entry;
+    size_t offset = 0;
+    size_t len;
+    int iovcnt = 1;
+    uint8_t flags;
+    Status ret;
+    long mtype;
+    int err;
+
+    if (unlikely(msqids == NULL || msgp == NULL)) {
+        __shield_set_errno(EFAULT);
+        goto err;
+    }
+    if (unlikely(n > QMSG_MULTI_MAX)) {
+        __shield_set_errno(EINVAL);
+        goto err;
+    }
+    if (unlikely(msgsz > CONFIG_MAX_SYSV_MSG_LEN)) {
+        /* counted by each valid destination, as msgsnd() does */
+        for (size_t i = 0; i < n; ++i) {
+            if (__msg_snd_check(msqids[i]) == 0) {
+                qmsg_vector[msqids[i]].stats.msg_e2big++;
+            }
+        }
+        __shield_set_errno(E2BIG);
+        goto err;
+    }
+    memcpy(&mtype, msgp, sizeof(long));
+    if (unlikely(mtype < 1)) {
+        __shield_set_errno(EINVAL);
+        goto err;
+    }
+    /* compressed once for all the destinations */
+    iov.iov_base = (void *)msgp;
+    iov.iov_len = msgsz + sizeof(long);
+    msg_iov = &iov;
+    len = iov.iov_len;
+    flags = __msg_lz_iov(&msg_iov, &iovcnt, &len, msgflg, &lz_iov);
+    msgp = msg_iov->iov_base;
+    errcode = 0;
+    for (size_t i = 0; i < n; ++i) {
+        err = __msg_snd_check(msqids[i]);
+        if (unlikely(err != 0)) {
+            __msg_multi_result(errs, i, err);
+            continue;
+        }
+        entry = &qmsg_vector[msqids[i]];
+#if defined(CONFIG_STD_POSIX_SYSV_TXQ)
+        /* flushing uses the SVC exchange area, done before the message is staged in */
+        if (unlikely(entry->tx_count > 0 && __msg_tx_flush(entry) > 0)) {
+            err = EAGAIN;
+            if ((msgflg & IPC_NOWAIT) &&
+                __msg_tx_queue(entry, msg_iov, 1, len, entry->tx_msg_id++, flags, 0) == 0) {
+                err = 0;
+                errcode++;
+            }
+            __msg_multi_result(errs, i, err);
+            continue;
+        }
+#endif
+        msg_ids[i] = entry->tx_msg_id++;
+        active |= (1UL << i);
+    }
+    while (active != 0) {
+        size_t chunk = len - offset;
+        if (chunk > QMSG_FRAG_DATA_LEN) {
+            chunk = QMSG_FRAG_DATA_LEN;
+        }
+        memcpy(&area[sizeof(msgfrag_hdr_t)], (const uint8_t *)msgp + offset, chunk);
+        hdr.offset = offset;
+        hdr.flags = flags | ((offset + chunk == len) ? MSGFRAG_LAST : 0);
+        for (size_t i = 0; i < n; ++i) {
+            if (!(active & (1UL << i))) {
+                continue;
+            }
+            entry = &qmsg_vector[msqids[i]];
+            hdr.msg_id = msg_ids[i];
+            memcpy(area, &hdr, sizeof(msgfrag_hdr_t));
+            ret = __msg_emit(entry, sizeof(msgfrag_hdr_t) + chunk);
+            if (likely(ret == STATUS_OK)) {
+                continue;
+            }
+            active &= ~(1UL << i);
+            err = __msg_emit_errno(ret);
+#if defined(CONFIG_STD_POSIX_SYSV_TXQ)
+            if (ret == STATUS_BUSY && (msgflg & IPC_NOWAIT)) {
+                /* resumed from this fragment at flush time, not emitted by this loop anymore */
+                if (__msg_tx_queue(entry, msg_iov, 1, len, msg_ids[i], flags, offset) == 0) {
+                    err = 0;
+                    errcode++;
+                }
+            }
+#endif
+            __msg_multi_result(errs, i, err);
+        }
+        offset += chunk;
+        if (offset == len) {
+            /* remaining active destinations received the whole message */
+            for (size_t i = 0; i < n; ++i) {
+                if (active & (1UL << i)) {
+                    __msg_multi_result(errs, i, 0);
+                    __msg_stats_snd(&qmsg_vector[msqids[i]], len);
+                    errcode++;
+                }
+            }
+            active = 0;
+        }
+    }
+err:
+    return errcode;
+}
+
+/*
+ * Emitting the messages queued for 'msqid' while its destination was busy.
+ */
+int msgsnd_flush(int msqid)
+{
+    int errcode = -1;
+    qmsg_entry_t *entry;
+
+    entry = __msg_snd_entry(msqid);
+    if (unlikely(entry == NULL)) {
+        goto err;
+    }
+#if defined(CONFIG_STD_POSIX_SYSV_TXQ)
+    errcode = __msg_tx_flush(entry);
+#else
+    errcode = 0;
+#endif
+err:
+    return errcode;
+}
+
+/**
+ * @brief queue all the IPCs already pending, without blocking, up to a full queue
+ *
+ * @return the status of the last wait, STATUS_AGAIN if there is no more pending IPC
+ */
+static Status __msg_drain(void)
+{
+    const exchange_event_t* rcv_buf;
+    Status ret;
+
+    do {
+        ret = __shield_event_wait_ipc(WFE_WAIT_NO, &rcv_buf);
+        if (ret != STATUS_OK) {
+            break;
+        }
+    } while (likely(__msg_enqueue(rcv_buf) == true));
+    return ret;
+}
+
+/**
+ * @brief check a receive queue identifier
+ *
+ * @return the queue entry, or NULL with errno set
+ */
+static qmsg_entry_t *__msg_rcv_entry(int msqid)
+{
+    qmsg_entry_t *entry = NULL;
+
+    if (msqid < 0 || msqid >= CONFIG_MAX_TASKS) {
+        __shield_set_errno(EINVAL);
+        goto err;
+    }
+    if (qmsg_vector[msqid].set == false) {
+        __shield_set_errno(EINVAL);
+        goto err;
+    }
+    if (qmsg_vector[msqid].msg_perm == 0x444) {
+        __shield_set_errno(EPERM);
+        goto err;
+    }
+    entry = &qmsg_vector[msqid];
+err:
+    return entry;
+}
+
+/**
+ * @brief select the message to receive on the given queue, waiting for IPCs if needed
+ *
+ * Queued messages are checked first. Then IPCs are received, and queued in their source
+ * queue, until one matches. A matching IPC is not queued but returned in place (desc->event),
+ * so that it can be consumed without any copy.
+ * The queue content is not modified, the caller consumes the selected message.
+ *
+ * @param deadline[in]: if not NULL and IPC_NOWAIT is not set, the wait ends with ETIMEDOUT
+ *        at this monotonic time (ms), whatever the number of received IPCs
+ *
+ * @return 0, or -1 with errno set
+ */
+static int __msg_select(qmsg_entry_t *entry, long msgtyp, int msgflg, const uint64_t *deadline,
+                        qmsg_desc_t *desc)
+{
+    int errcode = -1;
+    Status ret;
+    int32_t timeout = 0;
+    const bool except = (msgflg & MSG_EXCEPT);
+    uint8_t slot_id;
+    long mtype;
+
+    if (msgflg & IPC_NOWAIT) {
+        /* sync wait */
+        timeout = WFE_WAIT_NO;
+    }
+    if (unlikely(entry->conflate)) {
+        /* latest-value mode: the pending IPCs may supersede the queued messages */
+        __msg_drain();
+    }
+    /* check local previously queued messages for current msgqid, then get back
+     * IPCs from the kernel until one matches */
+    while ((slot_id = __msgq_select(&entry->index, msgtyp, except)) == MSGQ_NIL) {
+        const exchange_event_t* rcv_buf;
+
+        if (unlikely(__msgq_full(&entry->index))) {
+            /* queue full, no more message can be received for this queue */
+            __shield_set_errno(ENOMEM);
+            goto err;
+        }
+        /* other event types received in the meantime are kept pending by the demultiplexer */
+        if (deadline != NULL && !(msgflg & IPC_NOWAIT)) {
+            ret = __shield_event_wait_ipc_until(*deadline, &rcv_buf);
+        } else {
+            ret = __shield_event_wait_ipc(timeout, &rcv_buf);
+        }
+        switch (ret) {
+            case STATUS_INVALID:
+                __shield_set_errno(EINVAL);
+                goto err;
+                break;
+            case STATUS_DENIED:
+                __shield_set_errno(EACCES);
+                goto err;
+                break;
+            case STATUS_AGAIN:
+                __shield_set_errno(EAGAIN);
+                goto err;
+            case STATUS_TIMEOUT:
+                __shield_set_errno(ETIMEDOUT);
+                goto err;
+            case STATUS_OK:
+                break;
+            default:
+                /* abnormal other return code, should not happen */
+                __shield_set_errno(EINVAL);
+                goto err;
+                break;
+        }
+        if (rcv_buf->source == entry->key &&
+            __msg_frag_single(entry, rcv_buf, &desc->msg, &desc->msg_size)) {
+            /* IPC data is not long-aligned */
+            memcpy(&mtype, desc->msg, sizeof(long));
+            if (__msgq_match(mtype, msgtyp, except)) {
+                /* no queued message matches, this one is the selected one */
+                desc->slot = MSGQ_NIL;
+                desc->event = rcv_buf;
+                errcode = 0;
+                goto err;
+            }
+        }
+        /* the received IPC may come from any source, queue it in its own queue */
+        if (unlikely(__msg_enqueue(rcv_buf) == false)) {
+            __shield_set_errno(ENOMEM);
+            goto err;
+        }
+    }
+    desc->msg = entry->slots[slot_id].msg;
+    desc->msg_size = entry->slots[slot_id].msg_size;
+    desc->slot = slot_id;
+    desc->event = NULL;
+    errcode = 0;
+err:
+    return errcode;
+}
+
+/*
+ * msgrcv return in msgp the received struct msgbuf (mtype and mtext) and returns the
+ * number of bytes copied into mtext. The mtype field is used as a discriminant for
+ * message selection purpose.
+ * Although, as msgsnd()/msgrcv() API is **not** a kernel API, the received
+ * IPC holds the overall data (including mtype), as the kernel as no
+ * idea of the msgbuf structure.
+ *
+ * Received IPCs are queued locally in a per-source queue, in arrival order, up to
+ * CONFIG_STD_POSIX_SYSV_MSQ_DEPTH messages, so that a selective receive never drops
+ * messages of other types, and a sender can emit a burst without waiting for the
+ * receiver:
+ * - check the local queue for the message selected by msgtyp. If found, returns it:
+ *      -> msgtyp == 0: the first message (arrival order)
+ *      -> msgtyp > 0: the first message of type msgtyp, or of any other type with MSG_EXCEPT
+ *      -> msgtyp < 0: the first message of the lowest type, if lower than or equal to |msgtyp|.
+ *         This allows message priorities, a lower type being a higher priority.
+ *   Messages are indexed by type, the queue content is never walked for this.
+ * - If not, get back an IPC from the kernel. If it matches, it is directly copied to
+ *   msgp. Otherwise it is queued in its source queue, and:
+ *      -> if IPC_NOWAIT is not set, try again (blocking mode)
+ *      -> if IPC_NOWAIT is set and no IPC is pending, return EAGAIN
+ * - if the local queue is full and no message matches, or if the IPC received from
+ *   the kernel targets another full queue, returns ENOMEM. The other queue must be
+ *   consumed first, the IPC being kept pending meanwhile.
+ * - if the selected message is bigger than msgsz and MSG_NOERROR is not set, returns
+ *   E2BIG, the message being kept in the queue.
+ */
+static ssize_t __msg_rcv(int msqid, void *msgp, size_t msgsz, long msgtyp, int msgflg,
+                         const uint64_t *deadline)
+{
+    ssize_t errcode = -1;
+    size_t len;
+    qmsg_entry_t *entry;
+    qmsg_desc_t desc;
+
+    /* sanitation */
+    if (msgsz > CONFIG_MAX_SYSV_MSG_LEN) {
+        if (!(msgflg & MSG_NOERROR)) {
+            /* msgsz bigger than max transmittable content and truncate (NOERROR)
+             * not allowed */
+            errcode = -1; /* POSIX Compliance */
+            __shield_set_errno(EINVAL);
+            goto err;
+        }
     }
     if (msgp == NULL) {
         errcode = -1; /* POSIX Compliance */
         __shield_set_errno(EFAULT);
         goto err;
     }
-    if (msqid < 0 || msqid > CONFIG_MAX_TASKS) {
-        errcode = -1; /* POSIX Compliance */
+    entry = __msg_rcv_entry(msqid);
+    if (unlikely(entry == NULL)) {
+        errcode = -1; /* POSIX Compliance */
+        goto err;
+    }
+    if (msgsz > entry->msg_perm) {
+        errcode = -1; /* POSIX Compliance */
+        __shield_set_errno(EPERM);
+        goto err;
+    }
+    if (__msg_select(entry, msgtyp, msgflg, deadline, &desc) < 0) {
+        errcode = -1; /* POSIX Compliance */
+        goto err;
+    }
+    len = desc.msg_size;
+    if (len > msgsz) {
+        if (!(msgflg & MSG_NOERROR)) {
+            /* truncate not allowed! keeping locally, let caller come back with increased msgsz */
+            if (desc.slot == MSGQ_NIL) {
+                __msg_enqueue(desc.event);
+            }
+            errcode = -1;
+            entry->stats.msg_e2big++;
+            __shield_set_errno(E2BIG);
+            goto err;
+        }
+        len = msgsz;
+    }
+    memcpy(msgp, desc.msg, sizeof(long) + len);
+    __msg_stats_rcv(entry, desc.slot, len);
+    if (desc.slot != MSGQ_NIL) {
+        __msgq_detach(&entry->index, desc.slot);
+        __msg_slot_free(entry, desc.slot);
+    }
+    errcode = len;
+err:
+    return errcode;
+}
+
+ssize_t msgrcv(int msqid,
+               void *msgp,
+               size_t msgsz,
+               long msgtyp,
+               int msgflg)
+{
+    return __msg_rcv(msqid, msgp, msgsz, msgtyp, msgflg, NULL);
+}
+
+/*
+ * Same as msgrcv(), the wait for a matching message being bounded by timeout.
+ * The remaining time is computed again before each kernel wait, so that the IPCs of
+ * non-matching messages (or of other fragments) received meanwhile do not extend it.
+ */
+ssize_t msgrcv_timed(int msqid, void *msgp, size_t msgsz, long msgtyp, int msgflg,
+                     const struct timespec *timeout)
+{
+    ssize_t errcode = -1;
+    uint64_t deadline;
+
+    if (unlikely(__msg_deadline(timeout, msgflg, &deadline) < 0)) {
+        goto err;
+    }
+    errcode = __msg_rcv(msqid, msgp, msgsz, msgtyp, msgflg, &deadline);
+err:
+    return errcode;
+}
+
+ssize_t msgrcv_borrow(int msqid, const struct msgbuf **msgp, long msgtyp, int msgflg)
+{
+    ssize_t errcode = -1;
+    qmsg_entry_t *entry;
+    qmsg_desc_t desc;
+
+    if (unlikely(msgp == NULL)) {
+        __shield_set_errno(EFAULT);
+        goto err;
+    }
+    entry = __msg_rcv_entry(msqid);
+    if (unlikely(entry == NULL)) {
+        goto err;
+    }
+    if (unlikely(entry->borrowed != QMSG_BORROW_NONE)) {
+        /* only one message lent at a time per queue */
+        __shield_set_errno(EBUSY);
+        goto err;
+    }
+    if (__msg_select(entry, msgtyp, msgflg, NULL, &desc) < 0) {
+        goto err;
+    }
+    if (desc.slot != MSGQ_NIL) {
+        /* no more selectable, though the slot content is kept up to release */
+        __msgq_detach(&entry->index, desc.slot);
+        entry->borrowed = desc.slot;
+    } else {
+        entry->borrowed = QMSG_BORROW_IPC;
+    }
+    *msgp = desc.msg;
+    __msg_stats_rcv(entry, desc.slot, desc.msg_size);
+    errcode = desc.msg_size;
+err:
+    return errcode;
+}
+
+int msgrcv_release(int msqid)
+{
+    int errcode = -1;
+    qmsg_entry_t *entry;
+
+    entry = __msg_rcv_entry(msqid);
+    if (unlikely(entry == NULL)) {
+        goto err;
+    }
+    if (unlikely(entry->borrowed == QMSG_BORROW_NONE)) {
         __shield_set_errno(EINVAL);
         goto err;
     }
-    if (qmsg_vector[msqid].msg_perm == 0x444) {
-        errcode = -1; /* POSIX Compliance */
-        __shield_set_errno(EPERM);
+    if (entry->borrowed != QMSG_BORROW_IPC) {
+        __msg_slot_free(entry, entry->borrowed);
+    }
+    entry->borrowed = QMSG_BORROW_NONE;
+    errcode = 0;
+err:
+    return errcode;
+}
+
+ssize_t msgrcv_batch(struct msgdesc *descs, size_t count, int msgflg)
+{
+    ssize_t errcode = -1;
+    Status ret;
+    int32_t timeout;
+    size_t num = 0;
+    const exchange_event_t* rcv_buf;
+
+    if (unlikely(descs == NULL)) {
+        __shield_set_errno(EFAULT);
         goto err;
     }
-    if (msgsz > qmsg_vector[msqid].msg_perm) {
-        errcode = -1; /* POSIX Compliance */
-        __shield_set_errno(EPERM);
+    /* drain all the pending IPCs into their source queue, up to a full queue */
+    do {
+        /* blocking up to a queued message: a received IPC may only be a fragment, or
+         * be dropped (unknown source, invalid message) */
+        timeout = WFE_WAIT_NO;
+        if (!(msgflg & IPC_NOWAIT) && !__shield_msg_pending()) {
+            timeout = SHIELD_EVENT_WAIT_FOREVER;
+        }
+        ret = __shield_event_wait_ipc(timeout, &rcv_buf);
+        if (ret != STATUS_OK) {
+            break;
+        }
+    } while (likely(__msg_enqueue(rcv_buf) == true));
+
+    switch (ret) {
+        case STATUS_OK:
+        case STATUS_AGAIN:
+            break;
+        case STATUS_DENIED:
+            __shield_set_errno(EACCES);
+            goto err;
+        default:
+            __shield_set_errno(EINVAL);
+            goto err;
+    }
+    /* lend queued messages, in arrival order for each queue */
+    for (uint8_t msqid = 0; msqid < CONFIG_MAX_TASKS && num < count; ++msqid) {
+        qmsg_entry_t *entry = &qmsg_vector[msqid];
+        while (entry->index.count > 0 && num < count) {
+            const uint8_t slot_id = entry->index.head;
+            descs[num].msqid = msqid;
+            descs[num].msg = entry->slots[slot_id].msg;
+            descs[num].msgsz = entry->slots[slot_id].msg_size;
+            __msgq_detach(&entry->index, slot_id);
+            __msg_stats_rcv(entry, slot_id, descs[num].msgsz);
+            num++;
+        }
+    }
+    if (num == 0) {
+        __shield_set_errno(EAGAIN);
         goto err;
     }
+    errcode = num;
+err:
+    return errcode;
+}
 
-tryagain:
+int msgrcv_batch_release(const struct msgdesc *descs, size_t count)
+{
+    int errcode = -1;
 
-    /* check local previously stored messages for current msgqid */
-    if (qmsg_vector[msqid].set == true) {
-        /* msgtyp == 0, the first read message is transmitted */
-        if (msgtyp == 0) {
-            if (qmsg_vector[msqid].msg_size > msgsz && !(msgflg & MSG_NOERROR)) {
-                /* truncate not allowed!*/
-                errcode = -1;
-                __shield_set_errno(E2BIG);
-                goto err;
-            }
-            goto handle_cached_msg;
-        /* no EXCEPT mode, try to match msgtyp */
-        } else if ((msgflg & MSG_EXCEPT) && (qmsg_vector[msqid].msg.msgbuf.mtype != msgtyp)) {
-            /* found a waiting msg for except mode */
-            if (qmsg_vector[msqid].msg_size > msgsz && !(msgflg & MSG_NOERROR)) {
-                /* truncate not allowed!*/
-                errcode = -1;
-                __shield_set_errno(E2BIG);
-                goto err;
-            }
-            goto handle_cached_msg;
-        } else if (!(msgflg & MSG_EXCEPT) && (qmsg_vector[msqid].msg.msgbuf.mtype == msgtyp)) {
-            /* found a waiting msg with corresponding type */
-            if (qmsg_vector[msqid].msg_size > msgsz && !(msgflg & MSG_NOERROR)) {
-                /* truncate not allowed!*/
-                errcode = -1;
-                __shield_set_errno(E2BIG);
-                goto err;
-            }
-            goto handle_cached_msg;
-        } else if (qmsg_vector[msqid].msg_size < msgsz) {
-            /* at least one chunk of msgqid was stored before, yet not reaching
-             * msgsz. Need to read other chunks to complete */
+    if (unlikely(descs == NULL)) {
+        __shield_set_errno(EFAULT);
+        goto err;
+    }
+    /* check all the descriptors first, so that nothing is released on error */
+    for (size_t i = 0; i < count; ++i) {
+        if (unlikely(descs[i].msqid < 0 || descs[i].msqid >= CONFIG_MAX_TASKS ||
+                     __msg_slot_lookup(&qmsg_vector[descs[i].msqid], descs[i].msg) == MSGQ_NIL)) {
+            __shield_set_errno(EINVAL);
+            goto err;
         }
     }
-    /* here, current msqid is free, or not yet fully loaded,
-     * get back msgsz from kernel, checking msgqid using the key (source id) */
+    for (size_t i = 0; i < count; ++i) {
+        qmsg_entry_t *entry = &qmsg_vector[descs[i].msqid];
+        __msg_slot_free(entry, __msg_slot_lookup(entry, descs[i].msg));
+    }
+    errcode = 0;
+err:
+    return errcode;
+}
 
-    /* get back message content from kernel */
-    if (msgflg & IPC_NOWAIT) {
-        /* sync wait */
-        timeout = -1;
+/**
+ * @brief router table hash (Fibonacci hashing) of a (msqid, mtype) couple
+ */
+static inline uint32_t __msg_route_hash(uint8_t msqid, long mtype)
+{
+    /* msqid in the high bits, the usual mtypes being small */
+    const uint32_t k = (uint32_t)mtype ^ ((uint32_t)msqid << 24);
+    return (uint32_t)(k * 0x9e3779b1UL) >> (32 - QMSG_ROUTE_BITS);
+}
+
+/**
+ * @brief get back the router table cell of the (msqid, mtype) route
+ *
+ * @return the cell, or the empty cell ending the probe sequence if there is no such route
+ */
+static uint32_t __msg_route_cell(uint8_t msqid, long mtype)
+{
+    uint32_t cell = __msg_route_hash(msqid, mtype);
+
+    /* the table is never full, an empty cell ends the probe sequence */
+    while (qmsg_routes[cell].handler != NULL) {
+        if (qmsg_routes[cell].msqid == msqid && qmsg_routes[cell].mtype == mtype) {
+            break;
+        }
+        cell = (cell + 1) & (QMSG_ROUTE_LEN - 1);
     }
-    /* as msgsz may be bigger thant an IPC size, we must support chunks */
-    chunk_offset = 0;
-    qmsg_vector[msqid].msg_size = 0;
+    return cell;
+}
+
+/**
+ * @brief remove the route held by the given cell
+ *
+ * Backward shift deletion: the following routes of the probe sequence are moved back, so
+ * that no lookup is broken and no tombstone is needed.
+ */
+static void __msg_route_remove(uint32_t cell)
+{
+    uint32_t next = cell;
 
     do {
-        exchange_event_t* rcv_buf;
-        qmsg_entry_t *entry = &qmsg_vector[msqid];
+        uint32_t home;
+        next = (next + 1) & (QMSG_ROUTE_LEN - 1);
+        if (qmsg_routes[next].handler == NULL) {
+            break;
+        }
+        home = __msg_route_hash(qmsg_routes[next].msqid, qmsg_routes[next].mtype);
+        /* move back the route only if its home cell is not in (cell, next] */
+        if (((next - home) & (QMSG_ROUTE_LEN - 1)) >= ((next - cell) & (QMSG_ROUTE_LEN - 1))) {
+            qmsg_routes[cell] = qmsg_routes[next];
+            cell = next;
+        }
+    } while (1);
+    qmsg_routes[cell].handler = NULL;
+    qmsg_routes_num--;
+}
 
-        ret = __sys_wait_for_event(EVENT_TYPE_IPC, timeout);
-        switch (ret) {
-            case STATUS_INVALID:
-                errcode = -1; /* POSIX Compliance */
-                __shield_set_errno(EINVAL);
-                goto err;
-                break;
-            case STATUS_DENIED:
-                errcode = -1; /* POSIX Compliance */
-                __shield_set_errno(EACCES);
-                goto err;
-                break;
-            case STATUS_AGAIN:
-                errcode = -1; /* POSIX Compliance */
-                __shield_set_errno(EAGAIN);
-                goto err;
-            case STATUS_OK:
-                break;
-            default:
-                /* abnormal other return code, should not happen */
-                errcode = -1; /* POSIX Compliance */
-                __shield_set_errno(EINVAL);
-                goto err;
-                break;
+/**
+ * @brief handler of the given message: the (msqid, mtype) route, or the queue default one
+ *
+ * @return the route, or NULL if the message is not routed
+ */
+static const qmsg_route_t *__msg_route_lookup(uint8_t msqid, long mtype)
+{
+    const qmsg_route_t *route = NULL;
+    uint32_t cell;
+
+    if (likely(qmsg_routes_num > 0)) {
+        cell = __msg_route_cell(msqid, mtype);
+        if (qmsg_routes[cell].handler == NULL) {
+            cell = __msg_route_cell(msqid, 0);
         }
-        rcv_buf = &_s_svcexchange;
-        /* check than received message source (taskh_t) matches current key */
-        if (rcv_buf->source == entry->key) {
-            /* received message matches current msgqid */
-            if (entry->msg_size + rcv_buf->length > CONFIG_MAX_SYSV_MSG_LEN) {
-                /* overflow here */
-                errcode = -1; /* POSIX Compliance */
-                __shield_set_errno(EBADF);
-                goto err;
-            }
-            memcpy(&entry->msg.msg[chunk_offset], &rcv_buf->data[0], rcv_buf->length);
-            chunk_offset += rcv_buf->length;
-            qmsg_vector[msqid].msg_size += rcv_buf->length;
-        } else {
-            /* else, rcv msg is not from the same key (another one has emitted) */
-            /* push current chunk to other queue that do match the source */
-            for (uint8_t queue = 0; queue < CONFIG_MAX_TASKS; ++queue) {
-                if (rcv_buf->source == qmsg_vector[msqid].key) {
-                    entry = &qmsg_vector[msqid];
-                    if (entry->msg_size + rcv_buf->length > CONFIG_MAX_SYSV_MSG_LEN) {
-                        /* overflow here */
-                        errcode = -1; /* POSIX Compliance */
-                        __shield_set_errno(EBADF);
-                        goto err;
-                    }
-                    memcpy(&entry->msg.msg[entry->msg_size], &rcv_buf->data[0], rcv_buf->length);
-                    if (chunk_offset)
-                    entry->msg_size += rcv_buf->length;
-                    entry->set = true;
-                }
-                /** WARN: if an IPC from a source from which a msgget() has never been
-                 * made is received, the IPC content is discarded */
-            }
+        if (qmsg_routes[cell].handler != NULL) {
+            route = &qmsg_routes[cell];
         }
-    } while (qmsg_vector[msqid].msg_size <= msgsz);
+    }
+    return route;
+}
 
-    /* Now that the buffer received. Check its content. Here, like for cache check, we must check
-     * mtype according to msgflg */
-    if ((msgflg & MSG_EXCEPT) && (qmsg_vector[msqid].msg.msgbuf.mtype != msgtyp)) {
-        /* if this message matches, check for its size, according to MSG_NOERROR flag */
-        if (qmsg_vector[msqid].msg_size > msgsz && !(msgflg & MSG_NOERROR)) {
-            /* truncate not allowed! keeping locally, let caller come back with increased msgsz */
-            qmsg_vector[msqid].set = true;
-            errcode = -1;
-            __shield_set_errno(E2BIG);
+int msgroute(int msqid, long mtype, msg_handler_t handler, void *arg)
+{
+    int errcode = -1;
+    uint32_t cell;
+
+    if (unlikely(msqid < 0 || msqid >= CONFIG_MAX_TASKS || qmsg_vector[msqid].set == false)) {
+        __shield_set_errno(EINVAL);
+        goto err;
+    }
+    if (unlikely(mtype < 0)) {
+        __shield_set_errno(EINVAL);
+        goto err;
+    }
+    cell = __msg_route_cell(msqid, mtype);
+    if (handler == NULL) {
+        if (unlikely(qmsg_routes[cell].handler == NULL)) {
+            __shield_set_errno(ENOENT);
             goto err;
         }
-        goto handle_cached_msg;
+        __msg_route_remove(cell);
+    } else {
+        if (qmsg_routes[cell].handler == NULL) {
+            if (unlikely(qmsg_routes_num == CONFIG_STD_POSIX_SYSV_ROUTES)) {
+                __shield_set_errno(ENOMEM);
+                goto err;
+            }
+            qmsg_routes[cell].msqid = msqid;
+            qmsg_routes[cell].mtype = mtype;
+            qmsg_routes_num++;
+        }
+        qmsg_routes[cell].handler = handler;
+        qmsg_routes[cell].arg = arg;
+    }
+    errcode = 0;
+err:
+    return errcode;
+}
 
+/**
+ * @brief call the handlers of the routed messages queued in the given queue, in arrival order
+ *
+ * Messages are detached during the handler call, so that a handler can use the message API,
+ * including on its own queue.
+ *
+ * @return the number of dispatched messages
+ */
+static size_t __msg_dispatch_queued(uint8_t msqid)
+{
+    qmsg_entry_t *entry = &qmsg_vector[msqid];
+    const qmsg_route_t *route;
+    size_t num = 0;
+    uint8_t slot_id;
 
-    } else if (!(msgflg & MSG_EXCEPT) && (qmsg_vector[msqid].msg.msgbuf.mtype == msgtyp)) {
-        /* if this message matches, check for its size, according to MSG_NOERROR flag */
-        if (qmsg_vector[msqid].msg_size > msgsz && !(msgflg & MSG_NOERROR)) {
-            /* truncate not allowed!*/
-            qmsg_vector[msqid].set = true;
-            errcode = -1;
-            __shield_set_errno(E2BIG);
-            goto err;
+    slot_id = entry->index.head;
+    while (slot_id != MSGQ_NIL) {
+        const qmsg_slot_t *slot = &entry->slots[slot_id];
+        route = __msg_route_lookup(msqid, slot->msg->mtype);
+        if (route == NULL) {
+            /* not routed, kept for msgrcv() */
+            slot_id = entry->index.nodes[slot_id].next;
+            continue;
         }
-        goto handle_cached_msg;
+        __msgq_detach(&entry->index, slot_id);
+        __msg_stats_rcv(entry, slot_id, slot->msg_size);
+        route->handler(msqid, slot->msg, slot->msg_size, route->arg);
+        __msg_slot_free(entry, slot_id);
+        num++;
+        /* the handler may have changed the queue content */
+        slot_id = entry->index.head;
     }
+    return num;
+}
 
-    /* is the queue full now ? */
+/*
+ * Dispatching the received messages to their handler.
+ *
+ * Queued routed messages are dispatched first, queue per queue. Then the IPCs are received
+ * up to the last pending one (waiting as long as nothing has been dispatched, unless
+ * IPC_NOWAIT is set). A single IPC message of a queue that does not hold any earlier
+ * message is dispatched in place, in the SVC exchange area. Others are queued, and their
+ * queue is dispatched.
+ */
+ssize_t msgdispatch(int msgflg)
+{
+    ssize_t errcode = -1;
+    size_t num = 0;
+    int32_t timeout;
+    const exchange_event_t* rcv_buf;
+    const qmsg_route_t *route;
+    const struct msgbuf *msg;
+    size_t msg_size;
+    long mtype;
+    int msqid;
+    Status ret;
 
-    /* In the case of msgflag without IPC_NOWAIT, if the message of type mtype is not found
-     * (i.e. we arrived here), we try again, until the queue is full. */
-    if (msgflg & IPC_NOWAIT) {
-        errcode = -1;
+    for (uint8_t i = 0; i < CONFIG_MAX_TASKS; ++i) {
+        if (qmsg_vector[i].index.count > 0) {
+            num += __msg_dispatch_queued(i);
+        }
+    }
+    do {
+        /* blocking up to a dispatched message: a received IPC may only be a fragment,
+         * be dropped, or be queued without handler */
+        timeout = WFE_WAIT_NO;
+        if (num == 0 && !(msgflg & IPC_NOWAIT)) {
+            timeout = SHIELD_EVENT_WAIT_FOREVER;
+        }
+        ret = __shield_event_wait_ipc(timeout, &rcv_buf);
+        if (ret != STATUS_OK) {
+            break;
+        }
+        msqid = __msg_key_lookup(rcv_buf->source);
+        if (likely(msqid >= 0) && qmsg_vector[msqid].index.count == 0 &&
+            __msg_frag_single(&qmsg_vector[msqid], rcv_buf, &msg, &msg_size)) {
+            /* IPC data is not long-aligned */
+            memcpy(&mtype, msg, sizeof(long));
+            route = __msg_route_lookup(msqid, mtype);
+            if (route != NULL) {
+                __msg_stats_rcv(&qmsg_vector[msqid], MSGQ_NIL, msg_size);
+                route->handler(msqid, msg, msg_size, route->arg);
+                num++;
+                continue;
+            }
+        }
+        if (unlikely(__msg_enqueue(rcv_buf) == false)) {
+            /* full queue, the IPC is kept pending */
+            break;
+        }
+        if (likely(msqid >= 0)) {
+            num += __msg_dispatch_queued(msqid);
+        }
+    } while (1);
+    switch (ret) {
+        case STATUS_OK:
+        case STATUS_AGAIN:
+            break;
+        case STATUS_DENIED:
+            __shield_set_errno(EACCES);
+            goto err;
+        default:
+            __shield_set_errno(EINVAL);
+            goto err;
+    }
+    if (num == 0) {
         __shield_set_errno(EAGAIN);
         goto err;
     }
-    goto tryagain;
-
-    /* default on success */
+    errcode = num;
 err:
     return errcode;
+}
+
+/**
+ * @brief release all the resources held by the given queue, and forget it
+ */
+static void __msg_destroy(uint8_t msqid)
+{
+    qmsg_entry_t *entry = &qmsg_vector[msqid];
+    bool removed;
+
+    while (entry->index.head != MSGQ_NIL) {
+        const uint8_t slot_id = entry->index.head;
+        __msgq_detach(&entry->index, slot_id);
+        __msg_slot_free(entry, slot_id);
+    }
+    __msgfrag_abort(&entry->reasm, qmsg_pool, QMSG_POOL_CLASSES);
+#if defined(CONFIG_STD_POSIX_SYSV_TXQ)
+    while (entry->tx_count > 0) {
+        __msgpool_free(qmsg_pool, QMSG_POOL_CLASSES, entry->txq[entry->tx_head].msg);
+        entry->tx_head = (entry->tx_head + 1) % CONFIG_STD_POSIX_SYSV_TXQ_DEPTH;
+        entry->tx_count--;
+    }
+#endif
+    /* a removal moves routes back, possibly over an already checked cell on wrap */
+    do {
+        removed = false;
+        for (uint32_t cell = 0; cell < QMSG_ROUTE_LEN; ++cell) {
+            if (qmsg_routes[cell].handler != NULL && qmsg_routes[cell].msqid == msqid) {
+                __msg_route_remove(cell);
+                removed = true;
+            }
+        }
+    } while (removed);
+    __msg_key_remove(msqid);
+    entry->set = false;
+}
+
+/*
+ * Queue control. The IPCs received later from the key of a removed queue are discarded,
+ * up to a new msgget(IPC_CREAT) on this key.
+ */
+int msgctl(int msqid, int cmd, struct msqid_ds *buf)
+{
+    int errcode = -1;
+    qmsg_entry_t *entry;
 
-    /* handle found cached message or just received message */
-handle_cached_msg:
-    memcpy(msgp, &(qmsg_vector[msqid].msg.msgbuf), qmsg_vector[msqid].msg_size);
-    qmsg_vector[msqid].set = false;
-    errcode = qmsg_vector[msqid].msg_size;
+    if (unlikely(msqid < 0 || msqid >= CONFIG_MAX_TASKS || qmsg_vector[msqid].set == false)) {
+        __shield_set_errno(EINVAL);
+        goto err;
+    }
+    entry = &qmsg_vector[msqid];
+    switch (cmd) {
+        case IPC_STAT:
+            if (unlikely(buf == NULL)) {
+                __shield_set_errno(EFAULT);
+                goto err;
+            }
+            /* fields that are not recorded in this configuration are kept to 0 */
+            memset(buf, 0x0, sizeof(struct msqid_ds));
+            buf->msg_key = entry->key;
+            buf->msg_qnum = entry->index.count;
+            buf->msg_qmax = CONFIG_STD_POSIX_SYSV_MSQ_DEPTH;
+            buf->msg_qhwm = entry->stats.msg_qhwm;
+            buf->msg_snd_count = entry->stats.msg_snd_count;
+            buf->msg_snd_bytes = entry->stats.msg_snd_bytes;
+            buf->msg_snd_drops = entry->stats.msg_snd_drops;
+            buf->msg_rcv_count = entry->stats.msg_rcv_count;
+            buf->msg_rcv_bytes = entry->stats.msg_rcv_bytes;
+            buf->msg_drops = entry->stats.msg_drops;
+            buf->msg_e2big = entry->stats.msg_e2big;
+#if defined(CONFIG_STD_POSIX_SYSV_MSG_STATS)
+            buf->msg_stime = entry->stats.msg_stime;
+            buf->msg_rtime = entry->stats.msg_rtime;
+            buf->msg_lat_count = entry->stats.msg_lat_count;
+            buf->msg_lat_max_us = entry->stats.msg_lat_max_us;
+            memcpy(buf->msg_lat_hist, entry->stats.msg_lat_hist, sizeof(buf->msg_lat_hist));
+#endif
+            break;
+        case IPC_RMID:
+            /* lent messages (msgrcv_borrow(), msgrcv_batch()) must be given back first */
+            if (unlikely(entry->borrowed != QMSG_BORROW_NONE ||
+                         (uint8_t)__builtin_popcount(entry->index.used) != entry->index.count)) {
+                __shield_set_errno(EBUSY);
+                goto err;
+            }
+            __msg_destroy(msqid);
+            break;
+        default:
+            __shield_set_errno(EINVAL);
+            goto err;
+    }
+    errcode = 0;
+err:
     return errcode;
 }
@@ -5,10 +5,15 @@
 #include <stdbool.h>
 #include <shield/string.h>
 #include <shield/signal.h>
+#include <shield/stdio.h>
 #include <shield/time.h>
 #include <shield/errno.h>
 #include <shield/private/sort.h>
 #include <shield/private/errno.h>
+#include <shield/private/timeconv.h>
+#include <shield/private/calendar.h>
+#include <shield/private/event.h>
+#include <shield/private/timer.h>
 #include <uapi.h>
 
 #define TIME_DEBUG 0
@@ -45,12 +50,23 @@
  */
 #define STD_POSIX_TIMER_MAXNUM 5
 
+/*
+ * max expired timers waiting for their callback execution. A given timer is
+ * never queued twice (successive expirations are coalesced), so there is at
+ * most one pending callback per timer.
+ */
+#define STD_POSIX_TIMER_DEFERRED_MAXNUM STD_POSIX_TIMER_MAXNUM
+
 typedef struct timer_info {
-    /** Timer identifier (uint64_t), set at timer creation time
-        differ from 'key', upgraded with next timer trigger timetstamp
+    /** Timer identifier (uint64_t), set at timer creation time, and kept
+        for the overall timer life.
         MUST be aligned on 8 bytes to avoid strd usage fault
     */
     timer_t         id;
+    /** timestamp (us) at which the timer has been (re)armed, start point of duration_ms */
+    uint64_t        start_us;
+    /** callback execution statistics, following the timer when moved between lists */
+    struct shield_timer_stats stats;
     /** duration in ms (at least for initial, it periodic) */
     uint32_t        duration_ms;
     sigev_notify_function_t sigev_notify_function;
@@ -76,11 +92,27 @@ typedef struct timer_info {
 /**
  * timers subsystem context
  */
+/**
+ * expired SIGEV_THREAD timer, waiting for its callback execution
+ */
+typedef struct timer_deferred {
+    /** expiration deadline (us), used as dispatch priority (earliest first) */
+    uint64_t        deadline_us;
+    timer_t         id;
+    sigev_notify_function_t sigev_notify_function;
+    __sigval_t      sigev_value;
+    /** number of expirations coalesced while this entry was pending */
+    uint32_t        overruns;
+} timer_deferred_t;
+
 typedef struct timers_context {
     timer_info_t timers[STD_POSIX_TIMER_MAXNUM];
     timer_info_t active_timers[STD_POSIX_TIMER_MAXNUM];
+    /** deferred callbacks, ordered by deadline */
+    timer_deferred_t deferred[STD_POSIX_TIMER_DEFERRED_MAXNUM];
     uint8_t num_timers;
     uint8_t num_active_timers;
+    uint8_t num_deferred;
 } timers_context_t;
 
 _Alignas(uint64_t) timers_context_t timer_ctx;
@@ -117,8 +149,8 @@ static inline timer_info_t *__timer_find_not_postponed(timer_info_t * const time
             (timer_list[i].id == key) &&
             (timer_list[i].postponed == false)) {
             timer = &timer_list[i];
+            break;
         }
-        break;
     }
     return timer;
 }
@@ -132,8 +164,8 @@ static inline timer_info_t *__timer_find_freenode(timer_info_t * const timer_lis
     for (uint8_t i = 0; i < STD_POSIX_TIMER_MAXNUM; ++i) {
         if (timer_list[i].valid == false) {
             timer = &timer_list[i];
+            break;
         }
-        break;
     }
     return timer;
 }
@@ -213,8 +245,8 @@ int timer_compare(const void *a, const void *b)
     __timer_get_time_us(&now_us);
     const timer_info_t *ta = (const timer_info_t*)a;
     const timer_info_t *tb = (const timer_info_t*)b;
-    eta_us_a = (ta->id + (ta->duration_ms*1000)) - now_us;
-    eta_us_b = (tb->id + (tb->duration_ms*1000)) - now_us;
+    eta_us_a = (ta->start_us + __time_ms_to_us(ta->duration_ms)) - now_us;
+    eta_us_b = (tb->start_us + __time_ms_to_us(tb->duration_ms)) - now_us;
     if (ta->valid == false) {
         /* invalid are pushed at the end: force swapping */
         res = 1;
@@ -258,10 +290,13 @@ static int __timer_create_node(struct sigevent *sevp, timer_t key, bool periodic
     timer->sigev_value = sevp->sigev_value;
     timer->sigev_notify = sevp->sigev_notify;
     timer->id = key;
+    timer->start_us = 0;
+    memset(&timer->stats, 0x0, sizeof(struct shield_timer_stats));
     timer->set = false;
     timer->postponed = false;
     timer->periodic = periodic;
     timer->duration_ms = 0;
+    timer->valid = true;
 
     timer_ctx.num_timers++;
 err:
@@ -283,14 +318,20 @@ static int __timer_setnode(timer_t id,
     Status ret;
     timer_info_t *timer = NULL;
     timer_info_t *active_timer = NULL;
+    timer_info_t *prev_timer = NULL;
     uint32_t period_ms = 0;
+    uint64_t now_us;
     /* foreach node, get back its id....
      * As we have locked the timer lock, we can read the list manualy here */
     period_ms = (ts->tv_sec * MILI_IN_SEC);
-    period_ms += (ts->tv_nsec / NANO_IN_MSEC);
+    period_ms += __time_ns_to_ms(ts->tv_nsec);
+    if (unlikely(__timer_get_time_us(&now_us) != 0)) {
+        errcode = -1;
+        goto err;
+    }
 
     /* searching for node, starting with unset timers.... */
-    if (unlikely(timer_ctx.num_timers == 0)) {
+    if ((timer = __timer_find(timer_ctx.timers, id)) == NULL) {
         /* no unset timer found, fallback to already set timers */
         timer = __timer_find(timer_ctx.active_timers, id);
         if (unlikely(timer == NULL)) {
@@ -303,8 +344,11 @@ static int __timer_setnode(timer_t id,
         /* when timer already set and 'old' is non-null, set the previously
          * configured values to it */
         if (old) {
-            old->it_value.tv_sec = timer->duration_ms / 1000;
-            old->it_value.tv_nsec = (timer->duration_ms  % 1000) * 1000000;
+            uint32_t sec;
+            uint32_t nsec;
+            __time_ms_to_sec_nsec(timer->duration_ms, &sec, &nsec);
+            old->it_value.tv_sec = sec;
+            old->it_value.tv_nsec = nsec;
             if (timer->periodic == false) {
                 old->it_interval.tv_sec = 0;
                 old->it_interval.tv_nsec = 0;
@@ -315,9 +359,9 @@ static int __timer_setnode(timer_t id,
         }
         /* for all nodes having the same id (including that one), mark them as 'postponed'. */
         timer->postponed = true;
-        while ((timer = __timer_find_not_postponed(timer_ctx.active_timers, id)) != NULL) {
-            timer->postponed = true;
-            timer->periodic = false;
+        while ((prev_timer = __timer_find_not_postponed(timer_ctx.active_timers, id)) != NULL) {
+            prev_timer->postponed = true;
+            prev_timer->periodic = false;
         }
         if (period_ms == 0) {
             timer_info_t *unset_timer;
@@ -334,6 +378,10 @@ static int __timer_setnode(timer_t id,
                 goto err;
             }
             memcpy(unset_timer, timer, sizeof(timer_info_t));
+            unset_timer->set = false;
+            unset_timer->postponed = false;
+            unset_timer->valid = true;
+            timer_ctx.num_timers++;
             errcode = 0;
             goto end;
         }
@@ -348,8 +396,11 @@ static int __timer_setnode(timer_t id,
         active_timer->sigev_value = timer->sigev_value;
         active_timer->sigev_notify = timer->sigev_notify;
         active_timer->id = timer->id;
+        active_timer->start_us = now_us;
+        active_timer->stats = timer->stats;
         active_timer->set = true;
         active_timer->postponed = false;
+        active_timer->valid = true;
         if (periodic == true) {
             active_timer->periodic = true;
         }
@@ -377,6 +428,7 @@ static int __timer_setnode(timer_t id,
         timer_ctx.num_timers--;
         /* remove timers from create but not set timers list */
         timer->valid = false;
+        active_timer->start_us = now_us;
         active_timer->set = true;
         active_timer->duration_ms = period_ms;
 
@@ -418,12 +470,102 @@ err:
 }
 
 
-/* timer handler that is effectively called by the kernel */
+/*
+ * Queue the callback of an expired timer for later execution by shield_timer_dispatch().
+ *
+ * The deferred queue is kept ordered by deadline, so that dispatch is made
+ * earliest deadline first. If the timer callback is already pending, the
+ * expiration is coalesced and accounted as overrun.
+ */
+static int __timer_defer(const timer_info_t *timer)
+{
+    int errcode = 0;
+    uint64_t deadline_us = timer->start_us + __time_ms_to_us(timer->duration_ms);
+    uint8_t pos;
+
+    for (uint8_t i = 0; i < timer_ctx.num_deferred; ++i) {
+        if (timer_ctx.deferred[i].id == timer->id) {
+            timer_ctx.deferred[i].overruns++;
+            goto end;
+        }
+    }
+    if (unlikely(timer_ctx.num_deferred == STD_POSIX_TIMER_DEFERRED_MAXNUM)) {
+        errcode = -1;
+        __shield_set_errno(ENOMEM);
+        goto end;
+    }
+    /* insertion sort, the queue is small and mostly filled in deadline order */
+    pos = timer_ctx.num_deferred;
+    while (pos > 0 && timer_ctx.deferred[pos - 1].deadline_us > deadline_us) {
+        timer_ctx.deferred[pos] = timer_ctx.deferred[pos - 1];
+        pos--;
+    }
+    timer_ctx.deferred[pos].deadline_us = deadline_us;
+    timer_ctx.deferred[pos].id = timer->id;
+    timer_ctx.deferred[pos].sigev_notify_function = timer->sigev_notify_function;
+    timer_ctx.deferred[pos].sigev_value = timer->sigev_value;
+    timer_ctx.deferred[pos].overruns = 0;
+    timer_ctx.num_deferred++;
+end:
+    return errcode;
+}
+
+#if defined(CONFIG_TIMER_STATS)
+/*
+ * Record the lateness of the current expiration of timer, compared to its deadline.
+ */
+static inline void __timer_stats_record(timer_info_t *timer, uint64_t now_us)
+{
+    const uint64_t deadline_us = timer->start_us + __time_ms_to_us(timer->duration_ms);
+    uint32_t late_us = 0;
+    uint8_t bucket = 0;
+
+    if (now_us > deadline_us) {
+        /* saturated, a lateness above UINT32_MAX us (~71 minutes) lands in the last bucket */
+        late_us = ((now_us - deadline_us) > UINT32_MAX) ? UINT32_MAX : (uint32_t)(now_us - deadline_us);
+    }
+    if (late_us > 0) {
+        /* log2 bucket: number of significant bits of the lateness */
+        bucket = 32 - __builtin_clz(late_us);
+        if (bucket >= SHIELD_TIMER_STATS_HIST_LEN) {
+            bucket = SHIELD_TIMER_STATS_HIST_LEN - 1;
+        }
+    }
+    timer->stats.late_count++;
+    timer->stats.late_hist[bucket]++;
+    if (late_us > timer->stats.late_max_us) {
+        timer->stats.late_max_us = late_us;
+    }
+    /* late by a whole period (or initial duration for one shot timers) at least */
+    if (late_us >= __time_ms_to_us(timer->duration_ms)) {
+        timer->stats.late_overruns++;
+    }
+}
+#endif
+
+/*
+ * get back the current (i.e. not postponed) node of a timer, wherever it is
+ */
+static inline timer_info_t *__timer_find_current(const timer_t key)
+{
+    timer_info_t *timer;
+    if ((timer = __timer_find_not_postponed(timer_ctx.active_timers, key)) == NULL) {
+        timer = __timer_find(timer_ctx.timers, key);
+    }
+    return timer;
+}
+
+/*
+ * timer handler that is effectively called by the kernel
+ *
+ * Only the timers bookkeeping is made here. SIGEV_THREAD callbacks are
+ * deferred to shield_timer_dispatch() so that a slow callback never delays
+ * the timers handling.
+ */
 int timer_handler(void)
 {
-    uint64_t key;
-    int ret;
     int errcode;
+    uint64_t now_us;
 
     /* the timer associated to the current handle is ALWAYS the first cell */
     timer_info_t *timer = &timer_ctx.active_timers[0];
@@ -434,15 +576,22 @@ int timer_handler(void)
          * just do nothing except reordering.
          */
     } else {
-        switch (timer->sigev_notify) {
-            case SIGEV_THREAD:
-                timer->sigev_notify_function(timer->sigev_value);
-                break;
-            default:
-                break;
+        if (unlikely(__timer_get_time_us(&now_us) != 0)) {
+            errcode = -1;
+            __shield_set_errno(EPERM);
+            goto err;
         }
+#if defined(CONFIG_TIMER_STATS)
+        __timer_stats_record(timer, now_us);
+#endif
         /* upper thread execution is requested. The callback **must** be set as it has been checked
          * at creation time. */
+        if (timer->sigev_notify == SIGEV_THREAD) {
+            if (unlikely(__timer_defer(timer) != 0)) {
+                errcode = -1;
+                goto err;
+            }
+        }
         if (timer->periodic == false) {
             timer_info_t *inactive_timer;
             timer->valid = false;
@@ -453,15 +602,13 @@ int timer_handler(void)
                 goto err;
             }
             memcpy(inactive_timer, timer, sizeof(timer_info_t));
+            inactive_timer->set = false;
+            inactive_timer->valid = true;
             timer_ctx.num_timers++;
             timer_ctx.num_active_timers--;
         } else {
-            /* update id to current timestamp (used to define timer static point)*/
-            if (unlikely(__timer_get_time_ns(&timer->id) != STATUS_OK)) {
-                errcode = -1;
-                __shield_set_errno(EPERM);
-                goto err;
-            }
+            /* update start point to current timestamp (next period starts now) */
+            timer->start_us = now_us;
         }
     }
     errcode = 0;
@@ -470,6 +617,26 @@ err:
     return errcode;
 }
 
+bool timer_armed(void)
+{
+    return (timer_ctx.num_active_timers > 0);
+}
+
+bool timer_pending(void)
+{
+    return (timer_ctx.num_deferred > 0);
+}
+
+int __shield_time_now_ms(uint64_t *now)
+{
+    return __timer_get_time_ms(now);
+}
+
+int __shield_time_now_us(uint64_t *now)
+{
+    return __timer_get_time_us(now);
+}
+
 /**************************************************************************
  * Exported functions part 1; timers
  */
@@ -618,6 +785,8 @@ int shield_timer_gettime(timer_t timerid, struct itimerspec *curr_value)
 {
     uint64_t now_us;
     uint64_t eta_us;
+    uint64_t sec;
+    uint32_t nsec;
     int errcode;
     timer_info_t *timer = NULL;
     uint8_t ret;
@@ -654,20 +823,145 @@ int shield_timer_gettime(timer_t timerid, struct itimerspec *curr_value)
 
     /* calculate remaining time for current timer */
     __timer_get_time_us(&now_us);
-    eta_us = (timer->id + (timer->duration_ms*1000)) - now_us;
-    /* timer id is the time (in us) when the timer has been set */
-    //memcpy(&timer_us, &info->id, sizeof(uint64_t));
+    eta_us = (timer->start_us + __time_ms_to_us(timer->duration_ms)) - now_us;
     if (timer->periodic == true) {
-        curr_value->it_interval.tv_nsec = (timer->duration_ms % 1000) * MILI_IN_NSECS;
-        curr_value->it_interval.tv_sec = timer->duration_ms / MILI_IN_SEC;
+        uint32_t period_sec;
+        __time_ms_to_sec_nsec(timer->duration_ms, &period_sec, &nsec);
+        curr_value->it_interval.tv_nsec = nsec;
+        curr_value->it_interval.tv_sec = period_sec;
     }
-    curr_value->it_value.tv_nsec = (eta_us % MILI_IN_NSECS) * MILI_IN_SEC;
-    curr_value->it_value.tv_sec = eta_us / MILI_IN_NSECS;
+    __time_us_to_sec_nsec(eta_us, &sec, &nsec);
+    curr_value->it_value.tv_nsec = nsec;
+    curr_value->it_value.tv_sec = sec;
     errcode = 0;
 err:
     return errcode;
 }
 
+/*
+ * Execute the pending SIGEV_THREAD callbacks, earliest deadline first.
+ *
+ * Each callback execution time is measured and accounted in the timer
+ * statistics. Callbacks queued while dispatching (i.e. timers expiring during
+ * a callback) are executed in the same call.
+ */
+int shield_timer_dispatch(void)
+{
+    static bool dispatching;
+    int count = 0;
+    timer_deferred_t work;
+    timer_info_t *timer;
+    uint64_t start_us;
+    uint64_t end_us;
+    uint32_t exec_us;
+    bool timed;
+
+    if (dispatching == true) {
+        /* called from a callback (e.g. through a blocking wait), the pending callbacks
+         * are executed by the ongoing dispatch */
+        goto end;
+    }
+    dispatching = true;
+    while (timer_ctx.num_deferred > 0) {
+        /* pop head first, the callback may lead to new expirations */
+        work = timer_ctx.deferred[0];
+        timer_ctx.num_deferred--;
+        memmove(&timer_ctx.deferred[0], &timer_ctx.deferred[1],
+                timer_ctx.num_deferred * sizeof(timer_deferred_t));
+
+        timed = (__timer_get_time_us(&start_us) == 0);
+        work.sigev_notify_function(work.sigev_value);
+        timed = timed && (__timer_get_time_us(&end_us) == 0);
+        count++;
+
+        /* the timer may have been moved (or unset) by the callback, find it again */
+        if (unlikely((timer = __timer_find_current(work.id)) == NULL)) {
+            continue;
+        }
+        timer->stats.cb_overruns += work.overruns;
+        if (unlikely(timed == false)) {
+            /* execution time unknown, only the overruns are accounted */
+            continue;
+        }
+        exec_us = (uint32_t)(end_us - start_us);
+        timer->stats.cb_count++;
+        timer->stats.cb_last_us = exec_us;
+        timer->stats.cb_total_us += exec_us;
+        if (exec_us > timer->stats.cb_max_us) {
+            timer->stats.cb_max_us = exec_us;
+        }
+    }
+    dispatching = false;
+end:
+    return count;
+}
+
+void timer_dispatch(void)
+{
+    if (timer_pending()) {
+        shield_timer_dispatch();
+    }
+}
+
+int shield_timer_stats(timer_t timerid, struct shield_timer_stats *stats)
+{
+    int errcode = 0;
+    timer_info_t *timer;
+
+    if (unlikely(stats == NULL)) {
+        errcode = -1;
+        __shield_set_errno(EFAULT);
+        goto err;
+    }
+    if (unlikely((timer = __timer_find_current(timerid)) == NULL)) {
+        errcode = -1;
+        __shield_set_errno(EINVAL);
+        goto err;
+    }
+    memcpy(stats, &timer->stats, sizeof(struct shield_timer_stats));
+err:
+    return errcode;
+}
+
+int shield_timer_stats_dump(timer_t timerid)
+{
+    int errcode;
+    struct shield_timer_stats stats;
+    uint32_t cb_avg_us = 0;
+
+    if (unlikely((errcode = shield_timer_stats(timerid, &stats)) != 0)) {
+        goto err;
+    }
+    if (stats.cb_count != 0) {
+        /* debug path only, the 64 bits division is acceptable here */
+        cb_avg_us = (uint32_t)(stats.cb_total_us / stats.cb_count);
+    }
+    printf("timer %llu: callbacks %lu, avg %luus, max %luus, last %luus, coalesced %lu\n",
+           (unsigned long long)timerid, (unsigned long)stats.cb_count,
+           (unsigned long)cb_avg_us, (unsigned long)stats.cb_max_us,
+           (unsigned long)stats.cb_last_us, (unsigned long)stats.cb_overruns);
+#if defined(CONFIG_TIMER_STATS)
+    printf("timer %llu: expirations %lu, max lateness %luus, overruns %lu\n",
+           (unsigned long long)timerid, (unsigned long)stats.late_count,
+           (unsigned long)stats.late_max_us, (unsigned long)stats.late_overruns);
+    for (uint8_t i = 0; i < SHIELD_TIMER_STATS_HIST_LEN; ++i) {
+        if (stats.late_hist[i] == 0) {
+            continue;
+        }
+        if (i == 0) {
+            printf("  late < 1us: %lu\n", (unsigned long)stats.late_hist[i]);
+        } else if (i == SHIELD_TIMER_STATS_HIST_LEN - 1) {
+            printf("  late >= %luus: %lu\n", 1UL << (i - 1), (unsigned long)stats.late_hist[i]);
+        } else {
+            printf("  late %lu-%luus: %lu\n", 1UL << (i - 1), (1UL << i) - 1,
+                   (unsigned long)stats.late_hist[i]);
+        }
+    }
+#endif
+err:
+    return errcode;
+}
+
 /**************************************************************************
  * Exported functions part 1; clock
  */
@@ -676,6 +970,8 @@ int shield_clock_gettime(clockid_t clockid, struct timespec *tp)
 {
     int errcode = 0;
     uint64_t time;
+    uint64_t sec;
+    uint32_t nsec;
     /* sanitation */
     if (tp == NULL) {
         errcode = -1;
@@ -691,8 +987,9 @@ int shield_clock_gettime(clockid_t clockid, struct timespec *tp)
     }
 
     if (likely(__timer_get_time_us(&time) == STATUS_OK)) {
-        tp->tv_nsec = (time % MICRO_IN_SEC) * MICRO_IN_NSEC;
-        tp->tv_sec = (time / MICRO_IN_SEC);
+        __time_us_to_sec_nsec(time, &sec, &nsec);
+        tp->tv_nsec = nsec;
+        tp->tv_sec = sec;
         goto end;
     }
     /* EPERM is not a POSIX defined return value, but time measurement is controled on EwoK */
@@ -717,7 +1014,7 @@ int shield_nanosleep(const struct timespec *req, struct timespec *rem)
         enum Status status;
         struct SleepDuration sd;
 
-        sd.arbitrary_ms = req->tv_nsec / MILI_IN_NSECS;
+        sd.arbitrary_ms = __time_ns_to_ms(req->tv_nsec);
         /* int overflow check first */
         if (unlikely(req->tv_sec >= ((0xffffffffUL) - sd.arbitrary_ms))) {
             errcode = -1;
@@ -727,6 +1024,11 @@ int shield_nanosleep(const struct timespec *req, struct timespec *rem)
         sd.arbitrary_ms += req->tv_sec;
         sd.tag = SLEEP_DURATION_ARBITRARY_MS;
         status = __sys_sleep(sd, SLEEP_MODE_SHALLOW);
+        /* timers may have expired while sleeping, other events are kept pending */
+        while (__shield_event_fetch(WFE_WAIT_NO) == STATUS_OK) {
+            ;
+        }
+        timer_dispatch();
         if (unlikely(status != STATUS_OK)) {
             errcode = -1;
             __shield_set_errno(EINTR);
@@ -735,23 +1037,249 @@ int shield_nanosleep(const struct timespec *req, struct timespec *rem)
         /* TODO add rem content if duration is lesser in long sleep mode */
     } else {
         /* active wait here, the scheduler may preempt the thread though */
-        uint32_t sleep_time_ms = req->tv_nsec / MILI_IN_NSECS;
+        uint32_t sleep_time_us = __time_ns_to_us(req->tv_nsec);
         uint64_t start;
         uint64_t curr;
         /* should never fail with us precision */
         __timer_get_time_us(&start);
         do {
             __timer_get_time_us(&curr);
-        } while ((curr - start) < (req->tv_nsec / MICRO_IN_NSEC));
+        } while ((curr - start) < sleep_time_us);
     }
 err:
     return errcode;
 }
 
+/**************************************************************************
+ * Exported functions part 3; calendar
+ */
+
+static const char __strftime_wday[7][4] = {
+    "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat",
+};
+
+static const char __strftime_month[12][4] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec",
+};
+
+struct tm *shield_gmtime_r(const time_t *timep, struct tm *result)
+{
+    struct tm *tm = NULL;
+    calendar_date_t date;
+    uint32_t days;
+    uint32_t hour;
+    uint32_t min;
+    uint32_t sec;
+
+    if (unlikely(timep == NULL || result == NULL)) {
+        __shield_set_errno(EINVAL);
+        goto err;
+    }
+    /* time64 is out of scope, only reachable on 64 bits (test) targets */
+    if (unlikely(sizeof(time_t) > sizeof(uint32_t) && (uint64_t)*timep > UINT32_MAX)) {
+        __shield_set_errno(EOVERFLOW);
+        goto err;
+    }
+    __calendar_split_secs((uint32_t)*timep, &days, &hour, &min, &sec);
+    __calendar_civil_from_days(days, &date);
+    result->tm_sec = sec;
+    result->tm_min = min;
+    result->tm_hour = hour;
+    result->tm_mday = date.mday;
+    result->tm_mon = date.month - 1;
+    result->tm_year = date.year - 1900;
+    result->tm_wday = date.wday;
+    result->tm_yday = date.yday;
+    result->tm_isdst = 0;
+    tm = result;
+err:
+    return tm;
+}
+
+time_t shield_timegm(struct tm *tm)
+{
+    time_t t = (time_t)-1;
+    int64_t secs;
+    int32_t year;
+    int32_t mon;
+
+    if (unlikely(tm == NULL)) {
+        __shield_set_errno(EINVAL);
+        goto err;
+    }
+    /* normalize month first, carrying to year. Other fields are linear */
+    year = tm->tm_year;
+    mon = tm->tm_mon;
+    year += mon / 12;
+    mon %= 12;
+    if (mon < 0) {
+        mon += 12;
+        year--;
+    }
+    /* years out of [1800, 2200] can't be brought back into the time_t range by the
+     * other fields, and this keeps the calendar arithmetic far from any overflow */
+    if (unlikely(year < (1800 - 1900) || year > (2200 - 1900))) {
+        __shield_set_errno(EOVERFLOW);
+        goto err;
+    }
+    secs = (int64_t)__calendar_days_from_civil(year + 1900, mon + 1, 1);
+    secs += (int64_t)tm->tm_mday - 1;
+    secs *= CALENDAR_SECS_PER_DAY;
+    secs += ((int64_t)tm->tm_hour * CALENDAR_SECS_PER_HOUR) +
+            ((int64_t)tm->tm_min * CALENDAR_SECS_PER_MIN) +
+            (int64_t)tm->tm_sec;
+    if (unlikely(secs < 0 || secs > UINT32_MAX)) {
+        __shield_set_errno(EOVERFLOW);
+        goto err;
+    }
+    t = (time_t)secs;
+    /* update tm with normalized values, including tm_wday and tm_yday */
+    shield_gmtime_r(&t, tm);
+err:
+    return t;
+}
+
+/*
+ * strftime() output helpers. They return false when the output buffer is full,
+ * always keeping room for the trailing '\0'.
+ */
+static inline bool __strftime_putc(char *s, size_t max, size_t *off, char c)
+{
+    bool res = false;
+    if (unlikely(*off + 1 >= max)) {
+        goto end;
+    }
+    s[(*off)++] = c;
+    res = true;
+end:
+    return res;
+}
+
+static inline bool __strftime_puts(char *s, size_t max, size_t *off, const char *str)
+{
+    bool res = true;
+    for (; *str != '\0' && res == true; ++str) {
+        res = __strftime_putc(s, max, off, *str);
+    }
+    return res;
+}
+
+/* write value in decimal, padded up to width digits with pad char */
+static inline bool __strftime_putnum(char *s, size_t max, size_t *off,
+                                     uint32_t value, uint8_t width, char pad)
+{
+    char digits[10];
+    uint8_t len = 0;
+    bool res = true;
+
+    do {
+        digits[len++] = '0' + (value % 10);
+        value /= 10;
+    } while (value != 0);
+    for (; width > len && res == true; --width) {
+        res = __strftime_putc(s, max, off, pad);
+    }
+    while (len > 0 && res == true) {
+        res = __strftime_putc(s, max, off, digits[--len]);
+    }
+    return res;
+}
+
+size_t shield_strftime(char *s, size_t max, const char *format, const struct tm *tm)
+{
+    size_t off = 0;
+    bool res = true;
+
+    if (unlikely(s == NULL || format == NULL || tm == NULL || max == 0)) {
+        goto err;
+    }
+    for (; *format != '\0' && res == true; ++format) {
+        if (*format != '%') {
+            res = __strftime_putc(s, max, &off, *format);
+            continue;
+        }
+        format++;
+        switch (*format) {
+            case 'a':
+                res = __strftime_puts(s, max, &off, __strftime_wday[(uint32_t)tm->tm_wday % 7]);
+                break;
+            case 'b':
+                res = __strftime_puts(s, max, &off, __strftime_month[(uint32_t)tm->tm_mon % 12]);
+                break;
+            case 'd':
+                res = __strftime_putnum(s, max, &off, tm->tm_mday, 2, '0');
+                break;
+            case 'e':
+                res = __strftime_putnum(s, max, &off, tm->tm_mday, 2, ' ');
+                break;
+            case 'F':
+                res = __strftime_putnum(s, max, &off, tm->tm_year + 1900, 4, '0') &&
+                      __strftime_putc(s, max, &off, '-') &&
+                      __strftime_putnum(s, max, &off, tm->tm_mon + 1, 2, '0') &&
+                      __strftime_putc(s, max, &off, '-') &&
+                      __strftime_putnum(s, max, &off, tm->tm_mday, 2, '0');
+                break;
+            case 'H':
+                res = __strftime_putnum(s, max, &off, tm->tm_hour, 2, '0');
+                break;
+            case 'j':
+                res = __strftime_putnum(s, max, &off, tm->tm_yday + 1, 3, '0');
+                break;
+            case 'm':
+                res = __strftime_putnum(s, max, &off, tm->tm_mon + 1, 2, '0');
+                break;
+            case 'M':
+                res = __strftime_putnum(s, max, &off, tm->tm_min, 2, '0');
+                break;
+            case 'S':
+                res = __strftime_putnum(s, max, &off, tm->tm_sec, 2, '0');
+                break;
+            case 'T':
+                res = __strftime_putnum(s, max, &off, tm->tm_hour, 2, '0') &&
+                      __strftime_putc(s, max, &off, ':') &&
+                      __strftime_putnum(s, max, &off, tm->tm_min, 2, '0') &&
+                      __strftime_putc(s, max, &off, ':') &&
+                      __strftime_putnum(s, max, &off, tm->tm_sec, 2, '0');
+                break;
+            case 'y':
+                res = __strftime_putnum(s, max, &off, (tm->tm_year + 1900) % 100, 2, '0');
+                break;
+            case 'Y':
+                res = __strftime_putnum(s, max, &off, tm->tm_year + 1900, 1, '0');
+                break;
+            case 'z':
+                /* only UTC is supported */
+                res = __strftime_puts(s, max, &off, "+0000");
+                break;
+            case 'Z':
+                res = __strftime_puts(s, max, &off, "UTC");
+                break;
+            case '%':
+                res = __strftime_putc(s, max, &off, '%');
+                break;
+            default:
+                /* unsupported conversion specifier (or trailing '%') */
+                goto err;
+        }
+    }
+    if (unlikely(res == false)) {
+        /* POSIX: if the result does not fit, return 0, content is indeterminate */
+        goto err;
+    }
+    s[off] = '\0';
+    return off;
+err:
+    return 0;
+}
+
 #ifndef TEST_MODE
 int clock_gettime(clockid_t clockid, struct timespec *tp) __attribute__((alias("shield_clock_gettime")));
 int timer_gettime(timer_t timerid, struct itimerspec *curr_value) __attribute__((alias("shield_timer_gettime")));
 int timer_settime(timer_t timerid, int flags, const struct itimerspec *new_value, struct itimerspec *old_value) __attribute__((alias("shield_timer_settime")));
 int timer_create(clockid_t clockid, struct sigevent *sevp, timer_t *timerid) __attribute__((alias("shield_timer_create")));
 int nanosleep(const struct timespec *req, struct timespec *rem) __attribute__((alias("shield_nanosleep")));
+struct tm *gmtime_r(const time_t *timep, struct tm *result) __attribute__((alias("shield_gmtime_r")));
+time_t timegm(struct tm *tm) __attribute__((alias("shield_timegm")));
+size_t strftime(char *s, size_t max, const char *format, const struct tm *tm) __attribute__((alias("shield_strftime")));
 #endif/*!TEST_MODE*/
@@ -0,0 +1,39 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#ifndef TEST_KERNEL_STUB_H
+#define TEST_KERNEL_STUB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Debug output capture, for the libshield binary log host tests.
+ *
+ * Each __sys_log() call appends the SVC exchange area content to the captured output.
+ */
+
+void kernel_stub_reset(void);
+
+/** captured debug output, of *len bytes */
+const uint8_t *kernel_stub_output(size_t *len);
+
+/** number of __sys_log() calls */
+uint32_t kernel_stub_logs(void);
+
+/** SVC exchange area length (CONFIG_SVC_EXCHANGE_AREA_LEN) */
+extern const size_t kernel_stub_svc_len;
+
+/** binary log buffer length (CONFIG_LOG_BINARY_BUF_LEN) */
+extern const size_t kernel_stub_log_buf_len;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!TEST_KERNEL_STUB_H*/
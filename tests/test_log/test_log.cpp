@@ -0,0 +1,182 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <vector>
+#include <shield/log.h>
+#include "kernel_stub.h"
+
+/*
+ * Binary log entries and frames encoding (see src/log.c), as read back by
+ * tools/shield-logdecode.py.
+ */
+
+namespace {
+
+constexpr size_t kHdrLen = 3;
+constexpr size_t kEntryHdrLen = 5;
+
+struct Entry {
+    uint32_t id;
+    std::vector<uint32_t> words;
+
+    bool operator==(const Entry &other) const {
+        return id == other.id && words == other.words;
+    }
+};
+
+uint32_t get_word(const uint8_t *src)
+{
+    return src[0] | (src[1] << 8) | (src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+
+/* decode the captured output, checking the frames, and return its entries */
+std::vector<Entry> decode(size_t *nframes)
+{
+    std::vector<Entry> entries;
+    size_t len;
+    const uint8_t *out = kernel_stub_output(&len);
+    size_t pos = 0;
+
+    *nframes = 0;
+    while (pos < len) {
+        EXPECT_GE(len - pos, kHdrLen);
+        EXPECT_EQ(out[pos], 0x1b);
+        EXPECT_EQ(out[pos + 1], 'B');
+        const size_t flen = out[pos + 2];
+        EXPECT_GT(flen, 0U);
+        EXPECT_LE(flen, kernel_stub_svc_len - kHdrLen);
+        EXPECT_LE(pos + kHdrLen + flen, len);
+        const uint8_t *data = &out[pos + kHdrLen];
+        size_t off = 0;
+        /* entries are never split between frames */
+        while (off < flen) {
+            Entry e;
+            const size_t nwords = data[off];
+            EXPECT_LE(off + kEntryHdrLen + (4 * nwords), flen);
+            e.id = get_word(&data[off + 1]);
+            for (size_t i = 0; i < nwords; ++i) {
+                e.words.push_back(get_word(&data[off + kEntryHdrLen + (4 * i)]));
+            }
+            entries.push_back(e);
+            off += kEntryHdrLen + (4 * nwords);
+        }
+        pos += kHdrLen + flen;
+        (*nframes)++;
+    }
+    return entries;
+}
+
+}
+
+class TestLog : public ::testing::Test {
+protected:
+    void SetUp() override {
+        /* drop what may be left in the log buffer by a previous test */
+        shield_log_flush();
+        kernel_stub_reset();
+    }
+};
+
+TEST_F(TestLog, EntryEncoding)
+{
+    const uint32_t words[] = { 1, 0xdeadbeef };
+    const uint8_t expected[] = {
+        0x1b, 'B', 13,
+        2, 0x44, 0x33, 0x22, 0x11,
+        0x01, 0x00, 0x00, 0x00,
+        0xef, 0xbe, 0xad, 0xde,
+    };
+    size_t len;
+
+    __shield_log_write(0x11223344, words, 2);
+    ASSERT_EQ(kernel_stub_logs(), 0U);
+    shield_log_flush();
+    ASSERT_EQ(kernel_stub_logs(), 1U);
+    const uint8_t *out = kernel_stub_output(&len);
+    ASSERT_EQ(len, sizeof(expected));
+    for (size_t i = 0; i < len; ++i) {
+        EXPECT_EQ(out[i], expected[i]) << "at " << i;
+    }
+}
+
+TEST_F(TestLog, NoArgs)
+{
+    size_t nframes;
+
+    __shield_log_write(42, nullptr, 0);
+    shield_log_flush();
+    auto entries = decode(&nframes);
+    ASSERT_EQ(nframes, 1U);
+    ASSERT_EQ(entries.size(), 1U);
+    EXPECT_EQ(entries[0].id, 42U);
+    EXPECT_TRUE(entries[0].words.empty());
+}
+
+TEST_F(TestLog, EmptyFlush)
+{
+    shield_log_flush();
+    EXPECT_EQ(kernel_stub_logs(), 0U);
+}
+
+TEST_F(TestLog, TooManyWords)
+{
+    uint32_t words[(2 * SHIELD_LOG_MAX_ARGS) + 1] = {};
+
+    __shield_log_write(1, words, (2 * SHIELD_LOG_MAX_ARGS) + 1);
+    shield_log_flush();
+    EXPECT_EQ(kernel_stub_logs(), 0U);
+}
+
+/* biggest entries, several per frame and frames per buffer: no entry is split nor lost */
+TEST_F(TestLog, FramesHoldWholeEntries)
+{
+    std::vector<Entry> written;
+    size_t nframes;
+    size_t total = 0;
+
+    for (uint32_t id = 0; total < kernel_stub_log_buf_len - 100; ++id) {
+        Entry e;
+        e.id = id;
+        for (uint32_t i = 0; i < (id % (2 * SHIELD_LOG_MAX_ARGS)) + 1; ++i) {
+            e.words.push_back((id << 16) | i);
+        }
+        __shield_log_write(e.id, e.words.data(), e.words.size());
+        total += kEntryHdrLen + (4 * e.words.size());
+        written.push_back(e);
+    }
+    /* the buffer is not full yet */
+    ASSERT_EQ(kernel_stub_logs(), 0U);
+    shield_log_flush();
+    auto entries = decode(&nframes);
+    EXPECT_EQ(nframes, kernel_stub_logs());
+    EXPECT_GT(nframes, 1U);
+    EXPECT_EQ(entries, written);
+}
+
+/* a full log buffer is emitted before the new entry is recorded */
+TEST_F(TestLog, FullBufferFlush)
+{
+    std::vector<Entry> written;
+    std::vector<uint32_t> words(2 * SHIELD_LOG_MAX_ARGS, 0x5a5a5a5a);
+    const size_t elen = kEntryHdrLen + (4 * words.size());
+    const size_t per_buf = kernel_stub_log_buf_len / elen;
+    size_t nframes;
+
+    for (uint32_t id = 0; id < per_buf; ++id) {
+        __shield_log_write(id, words.data(), words.size());
+        written.push_back({ id, words });
+    }
+    ASSERT_EQ(kernel_stub_logs(), 0U);
+    __shield_log_write(per_buf, words.data(), words.size());
+    written.push_back({ (uint32_t)per_buf, words });
+    ASSERT_GT(kernel_stub_logs(), 0U);
+    /* only the last entry is still buffered */
+    auto entries = decode(&nframes);
+    EXPECT_EQ(entries.size(), per_buf);
+    shield_log_flush();
+    entries = decode(&nframes);
+    EXPECT_EQ(entries, written);
+}
@@ -0,0 +1,191 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <shield/private/lz.h>
+
+static std::vector<uint8_t> roundtrip(const std::vector<uint8_t>& in, size_t *clen)
+{
+    static uint16_t hash[LZ_HASH_LEN];
+    std::vector<uint8_t> comp(LZ_BOUND(in.size()));
+    std::vector<uint8_t> out(in.size());
+    size_t out_len = 0;
+
+    *clen = __lz_compress(hash, in.data(), in.size(), comp.data(), comp.size());
+    EXPECT_NE(*clen, 0U);
+    EXPECT_TRUE(__lz_decode(comp.data(), *clen, out.data(), 0, out.size(), &out_len));
+    out.resize(out_len);
+    return out;
+}
+
+TEST(TestLz, Empty) {
+    static uint16_t hash[LZ_HASH_LEN];
+    const uint8_t in[1] = { 0 };
+    uint8_t comp[LZ_BOUND(0)];
+    uint8_t out[1];
+    size_t out_len = 1;
+
+    ASSERT_EQ(__lz_compress(hash, in, 0, comp, sizeof(comp)), 1U);
+    ASSERT_EQ(comp[0], 0);
+    ASSERT_TRUE(__lz_decode(comp, 1, out, 0, sizeof(out), &out_len));
+    ASSERT_EQ(out_len, 0U);
+}
+
+TEST(TestLz, Repetitive) {
+    std::vector<uint8_t> in;
+    size_t clen;
+
+    for (int i = 0; i < 64; ++i) {
+        const char rec[] = "{\"id\":12,\"temp\":21,\"state\":\"ok\"}";
+        in.insert(in.end(), rec, rec + sizeof(rec) - 1);
+    }
+    ASSERT_EQ(roundtrip(in, &clen), in);
+    ASSERT_LT(clen, in.size() / 10);
+}
+
+TEST(TestLz, LongRuns) {
+    /* overlapping matches and lengths spanning several extension bytes */
+    std::vector<uint8_t> in(1000, 'a');
+    size_t clen;
+
+    in.insert(in.end(), 300, 'b');
+    in.push_back('c');
+    ASSERT_EQ(roundtrip(in, &clen), in);
+    ASSERT_LT(clen, 32U);
+}
+
+TEST(TestLz, Incompressible) {
+    static uint16_t hash[LZ_HASH_LEN];
+    std::mt19937 gen(1);
+    std::vector<uint8_t> in(1024);
+    std::vector<uint8_t> comp(LZ_BOUND(in.size()));
+    size_t clen;
+
+    for (auto& b : in) {
+        b = static_cast<uint8_t>(gen());
+    }
+    ASSERT_EQ(roundtrip(in, &clen), in);
+    ASSERT_LE(clen, LZ_BOUND(in.size()));
+    /* does not fit in a smaller buffer */
+    ASSERT_EQ(__lz_compress(hash, in.data(), in.size(), comp.data(), in.size() - 1), 0U);
+}
+
+TEST(TestLz, RandomMix) {
+    std::mt19937 gen(2);
+
+    for (int it = 0; it < 200; ++it) {
+        std::vector<uint8_t> in(gen() % 2048);
+        size_t clen;
+        for (size_t i = 0; i < in.size(); ++i) {
+            /* small alphabet, random back references */
+            if (i > 8 && gen() % 4 == 0) {
+                in[i] = in[i - 1 - (gen() % 8)];
+            } else {
+                in[i] = static_cast<uint8_t>('a' + gen() % 4);
+            }
+        }
+        ASSERT_EQ(roundtrip(in, &clen), in);
+    }
+}
+
+TEST(TestLz, DecodeBounds) {
+    uint8_t out[16];
+    size_t out_len;
+    /* match before the output start */
+    const uint8_t bad_offset[] = { 0x14, 'a', 0x02, 0x00 };
+    /* zero offset */
+    const uint8_t zero_offset[] = { 0x10, 'a', 0x00, 0x00 };
+    /* truncated offset */
+    const uint8_t truncated[] = { 0x10, 'a', 0x01 };
+    /* literals longer than the input */
+    const uint8_t short_lit[] = { 0x50, 'a', 'b' };
+    /* output overflow */
+    const uint8_t overflow[] = { 0x1f, 'a', 0x01, 0x00, 0x10 };
+    /* valid: 'a' then 19 repetitions, fits in 20 bytes */
+    const uint8_t valid[] = { 0x1f, 'a', 0x01, 0x00, 0x00, 0x00 };
+
+    ASSERT_FALSE(__lz_decode(bad_offset, sizeof(bad_offset), out, 0, sizeof(out), &out_len));
+    ASSERT_FALSE(__lz_decode(zero_offset, sizeof(zero_offset), out, 0, sizeof(out), &out_len));
+    ASSERT_FALSE(__lz_decode(truncated, sizeof(truncated), out, 0, sizeof(out), &out_len));
+    ASSERT_FALSE(__lz_decode(short_lit, sizeof(short_lit), out, 0, sizeof(out), &out_len));
+    ASSERT_FALSE(__lz_decode(overflow, sizeof(overflow), out, 0, sizeof(out), &out_len));
+    ASSERT_FALSE(__lz_decode(valid, sizeof(valid), out, 0, sizeof(out), &out_len));
+    {
+        uint8_t big[20];
+        ASSERT_TRUE(__lz_decode(valid, sizeof(valid), big, 0, sizeof(big), &out_len));
+        ASSERT_EQ(out_len, 20U);
+        for (auto b : big) {
+            ASSERT_EQ(b, 'a');
+        }
+    }
+}
+
+TEST(TestLz, DecodeGarbage) {
+    /* whatever the input, the decoder stays in the output buffer (checked with sanitizers) */
+    std::mt19937 gen(3);
+    std::vector<uint8_t> out(64);
+
+    for (int it = 0; it < 10000; ++it) {
+        std::vector<uint8_t> in(1 + gen() % 32);
+        size_t out_len;
+        for (auto& b : in) {
+            b = static_cast<uint8_t>(gen());
+        }
+        if (__lz_decode(in.data(), in.size(), out.data(), 0, out.size(), &out_len)) {
+            ASSERT_LE(out_len, out.size());
+        }
+    }
+}
+
+TEST(TestLz, Stream) {
+    static lz_enc_stream_t enc;
+    static lz_dec_stream_t dec;
+    size_t raw = 0;
+    size_t comp = 0;
+
+    __lz_enc_stream_init(&enc);
+    __lz_dec_stream_init(&dec);
+    for (int i = 0; i < 500; ++i) {
+        char line[LZ_WINDOW];
+        uint8_t c[LZ_WINDOW];
+        uint8_t out[LZ_WINDOW];
+        const int len = snprintf(line, sizeof(line), "[%8d] sensor %d: temperature=%d humidity=%d\n",
+                                 i * 1000, i % 3, 20 + (i % 7), 40 + (i % 11));
+        const size_t clen = __lz_stream_compress(&enc, reinterpret_cast<uint8_t *>(line), len, c);
+        ASSERT_LE(clen, static_cast<size_t>(len));
+        ASSERT_TRUE(__lz_stream_decompress(&dec, c, clen, out, len));
+        ASSERT_EQ(memcmp(out, line, len), 0);
+        raw += len;
+        comp += clen;
+    }
+    /* lines are compressed against the previous ones */
+    ASSERT_LT(comp, raw / 2);
+}
+
+TEST(TestLz, StreamStored) {
+    static lz_enc_stream_t enc;
+    static lz_dec_stream_t dec;
+    std::mt19937 gen(4);
+
+    __lz_enc_stream_init(&enc);
+    __lz_dec_stream_init(&dec);
+    for (int i = 0; i < 200; ++i) {
+        uint8_t in[LZ_WINDOW];
+        uint8_t c[LZ_WINDOW];
+        uint8_t out[LZ_WINDOW];
+        const size_t len = 1 + gen() % LZ_WINDOW;
+        /* random blocks, and repetitions of the previous ones */
+        for (size_t j = 0; j < len; ++j) {
+            in[j] = (i % 2) ? static_cast<uint8_t>(gen()) : static_cast<uint8_t>('0' + j % 10);
+        }
+        const size_t clen = __lz_stream_compress(&enc, in, len, c);
+        ASSERT_LE(clen, len);
+        ASSERT_TRUE(__lz_stream_decompress(&dec, c, clen, out, len));
+        ASSERT_EQ(memcmp(out, in, len), 0);
+    }
+}
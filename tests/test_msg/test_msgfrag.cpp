@@ -0,0 +1,176 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <shield/private/msgfrag.h>
+
+/*
+ * Message reassembly, each source having its own reassembly state, on a pool of two
+ * reassembly buffers.
+ */
+
+class TestMsgfrag : public ::testing::Test {
+protected:
+    static constexpr size_t kMaxLen = 64;
+    alignas(long) uint8_t blocks[2 * kMaxLen];
+    msgpool_class_t pool[1];
+    msgfrag_reasm_t src[3];
+    uint32_t drops;
+
+    void SetUp() override {
+        pool[0] = { blocks, kMaxLen, 2, 0 };
+        memset(src, 0, sizeof(src));
+        drops = 0;
+    }
+
+    /*
+     * receive the fragment of msg at offset on the given source, as done on IPC reception
+     *
+     * @return the __msgfrag_start() status, out holding the message once complete
+     */
+    msgfrag_status_t input(msgfrag_reasm_t *reasm, uint8_t msg_id, uint16_t offset, bool last,
+                           const std::vector<uint8_t> &msg, size_t len, std::vector<uint8_t> *out) {
+        const msgfrag_hdr_t hdr = { msg_id, (uint8_t)(last ? MSGFRAG_LAST : 0), offset };
+        msgfrag_status_t status;
+
+        if (__msgfrag_sync(reasm, pool, 1, &hdr)) {
+            drops++;
+        }
+        status = __msgfrag_start(reasm, pool, 1, &hdr, len, kMaxLen);
+        if (status == MSGFRAG_DROP) {
+            drops++;
+        }
+        if (status != MSGFRAG_READY) {
+            return status;
+        }
+        __msgfrag_append(reasm, &msg[offset], len);
+        if (last) {
+            const size_t msg_len = reasm->len;
+            uint8_t *buf = __msgfrag_take(reasm);
+            out->assign(buf, buf + msg_len);
+            __msgpool_free(pool, 1, buf);
+        }
+        return status;
+    }
+
+    static std::vector<uint8_t> message(uint8_t seed, size_t len) {
+        std::vector<uint8_t> msg(len);
+        for (size_t i = 0; i < len; ++i) {
+            msg[i] = (uint8_t)(seed + i);
+        }
+        return msg;
+    }
+};
+
+TEST_F(TestMsgfrag, InOrder) {
+    const auto msg = message(1, 50);
+    std::vector<uint8_t> out;
+
+    ASSERT_EQ(input(&src[0], 4, 0, false, msg, 20, &out), MSGFRAG_READY);
+    ASSERT_EQ(pool[0].used, 1U);
+    ASSERT_EQ(input(&src[0], 4, 20, false, msg, 20, &out), MSGFRAG_READY);
+    ASSERT_TRUE(out.empty());
+    ASSERT_EQ(input(&src[0], 4, 40, true, msg, 10, &out), MSGFRAG_READY);
+    ASSERT_EQ(out, msg);
+    ASSERT_EQ(src[0].buf, nullptr);
+    ASSERT_EQ(pool[0].used, 0U);
+    ASSERT_EQ(drops, 0U);
+}
+
+TEST_F(TestMsgfrag, DropOnGap) {
+    const auto msg = message(1, 50);
+    const auto next = message(2, 30);
+    std::vector<uint8_t> out;
+
+    /* the second fragment is lost: the third one drops the message */
+    ASSERT_EQ(input(&src[0], 4, 0, false, msg, 20, &out), MSGFRAG_READY);
+    ASSERT_EQ(input(&src[0], 4, 40, true, msg, 10, &out), MSGFRAG_DROP);
+    ASSERT_EQ(drops, 2U);
+    ASSERT_EQ(src[0].buf, nullptr);
+    ASSERT_EQ(pool[0].used, 0U);
+    ASSERT_TRUE(out.empty());
+
+    /* the end of a message is lost: the next message drops it, and is received */
+    ASSERT_EQ(input(&src[0], 5, 0, false, msg, 20, &out), MSGFRAG_READY);
+    ASSERT_EQ(input(&src[0], 6, 0, false, next, 20, &out), MSGFRAG_READY);
+    ASSERT_EQ(drops, 3U);
+    ASSERT_EQ(input(&src[0], 6, 20, true, next, 10, &out), MSGFRAG_READY);
+    ASSERT_EQ(out, next);
+    ASSERT_EQ(pool[0].used, 0U);
+
+    /* same offset, other message id */
+    out.clear();
+    ASSERT_EQ(input(&src[0], 7, 0, false, msg, 20, &out), MSGFRAG_READY);
+    ASSERT_EQ(input(&src[0], 8, 20, true, msg, 10, &out), MSGFRAG_DROP);
+    ASSERT_EQ(drops, 5U);
+    ASSERT_TRUE(out.empty());
+    ASSERT_EQ(pool[0].used, 0U);
+
+    /* replayed fragment */
+    ASSERT_EQ(input(&src[0], 9, 0, false, msg, 20, &out), MSGFRAG_READY);
+    ASSERT_EQ(input(&src[0], 9, 0, false, msg, 20, &out), MSGFRAG_READY);
+    ASSERT_EQ(drops, 6U);
+    ASSERT_EQ(input(&src[0], 9, 20, true, msg, 30, &out), MSGFRAG_READY);
+    ASSERT_EQ(out, msg);
+}
+
+TEST_F(TestMsgfrag, InterleavedSources) {
+    const auto a = message(1, 60);
+    const auto b = message(100, 45);
+    std::vector<uint8_t> out_a, out_b;
+
+    ASSERT_EQ(input(&src[0], 1, 0, false, a, 20, &out_a), MSGFRAG_READY);
+    ASSERT_EQ(input(&src[1], 1, 0, false, b, 15, &out_b), MSGFRAG_READY);
+    ASSERT_EQ(input(&src[0], 1, 20, false, a, 20, &out_a), MSGFRAG_READY);
+    ASSERT_EQ(input(&src[1], 1, 15, false, b, 15, &out_b), MSGFRAG_READY);
+    ASSERT_EQ(input(&src[1], 1, 30, true, b, 15, &out_b), MSGFRAG_READY);
+    ASSERT_EQ(out_b, b);
+    ASSERT_TRUE(out_a.empty());
+    ASSERT_EQ(input(&src[0], 1, 40, true, a, 20, &out_a), MSGFRAG_READY);
+    ASSERT_EQ(out_a, a);
+    ASSERT_EQ(drops, 0U);
+    ASSERT_EQ(pool[0].used, 0U);
+}
+
+TEST_F(TestMsgfrag, PoolExhaustion) {
+    const auto msg = message(1, 40);
+    std::vector<uint8_t> out;
+
+    ASSERT_EQ(input(&src[0], 1, 0, false, msg, 20, &out), MSGFRAG_READY);
+    ASSERT_EQ(input(&src[1], 1, 0, false, msg, 20, &out), MSGFRAG_READY);
+    /* no buffer left: nothing is changed, the fragment can be received again later */
+    ASSERT_EQ(input(&src[2], 3, 0, false, msg, 20, &out), MSGFRAG_NOMEM);
+    ASSERT_EQ(src[2].buf, nullptr);
+    ASSERT_EQ(drops, 0U);
+    /* fragments of messages being reassembled don't need a buffer */
+    ASSERT_EQ(input(&src[0], 1, 20, true, msg, 20, &out), MSGFRAG_READY);
+    ASSERT_EQ(out, msg);
+    out.clear();
+    ASSERT_EQ(input(&src[2], 3, 0, false, msg, 20, &out), MSGFRAG_READY);
+    ASSERT_EQ(input(&src[2], 3, 20, true, msg, 20, &out), MSGFRAG_READY);
+    ASSERT_EQ(out, msg);
+    ASSERT_EQ(pool[0].used, 2U);
+    __msgfrag_abort(&src[1], pool, 1);
+    ASSERT_EQ(pool[0].used, 0U);
+}
+
+TEST_F(TestMsgfrag, Oversized) {
+    const auto msg = message(1, kMaxLen + 10);
+    std::vector<uint8_t> out;
+
+    ASSERT_EQ(input(&src[0], 1, 0, false, msg, 40, &out), MSGFRAG_READY);
+    ASSERT_EQ(input(&src[0], 1, 40, false, msg, 30, &out), MSGFRAG_DROP);
+    ASSERT_EQ(src[0].buf, nullptr);
+    ASSERT_EQ(pool[0].used, 0U);
+    /* the end of the dropped message, without its beginning */
+    ASSERT_EQ(input(&src[0], 1, 70, true, msg, 4, &out), MSGFRAG_DROP);
+    ASSERT_EQ(drops, 2U);
+    ASSERT_TRUE(out.empty());
+    /* a message of the maximum length fits */
+    ASSERT_EQ(input(&src[0], 2, 0, true, msg, kMaxLen, &out), MSGFRAG_READY);
+    ASSERT_EQ(out, std::vector<uint8_t>(msg.begin(), msg.begin() + kMaxLen));
+}
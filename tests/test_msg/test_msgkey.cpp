@@ -0,0 +1,170 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <random>
+#include <vector>
+#include <shield/private/msgkey.h>
+
+/*
+ * The key index is checked against a std::map, with keys chosen to collide on the
+ * same home cell, and probe sequences wrapping at the end of the table, so that the
+ * backward shift deletion is exercised.
+ */
+
+class TestMsgkey : public ::testing::Test {
+protected:
+    msgkey_index_t idx;
+    std::map<uint32_t, uint8_t> model;
+
+    void SetUp() override {
+        memset(&idx, 0, sizeof(idx));
+    }
+
+    /* n distinct keys whose home cell is the given one */
+    static std::vector<uint32_t> keys_at(uint32_t cell, size_t n, uint32_t from = 1) {
+        std::vector<uint32_t> keys;
+        for (uint32_t key = from; keys.size() < n; ++key) {
+            if (__msgkey_hash(key) == cell) {
+                keys.push_back(key);
+            }
+        }
+        return keys;
+    }
+
+    void insert(uint8_t id, uint32_t key) {
+        __msgkey_insert(&idx, id, key);
+        model[key] = id;
+    }
+
+    void remove(uint32_t key) {
+        __msgkey_remove(&idx, model.at(key));
+        model.erase(key);
+    }
+
+    void check(const std::vector<uint32_t> &absent = {}) {
+        size_t used = 0;
+        for (auto &[key, id] : model) {
+            ASSERT_EQ(__msgkey_lookup(&idx, key), id) << "key=" << key;
+        }
+        for (uint32_t key : absent) {
+            if (model.count(key) == 0) {
+                ASSERT_EQ(__msgkey_lookup(&idx, key), -1) << "key=" << key;
+            }
+        }
+        for (uint32_t c = 0; c < MSGKEY_INDEX_LEN; ++c) {
+            used += (idx.cells[c] != 0);
+        }
+        ASSERT_EQ(used, model.size());
+    }
+};
+
+TEST_F(TestMsgkey, HashRange) {
+    for (uint32_t key = 0; key < 100000; ++key) {
+        ASSERT_LT(__msgkey_hash(key), MSGKEY_INDEX_LEN);
+    }
+    ASSERT_LT(__msgkey_hash(UINT32_MAX), MSGKEY_INDEX_LEN);
+}
+
+TEST_F(TestMsgkey, Empty) {
+    ASSERT_EQ(__msgkey_lookup(&idx, 0), -1);
+    ASSERT_EQ(__msgkey_lookup(&idx, 0x1234), -1);
+}
+
+TEST_F(TestMsgkey, CollidingKeys) {
+    const auto keys = keys_at(3, MSGKEY_IDS);
+
+    for (uint8_t id = 0; id < MSGKEY_IDS; ++id) {
+        insert(id, keys[id]);
+        check(keys);
+    }
+    /* remove from the middle of the probe sequence, keys behind are moved back */
+    remove(keys[2]);
+    check(keys);
+    ASSERT_EQ(idx.cells[(3 + MSGKEY_IDS - 1) & MSGKEY_INDEX_MASK], 0);
+    remove(keys[0]);
+    check(keys);
+    remove(keys[MSGKEY_IDS - 1]);
+    check(keys);
+    insert(2, keys[2]);
+    check(keys);
+}
+
+TEST_F(TestMsgkey, WrappingProbeSequence) {
+    const uint32_t last = MSGKEY_INDEX_LEN - 1;
+    const auto tail = keys_at(last, 3);
+    const auto head = keys_at(0, 2);
+
+    /* tail keys wrap to cells 0 and 1, head keys are pushed after them */
+    insert(0, tail[0]);
+    insert(1, tail[1]);
+    insert(2, head[0]);
+    insert(3, tail[2]);
+    insert(4, head[1]);
+    check();
+    ASSERT_EQ(idx.cells[last], 1);
+    ASSERT_EQ(idx.cells[0], 2);
+    /* a key whose home cell is before the hole, across the wrap, is moved back */
+    remove(tail[0]);
+    check();
+    ASSERT_EQ(idx.cells[last], 2);
+    remove(head[0]);
+    check();
+    remove(tail[1]);
+    check();
+    remove(tail[2]);
+    check();
+    ASSERT_EQ(idx.cells[0], 5);
+}
+
+TEST_F(TestMsgkey, KeyNotMovedBeforeItsHome) {
+    const auto a = keys_at(5, 2);
+    const auto b = keys_at(7, 1);
+
+    /* cells: 5:a0 6:a1 7:b0, removing a0 moves a1 back, b0 stays at its home */
+    insert(0, a[0]);
+    insert(1, a[1]);
+    insert(2, b[0]);
+    ASSERT_EQ(idx.cells[7], 3);
+    remove(a[0]);
+    check();
+    ASSERT_EQ(idx.cells[5], 2);
+    ASSERT_EQ(idx.cells[6], 0);
+    ASSERT_EQ(idx.cells[7], 3);
+}
+
+TEST_F(TestMsgkey, RandomVsModel) {
+    std::mt19937 gen(42);
+    /* small key space, to get collisions and reinsertions */
+    std::uniform_int_distribution<uint32_t> keydist(1, 64);
+    std::vector<uint32_t> all;
+
+    for (uint32_t key = 1; key <= 64; ++key) {
+        all.push_back(key);
+    }
+    for (int i = 0; i < 100000; ++i) {
+        const uint32_t key = keydist(gen);
+        if (model.count(key) != 0) {
+            remove(key);
+        } else if (model.size() < MSGKEY_IDS) {
+            uint8_t id = 0;
+            /* first free identifier */
+            for (bool used = true; used; ) {
+                used = false;
+                for (auto &[k, v] : model) {
+                    if (v == id) {
+                        used = true;
+                        id++;
+                        break;
+                    }
+                }
+            }
+            insert(id, key);
+        }
+        check(all);
+    }
+}
@@ -0,0 +1,66 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <set>
+#include <shield/private/msgpool.h>
+
+class TestMsgpool : public ::testing::Test {
+protected:
+    alignas(long) uint8_t small[4 * 16];
+    alignas(long) uint8_t medium[2 * 64];
+    alignas(long) uint8_t large[32 * 256];
+    msgpool_class_t pool[3];
+
+    void SetUp() override {
+        pool[0] = { small, 16, 4, 0 };
+        pool[1] = { medium, 64, 2, 0 };
+        pool[2] = { large, 256, 32, 0 };
+    }
+};
+
+TEST_F(TestMsgpool, SmallestFittingClass) {
+    uint8_t *b;
+
+    b = static_cast<uint8_t *>(__msgpool_alloc(pool, 3, 1));
+    ASSERT_EQ(b, &small[0]);
+    b = static_cast<uint8_t *>(__msgpool_alloc(pool, 3, 16));
+    ASSERT_EQ(b, &small[16]);
+    b = static_cast<uint8_t *>(__msgpool_alloc(pool, 3, 17));
+    ASSERT_EQ(b, &medium[0]);
+    b = static_cast<uint8_t *>(__msgpool_alloc(pool, 3, 65));
+    ASSERT_EQ(b, &large[0]);
+    ASSERT_EQ(__msgpool_alloc(pool, 3, 257), nullptr);
+}
+
+TEST_F(TestMsgpool, FallbackToBiggerClass) {
+    for (uint8_t i = 0; i < 4; ++i) {
+        ASSERT_EQ(__msgpool_alloc(pool, 3, 8), &small[i * 16]);
+    }
+    ASSERT_EQ(__msgpool_alloc(pool, 3, 8), &medium[0]);
+    ASSERT_EQ(__msgpool_alloc(pool, 3, 8), &medium[64]);
+    ASSERT_EQ(__msgpool_alloc(pool, 3, 8), &large[0]);
+    /* a freed small block is used again first */
+    __msgpool_free(pool, 3, &small[32]);
+    ASSERT_EQ(__msgpool_alloc(pool, 3, 8), &small[32]);
+}
+
+TEST_F(TestMsgpool, Exhaustion) {
+    std::set<void *> blocks;
+    void *b;
+
+    while ((b = __msgpool_alloc(pool, 3, 100)) != nullptr) {
+        ASSERT_TRUE(blocks.insert(b).second);
+    }
+    /* full 32 blocks class */
+    ASSERT_EQ(blocks.size(), 32U);
+    ASSERT_EQ(pool[2].used, 0xffffffffU);
+    for (auto p : blocks) {
+        __msgpool_free(pool, 3, p);
+    }
+    ASSERT_EQ(pool[2].used, 0U);
+    ASSERT_EQ(pool[0].used, 0U);
+    ASSERT_EQ(pool[1].used, 0U);
+}
@@ -0,0 +1,152 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#include <gtest/gtest.h>
+#include <climits>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <shield/private/msgq.h>
+
+/*
+ * The queue index selection is checked against a naive model: a list of
+ * (mtype, slot) in arrival order, walked for each selection.
+ */
+
+struct Model {
+    std::deque<std::pair<long, uint8_t>> msgs;
+
+    uint8_t select(long msgtyp, bool except) const {
+        if (msgtyp == 0) {
+            return msgs.empty() ? MSGQ_NIL : msgs.front().second;
+        }
+        if (msgtyp < 0) {
+            const long bound = (msgtyp == LONG_MIN) ? LONG_MAX : -msgtyp;
+            uint8_t best = MSGQ_NIL;
+            long best_type = 0;
+            for (auto &m : msgs) {
+                if (m.first <= bound && (best == MSGQ_NIL || m.first < best_type)) {
+                    best = m.second;
+                    best_type = m.first;
+                }
+            }
+            return best;
+        }
+        for (auto &m : msgs) {
+            if ((except && m.first != msgtyp) || (!except && m.first == msgtyp)) {
+                return m.second;
+            }
+        }
+        return MSGQ_NIL;
+    }
+
+    void remove(uint8_t slot) {
+        for (auto it = msgs.begin(); it != msgs.end(); ++it) {
+            if (it->second == slot) {
+                msgs.erase(it);
+                return;
+            }
+        }
+    }
+};
+
+TEST(TestMsgq, EmptyQueue) {
+    msgq_index_t q;
+    __msgq_init(&q);
+    ASSERT_EQ(__msgq_select(&q, 0, false), MSGQ_NIL);
+    ASSERT_EQ(__msgq_select(&q, 1, false), MSGQ_NIL);
+    ASSERT_EQ(__msgq_select(&q, 1, true), MSGQ_NIL);
+    ASSERT_EQ(__msgq_select(&q, -1, false), MSGQ_NIL);
+}
+
+TEST(TestMsgq, FullQueue) {
+    msgq_index_t q;
+    __msgq_init(&q);
+    for (long i = 0; i < MSGQ_DEPTH; ++i) {
+        ASSERT_NE(__msgq_insert(&q, i + 1), MSGQ_NIL);
+    }
+    ASSERT_TRUE(__msgq_full(&q));
+    ASSERT_EQ(__msgq_insert(&q, 1), MSGQ_NIL);
+}
+
+TEST(TestMsgq, LowestTypeFirstThenArrival) {
+    msgq_index_t q;
+    __msgq_init(&q);
+    uint8_t a = __msgq_insert(&q, 5);
+    uint8_t b = __msgq_insert(&q, 3);
+    uint8_t c = __msgq_insert(&q, 3);
+    uint8_t d = __msgq_insert(&q, 4);
+
+    ASSERT_EQ(__msgq_select(&q, -2, false), MSGQ_NIL);
+    ASSERT_EQ(__msgq_select(&q, -3, false), b);
+    __msgq_remove(&q, b);
+    ASSERT_EQ(__msgq_select(&q, -10, false), c);
+    __msgq_remove(&q, c);
+    ASSERT_EQ(__msgq_select(&q, LONG_MIN, false), d);
+    ASSERT_EQ(__msgq_select(&q, 0, false), a);
+    ASSERT_EQ(__msgq_select(&q, 5, true), d);
+    ASSERT_EQ(__msgq_select(&q, 5 + MSGQ_TYPE_BUCKETS, false), MSGQ_NIL);
+}
+
+TEST(TestMsgq, RandomVsModel) {
+    std::mt19937 rng(0x5eed);
+    msgq_index_t q;
+    Model model;
+
+    __msgq_init(&q);
+    for (uint32_t iter = 0; iter < 1000000; ++iter) {
+        const uint32_t op = rng() % 4;
+        /* few distinct types, to get collisions and equal types */
+        const long mtype = (long)(rng() % 20) + 1;
+
+        if (op == 0 && !__msgq_full(&q)) {
+            uint8_t slot = __msgq_insert(&q, mtype);
+            ASSERT_NE(slot, MSGQ_NIL);
+            model.msgs.emplace_back(mtype, slot);
+        } else {
+            long msgtyp;
+            bool except = false;
+            switch (op) {
+                case 1: msgtyp = 0; break;
+                case 2: msgtyp = -mtype; break;
+                default: msgtyp = mtype; except = (rng() & 1); break;
+            }
+            uint8_t expected = model.select(msgtyp, except);
+            ASSERT_EQ(__msgq_select(&q, msgtyp, except), expected)
+                << "iter=" << iter << " msgtyp=" << msgtyp << " except=" << except;
+            if (expected != MSGQ_NIL && (rng() & 1)) {
+                __msgq_remove(&q, expected);
+                model.remove(expected);
+            }
+        }
+        ASSERT_EQ(q.count, model.msgs.size());
+    }
+}
+
+TEST(TestMsgq, DetachedSlotKeptUpToFree) {
+    msgq_index_t q;
+    __msgq_init(&q);
+    for (long i = 0; i < MSGQ_DEPTH; ++i) {
+        ASSERT_NE(__msgq_insert(&q, 1), MSGQ_NIL);
+    }
+    uint8_t lent = __msgq_select(&q, 0, false);
+    __msgq_detach(&q, lent);
+    /* no more selectable, but its slot can't be reused */
+    ASSERT_NE(__msgq_select(&q, 0, false), lent);
+    ASSERT_EQ(q.count, MSGQ_DEPTH - 1);
+    ASSERT_TRUE(__msgq_full(&q));
+    ASSERT_EQ(__msgq_insert(&q, 2), MSGQ_NIL);
+    __msgq_free(&q, lent);
+    ASSERT_EQ(__msgq_insert(&q, 2), lent);
+}
+
+TEST(TestMsgq, MatchIncoming) {
+    ASSERT_TRUE(__msgq_match(7, 0, false));
+    ASSERT_TRUE(__msgq_match(7, 7, false));
+    ASSERT_FALSE(__msgq_match(7, 7, true));
+    ASSERT_TRUE(__msgq_match(8, 7, true));
+    ASSERT_TRUE(__msgq_match(7, -7, false));
+    ASSERT_FALSE(__msgq_match(8, -7, false));
+    ASSERT_TRUE(__msgq_match(LONG_MAX, LONG_MIN, false));
+}
@@ -0,0 +1,127 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#include <stdbool.h>
+#include <string.h>
+#include <uapi.h>
+#include "kernel_stub.h"
+
+#define KERNEL_STUB_DEPTH 64
+
+typedef struct {
+    uint32_t source;
+    uint8_t  len;
+    uint8_t  data[CONFIG_SVC_EXCHANGE_AREA_LEN];
+} kernel_stub_event_t;
+
+/* SVC exchange area, exchange_event_t typed on libshield side */
+_Alignas(uint32_t) uint8_t svc_exchange[CONFIG_SVC_EXCHANGE_AREA_LEN] __asm__("_s_svcexchange");
+
+static kernel_stub_event_t script[KERNEL_STUB_DEPTH];
+static size_t script_len;
+static size_t script_pos;
+static uint32_t blocked;
+static uint32_t waits;
+static uint64_t now_ms;
+
+void kernel_stub_reset(void)
+{
+    script_len = 0;
+    script_pos = 0;
+    blocked = 0;
+    waits = 0;
+}
+
+void kernel_stub_push_ipc(uint32_t source, const void *data, size_t len)
+{
+    kernel_stub_event_t *event = &script[script_len++];
+
+    event->source = source;
+    event->len = (uint8_t)len;
+    memcpy(&event->data[0], data, len);
+}
+
+size_t kernel_stub_pending(void)
+{
+    return script_len - script_pos;
+}
+
+uint32_t kernel_stub_blocked(void)
+{
+    return blocked;
+}
+
+uint32_t kernel_stub_waits(void)
+{
+    return waits;
+}
+
+Status __sys_wait_for_event(uint8_t mask, int32_t timeout)
+{
+    Status ret = STATUS_AGAIN;
+    exchange_event_t *event = (exchange_event_t *)&svc_exchange[0];
+
+    waits++;
+    if (script_pos < script_len && (mask & EVENT_TYPE_IPC)) {
+        event->type = EVENT_TYPE_IPC;
+        event->source = script[script_pos].source;
+        event->length = script[script_pos].len;
+        memcpy(&event->data[0], &script[script_pos].data[0], script[script_pos].len);
+        script_pos++;
+        ret = STATUS_OK;
+    } else if (timeout > 0) {
+        now_ms += (uint64_t)timeout;
+        ret = STATUS_TIMEOUT;
+    } else if (timeout == 0) {
+        /* would block forever */
+        blocked++;
+        ret = STATUS_DENIED;
+    }
+    return ret;
+}
+
+Status __sys_send_ipc(uint32_t target, uint8_t len)
+{
+    (void)target;
+    (void)len;
+    return STATUS_OK;
+}
+
+Status copy_to_kernel(const uint8_t *from, size_t len)
+{
+    memcpy(svc_exchange, from, len);
+    return STATUS_OK;
+}
+
+/* libshield time services, from time.c */
+int __shield_time_now_ms(uint64_t *now)
+{
+    *now = now_ms;
+    return 0;
+}
+
+int __shield_time_now_us(uint64_t *now)
+{
+    *now = now_ms * 1000;
+    return 0;
+}
+
+bool timer_armed(void)
+{
+    return false;
+}
+
+bool timer_pending(void)
+{
+    return false;
+}
+
+int timer_handler(void)
+{
+    return 0;
+}
+
+void timer_dispatch(void)
+{
+}
@@ -0,0 +1,42 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#ifndef TEST_KERNEL_STUB_H
+#define TEST_KERNEL_STUB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Scripted kernel, for the libshield SysV messages host tests.
+ *
+ * __sys_wait_for_event() delivers the scripted events in order. Once the script is
+ * consumed, a non-blocking wait returns STATUS_AGAIN, a timed wait moves the clock
+ * forward and returns STATUS_TIMEOUT, and a blocking wait, which would never return,
+ * is counted and returns STATUS_DENIED so that the test can check it.
+ */
+
+void kernel_stub_reset(void);
+
+/** script an IPC event from source, made of the given data */
+void kernel_stub_push_ipc(uint32_t source, const void *data, size_t len);
+
+/** number of scripted events not delivered yet */
+size_t kernel_stub_pending(void);
+
+/** number of blocking waits made once the script was consumed */
+uint32_t kernel_stub_blocked(void);
+
+/** number of __sys_wait_for_event() calls */
+uint32_t kernel_stub_waits(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!TEST_KERNEL_STUB_H*/
@@ -0,0 +1,266 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#include <gtest/gtest.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "kernel_stub.h"
+
+/*
+ * SysV messages API, on top of the events demultiplexer and a scripted kernel
+ * (see kernel_stub.h).
+ *
+ * shield/sys/msg.h can't be included here, as its types collide with the host libc
+ * ones, so the tested part of the API is declared here.
+ */
+extern "C" {
+struct msgbuf {
+    long mtype;
+    char mtext[1];
+};
+
+struct msgdesc {
+    int                  msqid;
+    const struct msgbuf  *msg;
+    size_t               msgsz;
+};
+
+int msgget(uint32_t key, int msgflg);
+ssize_t msgrcv_batch(struct msgdesc *descs, size_t count, int msgflg);
+int msgrcv_batch_release(const struct msgdesc *descs, size_t count);
+int msgctl(int msqid, int cmd, void *buf);
+int msgroute(int msqid, long mtype, void (*handler)(int, const struct msgbuf *, size_t, void *), void *arg);
+ssize_t msgdispatch(int msgflg);
+int __shield_errno_location(void);
+}
+
+#define IPC_CREAT   01000
+#define IPC_NOWAIT  04000
+#define IPC_RMID    0
+
+/* fragment header flags, see src/sys/msg.c */
+#define FRAG_LAST   0x1
+
+class TestMsgapi : public ::testing::Test {
+protected:
+    static constexpr uint32_t kSrc = 0x1001;
+    static constexpr uint32_t kUnknown = 0x2002;
+    int qid;
+
+    void SetUp() override {
+        kernel_stub_reset();
+        qid = msgget(kSrc, IPC_CREAT);
+        ASSERT_GE(qid, 0);
+    }
+
+    void TearDown() override {
+        struct msgdesc descs[8];
+        ssize_t num;
+
+        kernel_stub_reset();
+        while ((num = msgrcv_batch(descs, 8, IPC_NOWAIT)) > 0) {
+            msgrcv_batch_release(descs, num);
+        }
+        ASSERT_EQ(msgctl(qid, IPC_RMID, nullptr), 0);
+    }
+
+    /* an IPC holding the given part of a message (mtype then text) */
+    static void push_frag(uint32_t src, uint8_t msg_id, uint8_t flags, uint16_t offset,
+                          const std::vector<uint8_t> &content) {
+        std::vector<uint8_t> ipc = { msg_id, flags, (uint8_t)offset, (uint8_t)(offset >> 8) };
+        ipc.insert(ipc.end(), content.begin(), content.end());
+        kernel_stub_push_ipc(src, ipc.data(), ipc.size());
+    }
+
+    static std::vector<uint8_t> message(long mtype, const std::string &text) {
+        std::vector<uint8_t> msg(sizeof(long));
+        memcpy(msg.data(), &mtype, sizeof(long));
+        msg.insert(msg.end(), text.begin(), text.end());
+        return msg;
+    }
+
+    static void push_msg(uint32_t src, uint8_t msg_id, long mtype, const std::string &text) {
+        push_frag(src, msg_id, FRAG_LAST, 0, message(mtype, text));
+    }
+};
+
+TEST_F(TestMsgapi, BatchDrainsAllPending) {
+    struct msgdesc descs[4];
+
+    push_msg(kSrc, 0, 1, "a");
+    push_msg(kSrc, 1, 2, "bb");
+    push_msg(kSrc, 2, 3, "ccc");
+    ASSERT_EQ(msgrcv_batch(descs, 4, 0), 3);
+    ASSERT_EQ(kernel_stub_blocked(), 0U);
+    for (long i = 0; i < 3; ++i) {
+        ASSERT_EQ(descs[i].msqid, qid);
+        ASSERT_EQ(descs[i].msg->mtype, i + 1);
+        ASSERT_EQ(descs[i].msgsz, (size_t)i + 1);
+    }
+    ASSERT_EQ(msgrcv_batch_release(descs, 3), 0);
+}
+
+TEST_F(TestMsgapi, BatchBlocksAfterFragment) {
+    struct msgdesc descs[4];
+    const auto msg = message(7, "fragmented");
+
+    /* the first fragment does not queue any message: the wait goes on */
+    push_frag(kSrc, 0, 0, 0, std::vector<uint8_t>(msg.begin(), msg.begin() + 12));
+    ASSERT_EQ(msgrcv_batch(descs, 4, 0), -1);
+    ASSERT_EQ(kernel_stub_pending(), 0U);
+    ASSERT_EQ(kernel_stub_blocked(), 1U);
+
+    push_frag(kSrc, 0, FRAG_LAST, 12, std::vector<uint8_t>(msg.begin() + 12, msg.end()));
+    ASSERT_EQ(msgrcv_batch(descs, 4, 0), 1);
+    ASSERT_EQ(kernel_stub_blocked(), 1U);
+    ASSERT_EQ(descs[0].msg->mtype, 7);
+    ASSERT_EQ(descs[0].msgsz, 10U);
+    ASSERT_EQ(memcmp(descs[0].msg->mtext, "fragmented", 10), 0);
+    ASSERT_EQ(msgrcv_batch_release(descs, 1), 0);
+}
+
+TEST_F(TestMsgapi, BatchBlocksAfterDroppedIpc) {
+    struct msgdesc descs[4];
+
+    /* unknown source, and an IPC too short to be a message */
+    push_msg(kUnknown, 0, 1, "lost");
+    kernel_stub_push_ipc(kSrc, "\0", 1);
+    ASSERT_EQ(msgrcv_batch(descs, 4, 0), -1);
+    ASSERT_EQ(kernel_stub_pending(), 0U);
+    ASSERT_EQ(kernel_stub_blocked(), 1U);
+}
+
+TEST_F(TestMsgapi, BatchNowait) {
+    struct msgdesc descs[4];
+    const auto msg = message(7, "fragmented");
+
+    ASSERT_EQ(msgrcv_batch(descs, 4, IPC_NOWAIT), -1);
+    ASSERT_EQ(__shield_errno_location(), EAGAIN);
+    push_frag(kSrc, 0, 0, 0, std::vector<uint8_t>(msg.begin(), msg.begin() + 12));
+    ASSERT_EQ(msgrcv_batch(descs, 4, IPC_NOWAIT), -1);
+    ASSERT_EQ(__shield_errno_location(), EAGAIN);
+    ASSERT_EQ(kernel_stub_blocked(), 0U);
+    push_frag(kSrc, 0, FRAG_LAST, 12, std::vector<uint8_t>(msg.begin() + 12, msg.end()));
+    ASSERT_EQ(msgrcv_batch(descs, 4, IPC_NOWAIT), 1);
+    ASSERT_EQ(msgrcv_batch_release(descs, 1), 0);
+}
+
+TEST_F(TestMsgapi, BatchQueuedFirst) {
+    struct msgdesc descs[1];
+
+    /* messages already queued: no blocking wait */
+    push_msg(kSrc, 0, 1, "a");
+    push_msg(kSrc, 1, 2, "b");
+    ASSERT_EQ(msgrcv_batch(descs, 1, 0), 1);
+    ASSERT_EQ(descs[0].msg->mtype, 1);
+    ASSERT_EQ(msgrcv_batch_release(descs, 1), 0);
+    ASSERT_EQ(msgrcv_batch(descs, 1, 0), 1);
+    ASSERT_EQ(descs[0].msg->mtype, 2);
+    ASSERT_EQ(msgrcv_batch_release(descs, 1), 0);
+    ASSERT_EQ(kernel_stub_blocked(), 0U);
+}
+
+TEST_F(TestMsgapi, SingleIpcEndsInterruptedMessage) {
+    /* more interrupted sources than large pool blocks in the default configuration */
+    static constexpr uint32_t kSources = 4;
+    struct msgdesc descs[8];
+    std::vector<int> qids;
+    const auto big = message(9, std::string(200, 'x'));
+    size_t received = 0;
+    ssize_t num;
+
+    for (uint32_t i = 1; i <= kSources; ++i) {
+        qids.push_back(msgget(kSrc + i, IPC_CREAT));
+        ASSERT_GE(qids.back(), 0);
+    }
+    /* the end of each source message is lost, then the source sends a single IPC message */
+    for (uint32_t src : { kSrc, kSrc + 1, kSrc + 2, kSrc + 3 }) {
+        push_frag(src, 0, 0, 0, std::vector<uint8_t>(big.begin(), big.begin() + 100));
+        push_msg(src, 1, 1, "single");
+    }
+    /* the reassembly buffers have been released: a big message can still be received */
+    push_frag(kSrc + kSources, 0, 0, 0, std::vector<uint8_t>(big.begin(), big.begin() + 100));
+    push_frag(kSrc + kSources, 0, FRAG_LAST, 100, std::vector<uint8_t>(big.begin() + 100, big.end()));
+    while ((num = msgrcv_batch(descs, 8, IPC_NOWAIT)) > 0) {
+        for (ssize_t i = 0; i < num; ++i) {
+            if (descs[i].msqid == qids.back()) {
+                EXPECT_EQ(descs[i].msg->mtype, 9);
+                EXPECT_EQ(descs[i].msgsz, 200U);
+            } else {
+                EXPECT_EQ(descs[i].msg->mtype, 1);
+            }
+        }
+        received += num;
+        ASSERT_EQ(msgrcv_batch_release(descs, num), 0);
+    }
+    EXPECT_EQ(received, 5U);
+    EXPECT_EQ(kernel_stub_pending(), 0U);
+    for (int id : qids) {
+        ASSERT_EQ(msgctl(id, IPC_RMID, nullptr), 0);
+    }
+}
+
+static void count_handler(int msqid, const struct msgbuf *msg, size_t msgsz, void *arg)
+{
+    (void)msqid;
+    (void)msg;
+    (void)msgsz;
+    (*static_cast<int *>(arg))++;
+}
+
+TEST_F(TestMsgapi, DispatchRouted) {
+    int calls = 0;
+
+    ASSERT_EQ(msgroute(qid, 0, count_handler, &calls), 0);
+    push_msg(kSrc, 0, 1, "a");
+    push_msg(kSrc, 1, 2, "b");
+    ASSERT_EQ(msgdispatch(0), 2);
+    ASSERT_EQ(calls, 2);
+    ASSERT_EQ(kernel_stub_blocked(), 0U);
+}
+
+TEST_F(TestMsgapi, DispatchBlocksAfterFragment) {
+    int calls = 0;
+    const auto msg = message(7, "fragmented");
+
+    ASSERT_EQ(msgroute(qid, 0, count_handler, &calls), 0);
+    push_frag(kSrc, 0, 0, 0, std::vector<uint8_t>(msg.begin(), msg.begin() + 12));
+    ASSERT_EQ(msgdispatch(0), -1);
+    ASSERT_EQ(kernel_stub_blocked(), 1U);
+    ASSERT_EQ(calls, 0);
+    push_frag(kSrc, 0, FRAG_LAST, 12, std::vector<uint8_t>(msg.begin() + 12, msg.end()));
+    ASSERT_EQ(msgdispatch(0), 1);
+    ASSERT_EQ(calls, 1);
+}
+
+TEST_F(TestMsgapi, DispatchBlocksOnUnroutedMessages) {
+    struct msgdesc descs[4];
+    int calls = 0;
+
+    /* the documented msgdispatch() loop must not spin on messages without handler */
+    ASSERT_EQ(msgroute(qid, 2, count_handler, &calls), 0);
+    push_msg(kSrc, 0, 1, "not routed");
+    ASSERT_EQ(msgdispatch(0), -1);
+    ASSERT_EQ(kernel_stub_blocked(), 1U);
+    ASSERT_EQ(msgdispatch(0), -1);
+    ASSERT_EQ(kernel_stub_blocked(), 2U);
+    push_msg(kSrc, 1, 2, "routed");
+    ASSERT_EQ(msgdispatch(0), 1);
+    ASSERT_EQ(calls, 1);
+    ASSERT_EQ(kernel_stub_blocked(), 2U);
+    /* kept queued for msgrcv() */
+    ASSERT_EQ(msgrcv_batch(descs, 4, IPC_NOWAIT), 1);
+    ASSERT_EQ(descs[0].msg->mtype, 1);
+    ASSERT_EQ(msgrcv_batch_release(descs, 1), 0);
+}
+
+TEST_F(TestMsgapi, DispatchNowait) {
+    push_msg(kUnknown, 0, 1, "lost");
+    ASSERT_EQ(msgdispatch(IPC_NOWAIT), -1);
+    ASSERT_EQ(__shield_errno_location(), EAGAIN);
+    ASSERT_EQ(kernel_stub_blocked(), 0U);
+}
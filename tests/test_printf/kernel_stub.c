@@ -0,0 +1,77 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#include <string.h>
+#include <uapi.h>
+#include "kernel_stub.h"
+
+#define KERNEL_STUB_OUTPUT_LEN 4096
+#define KERNEL_STUB_LOGS       64
+
+static uint8_t svc_exchange[CONFIG_SVC_EXCHANGE_AREA_LEN];
+static uint8_t output[KERNEL_STUB_OUTPUT_LEN];
+static size_t output_len;
+static size_t log_len[KERNEL_STUB_LOGS];
+static uint32_t logs;
+
+#if defined(CONFIG_PRINTF_BUF_LEN)
+const size_t kernel_stub_printf_buf_len = CONFIG_PRINTF_BUF_LEN;
+#else
+const size_t kernel_stub_printf_buf_len = 128;
+#endif
+
+#if defined(CONFIG_LOG_LZ)
+const bool kernel_stub_log_lz = true;
+#else
+const bool kernel_stub_log_lz = false;
+#endif
+
+void kernel_stub_reset(void)
+{
+    output_len = 0;
+    logs = 0;
+}
+
+const uint8_t *kernel_stub_output(size_t *len)
+{
+    *len = output_len;
+    return &output[0];
+}
+
+uint32_t kernel_stub_logs(void)
+{
+    return logs;
+}
+
+size_t kernel_stub_log_len(uint32_t log)
+{
+    return (log < logs && log < KERNEL_STUB_LOGS) ? log_len[log] : 0;
+}
+
+Status copy_to_kernel(const uint8_t *from, size_t len)
+{
+    Status ret = STATUS_INVALID;
+
+    if (len <= sizeof(svc_exchange)) {
+        memcpy(svc_exchange, from, len);
+        ret = STATUS_OK;
+    }
+    return ret;
+}
+
+Status __sys_log(size_t len)
+{
+    Status ret = STATUS_INVALID;
+
+    if (len <= sizeof(svc_exchange) && output_len + len <= sizeof(output)) {
+        memcpy(&output[output_len], svc_exchange, len);
+        output_len += len;
+        if (logs < KERNEL_STUB_LOGS) {
+            log_len[logs] = len;
+        }
+        logs++;
+        ret = STATUS_OK;
+    }
+    return ret;
+}
@@ -0,0 +1,44 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#ifndef TEST_KERNEL_STUB_H
+#define TEST_KERNEL_STUB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Debug output capture, for the libshield printf() host tests.
+ *
+ * Each __sys_log() call appends the SVC exchange area content to the captured output,
+ * and records its length.
+ */
+
+void kernel_stub_reset(void);
+
+/** captured debug output, of *len bytes */
+const uint8_t *kernel_stub_output(size_t *len);
+
+/** number of __sys_log() calls */
+uint32_t kernel_stub_logs(void);
+
+/** length of the given __sys_log() call */
+size_t kernel_stub_log_len(uint32_t log);
+
+/** printf() output buffer length (CONFIG_PRINTF_BUF_LEN) */
+extern const size_t kernel_stub_printf_buf_len;
+
+/** true if the debug output is compressed (CONFIG_LOG_LZ) */
+extern const bool kernel_stub_log_lz;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif/*!TEST_KERNEL_STUB_H*/
@@ -0,0 +1,83 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#include <gtest/gtest.h>
+#include <cstring>
+#include <cstdarg>
+#include <string>
+#include <shield/stdio.h>
+
+static int call_vsnprintf(char *dest, size_t len, const char *fmt, ...)
+{
+    va_list ap;
+    int res;
+
+    va_start(ap, fmt);
+    res = shield_vsnprintf(dest, len, fmt, ap);
+    va_end(ap);
+    return res;
+}
+
+TEST(TestPrintf, SnprintfFits) {
+    char buf[32];
+
+    ASSERT_EQ(shield_snprintf(buf, sizeof(buf), "%s %d %x", "foo", 42, 0xbeefU), 11);
+    ASSERT_STREQ(buf, "foo 42 beef");
+}
+
+TEST(TestPrintf, SnprintfTruncate) {
+    char buf[8];
+
+    memset(buf, 0x55, sizeof(buf));
+    /* return value is the untruncated length, output is always null terminated */
+    ASSERT_EQ(shield_snprintf(buf, sizeof(buf), "%s-%d", "abcdef", 1234), 11);
+    ASSERT_STREQ(buf, "abcdef-");
+    ASSERT_EQ(shield_snprintf(buf, 1, "%s", "abcdef"), 6);
+    ASSERT_EQ(buf[0], '\0');
+}
+
+TEST(TestPrintf, SnprintfLengthOnly) {
+    ASSERT_EQ(shield_snprintf(NULL, 0, "%s%s", "abc", "def"), 6);
+}
+
+TEST(TestPrintf, SnprintfLongOutput) {
+    /* longer than the debug output buffer, formatting is made in place */
+    std::string big(600, 'q');
+    char buf[1024];
+
+    ASSERT_EQ(shield_snprintf(buf, sizeof(buf), "<%s>", big.c_str()), 602);
+    ASSERT_EQ(std::string(buf), "<" + big + ">");
+}
+
+TEST(TestPrintf, Vsnprintf) {
+    char buf[16];
+
+    ASSERT_EQ(call_vsnprintf(buf, sizeof(buf), "%c%s%u", 'a', "bc", 123U), 6);
+    ASSERT_STREQ(buf, "abc123");
+    ASSERT_EQ(call_vsnprintf(buf, 4, "%c%s%u", 'a', "bc", 123U), 6);
+    ASSERT_STREQ(buf, "abc");
+}
+
+TEST(TestPrintf, FormatSpec) {
+    char buf[64];
+
+    ASSERT_EQ(shield_snprintf(buf, sizeof(buf), "%05d|%5d|%ld|%lx", -42, -42, -1234567L, 0xabcUL), 24);
+    ASSERT_STREQ(buf, "-0042|  -42|-1234567|abc");
+    ASSERT_EQ(shield_snprintf(buf, sizeof(buf), "%hd|%hhu|%4s|%%", (short)-5, (unsigned char)200, "ab"), 13);
+    ASSERT_STREQ(buf, "-5|200|  ab|%");
+    ASSERT_LT(shield_snprintf(buf, sizeof(buf), "%05s", "ab"), 0);
+    ASSERT_LT(shield_snprintf(buf, sizeof(buf), "%y", 1), 0);
+}
+
+TEST(TestPrintf, Integers64) {
+    char buf[128];
+
+    ASSERT_EQ(shield_snprintf(buf, sizeof(buf), "%llu|%lld|%llx|%llo",
+                              18446744073709551615ULL, (long long)(-9223372036854775807LL - 1),
+                              0xfedcba9876543210ULL, 01777777777777777777777ULL), 81);
+    ASSERT_STREQ(buf, "18446744073709551615|-9223372036854775808|fedcba9876543210|1777777777777777777777");
+    /* inner decimal chunks are zero filled */
+    ASSERT_EQ(shield_snprintf(buf, sizeof(buf), "%llu|%llu", 4294967296ULL, 1000000000000000001ULL), 30);
+    ASSERT_STREQ(buf, "4294967296|1000000000000000001");
+}
@@ -0,0 +1,118 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#include <gtest/gtest.h>
+#include <cerrno>
+#include <cstdarg>
+#include <string>
+#include <shield/stdio.h>
+#include "kernel_stub.h"
+
+/*
+ * printf() family debug output, streamed to the kernel log by buffer-sized chunks
+ * (see src/printf.c), the kernel log being captured by a stub.
+ */
+
+extern "C" int __shield_errno_location(void);
+
+static int call_vprintf(const char *fmt, ...)
+{
+    va_list ap;
+    int res;
+
+    va_start(ap, fmt);
+    res = shield_vprintf(fmt, ap);
+    va_end(ap);
+    return res;
+}
+
+static int call_vdprintf(int fd, const char *fmt, ...)
+{
+    va_list ap;
+    int res;
+
+    va_start(ap, fmt);
+    res = shield_vdprintf(fd, fmt, ap);
+    va_end(ap);
+    return res;
+}
+
+static std::string output(void)
+{
+    size_t len;
+    const uint8_t *out = kernel_stub_output(&len);
+
+    return std::string(reinterpret_cast<const char *>(out), len);
+}
+
+class TestPrintfOutput : public ::testing::Test {
+protected:
+    void SetUp() override {
+        if (kernel_stub_log_lz) {
+            GTEST_SKIP() << "compressed debug output (CONFIG_LOG_LZ)";
+        }
+        kernel_stub_reset();
+    }
+};
+
+TEST_F(TestPrintfOutput, Short) {
+    ASSERT_EQ(shield_printf("%s %d\n", "foo", -42), 8);
+    ASSERT_EQ(kernel_stub_logs(), 1U);
+    ASSERT_EQ(output(), "foo -42\n");
+}
+
+TEST_F(TestPrintfOutput, LongerThanBuffer) {
+    /* neither a multiple of the buffer length, nor formatted in a single directive */
+    const std::string text(3 * kernel_stub_printf_buf_len + 17, 'q');
+    const std::string expected = "<" + text + "|" + std::to_string(123456) + ">";
+    const size_t buf_len = kernel_stub_printf_buf_len;
+    const uint32_t chunks = (expected.size() + buf_len - 1) / buf_len;
+
+    ASSERT_EQ(shield_printf("<%s|%d>", text.c_str(), 123456), (int)expected.size());
+    /* whole output, in buffer-sized chunks */
+    ASSERT_EQ(output(), expected);
+    ASSERT_EQ(kernel_stub_logs(), chunks);
+    for (uint32_t i = 0; i + 1 < chunks; ++i) {
+        EXPECT_EQ(kernel_stub_log_len(i), buf_len) << "chunk " << i;
+    }
+    EXPECT_EQ(kernel_stub_log_len(chunks - 1), expected.size() - ((chunks - 1) * buf_len));
+}
+
+TEST_F(TestPrintfOutput, ExactBufferLength) {
+    const std::string text(2 * kernel_stub_printf_buf_len, 'z');
+
+    ASSERT_EQ(shield_printf("%s", text.c_str()), (int)text.size());
+    ASSERT_EQ(output(), text);
+    /* no empty trailing chunk */
+    ASSERT_EQ(kernel_stub_logs(), 2U);
+    EXPECT_EQ(kernel_stub_log_len(0), kernel_stub_printf_buf_len);
+    EXPECT_EQ(kernel_stub_log_len(1), kernel_stub_printf_buf_len);
+}
+
+TEST_F(TestPrintfOutput, Vprintf) {
+    const std::string text(kernel_stub_printf_buf_len + 1, 'v');
+
+    ASSERT_EQ(call_vprintf("%s%c", text.c_str(), '!'), (int)text.size() + 1);
+    ASSERT_EQ(output(), text + "!");
+    ASSERT_EQ(kernel_stub_logs(), 2U);
+}
+
+TEST_F(TestPrintfOutput, VprintfNullFormat) {
+    ASSERT_EQ(call_vprintf(NULL), -1);
+    ASSERT_EQ(kernel_stub_logs(), 0U);
+}
+
+TEST_F(TestPrintfOutput, VdprintfStdoutStderr) {
+    ASSERT_EQ(call_vdprintf(1, "out %u\n", 1U), 6);
+    ASSERT_EQ(call_vdprintf(2, "err %u\n", 2U), 6);
+    ASSERT_EQ(output(), "out 1\nerr 2\n");
+}
+
+TEST_F(TestPrintfOutput, VdprintfBadFd) {
+    for (int fd : { -1, 0, 3 }) {
+        ASSERT_EQ(call_vdprintf(fd, "lost %d\n", fd), -1);
+        ASSERT_EQ(__shield_errno_location(), EBADF);
+    }
+    ASSERT_EQ(kernel_stub_logs(), 0U);
+}
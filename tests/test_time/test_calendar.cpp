@@ -0,0 +1,81 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#include <gtest/gtest.h>
+#include <ctime>
+#include <cstdint>
+#include <shield/private/calendar.h>
+
+/*
+ * Calendar algorithms are checked against the GNU libc gmtime_r() and timegm()
+ * for every day of the 32 bits unsigned time_t range (1970-01-01 to 2106-02-07),
+ * and the seconds split is checked on every 32 bits value.
+ */
+
+static constexpr uint32_t kLastDay = UINT32_MAX / CALENDAR_SECS_PER_DAY;
+
+TEST(TestCalendar, CivilFromDaysVsGlibc) {
+    for (uint32_t days = 0; days <= kLastDay; ++days) {
+        calendar_date_t date;
+        struct tm ref;
+        time_t t = (time_t)days * CALENDAR_SECS_PER_DAY;
+
+        ASSERT_NE(gmtime_r(&t, &ref), nullptr);
+        __calendar_civil_from_days(days, &date);
+        ASSERT_EQ(date.year, ref.tm_year + 1900) << "days=" << days;
+        ASSERT_EQ(date.month, (uint32_t)ref.tm_mon + 1) << "days=" << days;
+        ASSERT_EQ(date.mday, (uint32_t)ref.tm_mday) << "days=" << days;
+        ASSERT_EQ(date.wday, (uint32_t)ref.tm_wday) << "days=" << days;
+        ASSERT_EQ(date.yday, (uint32_t)ref.tm_yday) << "days=" << days;
+    }
+}
+
+TEST(TestCalendar, DaysFromCivilVsGlibc) {
+    for (uint32_t days = 0; days <= kLastDay; ++days) {
+        struct tm ref;
+        time_t t = (time_t)days * CALENDAR_SECS_PER_DAY;
+
+        ASSERT_NE(gmtime_r(&t, &ref), nullptr);
+        ASSERT_EQ(__calendar_days_from_civil(ref.tm_year + 1900, ref.tm_mon + 1, ref.tm_mday),
+                  (int32_t)days);
+    }
+}
+
+TEST(TestCalendar, DaysFromCivilUnnormalizedMday) {
+    /* out of range mday is linearly added, as timegm() does */
+    struct tm ref = {};
+    ref.tm_year = 2024 - 1900;
+    ref.tm_mon = 1;
+    for (int mday = -800; mday < 800; ++mday) {
+        struct tm tmp = ref;
+        tmp.tm_mday = mday;
+        time_t t = timegm(&tmp);
+        ASSERT_EQ((int64_t)__calendar_days_from_civil(2024, 2, mday) * CALENDAR_SECS_PER_DAY, (int64_t)t);
+    }
+}
+
+TEST(TestCalendar, LeapYears) {
+    ASSERT_EQ(__calendar_is_leap(1970), 0U);
+    ASSERT_EQ(__calendar_is_leap(1972), 1U);
+    ASSERT_EQ(__calendar_is_leap(2000), 1U);
+    ASSERT_EQ(__calendar_is_leap(2100), 0U);
+    ASSERT_EQ(__calendar_is_leap(2104), 1U);
+}
+
+TEST(TestCalendar, SplitSecsExhaustive) {
+    uint32_t secs = 0;
+    bool failed = false;
+
+    /* no gtest assertion in the loop body, as it costs more than the code under test */
+    do {
+        uint32_t days, hour, min, sec;
+        __calendar_split_secs(secs, &days, &hour, &min, &sec);
+        if ((days != secs / 86400U) || (hour != (secs % 86400U) / 3600U) ||
+            (min != (secs % 3600U) / 60U) || (sec != secs % 60U)) {
+            failed = true;
+            break;
+        }
+    } while (++secs != 0);
+    ASSERT_FALSE(failed) << "secs=" << secs;
+}
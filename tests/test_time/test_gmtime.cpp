@@ -0,0 +1,205 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#include <gtest/gtest.h>
+#include <cerrno>
+#include <ctime>
+#include <cstdint>
+#include <cstring>
+#include <random>
+
+/*
+ * gmtime_r(), timegm() and strftime() libshield implementations are checked against
+ * the GNU libc ones.
+ *
+ * shield/time.h can't be included here, as its types collide with the host libc ones.
+ * libshield struct tm is made of the 9 POSIX fields, which are the beginning of the
+ * host struct tm, and time_t have the same size on the host, so the TEST_MODE symbols
+ * are declared here using the host types.
+ */
+extern "C" {
+struct tm *shield_gmtime_r(const time_t *timep, struct tm *result);
+time_t shield_timegm(struct tm *tm);
+size_t shield_strftime(char *s, size_t max, const char *format, const struct tm *tm);
+int __shield_errno_location(void);
+void __shield_set_errno(int val);
+}
+
+static void expect_tm_eq(const struct tm &tm, const struct tm &ref)
+{
+    EXPECT_EQ(tm.tm_sec, ref.tm_sec);
+    EXPECT_EQ(tm.tm_min, ref.tm_min);
+    EXPECT_EQ(tm.tm_hour, ref.tm_hour);
+    EXPECT_EQ(tm.tm_mday, ref.tm_mday);
+    EXPECT_EQ(tm.tm_mon, ref.tm_mon);
+    EXPECT_EQ(tm.tm_year, ref.tm_year);
+    EXPECT_EQ(tm.tm_wday, ref.tm_wday);
+    EXPECT_EQ(tm.tm_yday, ref.tm_yday);
+    EXPECT_EQ(tm.tm_isdst, 0);
+}
+
+TEST(TestGmtime, GmtimeVsGlibc) {
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<uint32_t> dist;
+    const time_t bounds[] = { 0, 59, 86399, 86400, 951782400, 4107542399, UINT32_MAX };
+
+    for (time_t t : bounds) {
+        struct tm tm, ref;
+        ASSERT_NE(gmtime_r(&t, &ref), nullptr);
+        ASSERT_EQ(shield_gmtime_r(&t, &tm), &tm);
+        expect_tm_eq(tm, ref);
+    }
+    for (int i = 0; i < 1000000; ++i) {
+        struct tm tm, ref;
+        time_t t = dist(gen);
+        ASSERT_NE(gmtime_r(&t, &ref), nullptr);
+        ASSERT_EQ(shield_gmtime_r(&t, &tm), &tm);
+        ASSERT_EQ(memcmp(&tm, &ref, offsetof(struct tm, tm_isdst)), 0) << "t=" << t;
+    }
+}
+
+TEST(TestGmtime, GmtimeInvalid) {
+    struct tm tm;
+    time_t t = (time_t)UINT32_MAX + 1;
+
+    __shield_set_errno(0);
+    ASSERT_EQ(shield_gmtime_r(nullptr, &tm), nullptr);
+    ASSERT_EQ(__shield_errno_location(), EINVAL);
+    ASSERT_EQ(shield_gmtime_r(&t, nullptr), nullptr);
+    ASSERT_EQ(__shield_errno_location(), EINVAL);
+    /* time64 is not supported */
+    __shield_set_errno(0);
+    ASSERT_EQ(shield_gmtime_r(&t, &tm), nullptr);
+    ASSERT_EQ(__shield_errno_location(), EOVERFLOW);
+}
+
+TEST(TestGmtime, TimegmVsGlibc) {
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<uint32_t> dist;
+
+    for (int i = 0; i < 1000000; ++i) {
+        struct tm tm, ref;
+        time_t t = dist(gen);
+        ASSERT_NE(gmtime_r(&t, &ref), nullptr);
+        tm = ref;
+        ASSERT_EQ(shield_timegm(&tm), t);
+        ASSERT_EQ(memcmp(&tm, &ref, offsetof(struct tm, tm_isdst)), 0) << "t=" << t;
+    }
+}
+
+TEST(TestGmtime, TimegmNormalize) {
+    /* out of range fields, as generated by date arithmetic */
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> year(1980 - 1900, 2100 - 1900);
+    std::uniform_int_distribution<int> mon(-40, 40);
+    std::uniform_int_distribution<int> mday(-400, 400);
+    std::uniform_int_distribution<int> hms(-5000, 5000);
+
+    for (int i = 0; i < 1000000; ++i) {
+        struct tm tm = {}, ref = {};
+        ref.tm_year = year(gen);
+        ref.tm_mon = mon(gen);
+        ref.tm_mday = mday(gen);
+        ref.tm_hour = hms(gen);
+        ref.tm_min = hms(gen);
+        ref.tm_sec = hms(gen);
+        tm = ref;
+        time_t t = timegm(&ref);
+        ASSERT_EQ(shield_timegm(&tm), t) << "mon=" << tm.tm_mon << " mday=" << tm.tm_mday;
+        ASSERT_EQ(memcmp(&tm, &ref, offsetof(struct tm, tm_isdst)), 0);
+    }
+}
+
+TEST(TestGmtime, TimegmOverflow) {
+    struct tm tm = {};
+    struct tm ref;
+    time_t t = UINT32_MAX;
+
+    /* last representable second, then one second later */
+    ASSERT_NE(gmtime_r(&t, &ref), nullptr);
+    tm = ref;
+    ASSERT_EQ(shield_timegm(&tm), t);
+    tm = ref;
+    tm.tm_sec++;
+    __shield_set_errno(0);
+    ASSERT_EQ(shield_timegm(&tm), (time_t)-1);
+    ASSERT_EQ(__shield_errno_location(), EOVERFLOW);
+
+    /* one second before the epoch */
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year = 70;
+    tm.tm_mday = 1;
+    ASSERT_EQ(shield_timegm(&tm), (time_t)0);
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year = 70;
+    tm.tm_mday = 1;
+    tm.tm_sec = -1;
+    __shield_set_errno(0);
+    ASSERT_EQ(shield_timegm(&tm), (time_t)-1);
+    ASSERT_EQ(__shield_errno_location(), EOVERFLOW);
+
+    /* out of range years, including month carry */
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year = 2300 - 1900;
+    tm.tm_mon = -12 * 330;
+    tm.tm_mday = 1;
+    ASSERT_EQ(shield_timegm(&tm), (time_t)0);
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year = INT32_MAX;
+    tm.tm_mday = 1;
+    __shield_set_errno(0);
+    ASSERT_EQ(shield_timegm(&tm), (time_t)-1);
+    ASSERT_EQ(__shield_errno_location(), EOVERFLOW);
+    __shield_set_errno(0);
+    ASSERT_EQ(shield_timegm(nullptr), (time_t)-1);
+    ASSERT_EQ(__shield_errno_location(), EINVAL);
+}
+
+TEST(TestGmtime, StrftimeVsGlibc) {
+    static const char *formats[] = {
+        "%a %b %d %e %F %H %j %m %M %S %T %y %Y %z %%",
+        "%Y-%m-%dT%H:%M:%S%z",
+        "%a, %d %b %Y %T",
+        "no conversion",
+        "",
+    };
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<uint32_t> dist;
+
+    for (int i = 0; i < 100000; ++i) {
+        struct tm ref;
+        time_t t = dist(gen);
+        ASSERT_NE(gmtime_r(&t, &ref), nullptr);
+        for (const char *fmt : formats) {
+            char buf[128];
+            char refbuf[128];
+            size_t len = strftime(refbuf, sizeof(refbuf), fmt, &ref);
+            memset(buf, 0xa5, sizeof(buf));
+            ASSERT_EQ(shield_strftime(buf, sizeof(buf), fmt, &ref), len);
+            ASSERT_STREQ(buf, refbuf);
+        }
+    }
+}
+
+TEST(TestGmtime, StrftimeTruncate) {
+    struct tm ref;
+    time_t t = 951782400; /* 2000-02-29 */
+    char buf[11];
+
+    ASSERT_NE(gmtime_r(&t, &ref), nullptr);
+    /* the result and its trailing '\0' must fit, 0 is returned otherwise */
+    ASSERT_EQ(shield_strftime(buf, sizeof(buf), "%F", &ref), 10U);
+    ASSERT_STREQ(buf, "2000-02-29");
+    ASSERT_EQ(shield_strftime(buf, 10, "%F", &ref), 0U);
+    ASSERT_EQ(shield_strftime(buf, sizeof(buf), "%F%%", &ref), 0U);
+    ASSERT_EQ(shield_strftime(buf, 1, "", &ref), 0U);
+    ASSERT_EQ(buf[0], '\0');
+    ASSERT_EQ(shield_strftime(buf, 0, "", &ref), 0U);
+    /* glibc names the UTC zone GMT */
+    ASSERT_EQ(shield_strftime(buf, sizeof(buf), "%Z", &ref), 3U);
+    ASSERT_STREQ(buf, "UTC");
+    /* unsupported conversion */
+    ASSERT_EQ(shield_strftime(buf, sizeof(buf), "%c", &ref), 0U);
+    ASSERT_EQ(shield_strftime(buf, sizeof(buf), "%", &ref), 0U);
+}
@@ -0,0 +1,147 @@
+// SPDX-FileCopyrightText: 2024 Ledger SAS
+//
+// SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+#include <gtest/gtest.h>
+#include <random>
+#include <cstdint>
+#include <shield/private/timeconv.h>
+
+/*
+ * The reciprocal multiplications are checked against the exact division:
+ * - exhaustively for the whole 32 bits input range
+ * - on each quotient boundary (q*d - 1, q*d) for the lower and upper parts of
+ *   the 64 bits range, and on random 64 bits values for the others
+ */
+
+static constexpr uint64_t kBoundaries = 1ULL << 22;
+static constexpr size_t kRandomSamples = 1U << 24;
+
+template <typename F>
+static void check_u64_div(F div, uint64_t d)
+{
+    std::mt19937_64 rng(d);
+
+    for (uint64_t q = 1; q < kBoundaries; ++q) {
+        ASSERT_EQ(div(q * d - 1), q - 1);
+        ASSERT_EQ(div(q * d), q);
+    }
+    for (uint64_t q = UINT64_MAX / d; q > (UINT64_MAX / d) - kBoundaries; --q) {
+        ASSERT_EQ(div(q * d - 1), q - 1);
+        ASSERT_EQ(div(q * d), q);
+    }
+    ASSERT_EQ(div(UINT64_MAX), UINT64_MAX / d);
+    for (size_t n = 0; n < kRandomSamples; ++n) {
+        uint64_t x = rng();
+        ASSERT_EQ(div(x), x / d);
+    }
+}
+
+/* reference 128 bits product, a GNU extension (-Wpedantic) */
+__extension__ typedef unsigned __int128 umul128_t;
+
+TEST(TestTimeConv, Umulh64) {
+    std::mt19937_64 rng(42);
+
+    ASSERT_EQ(__time_umulh64(UINT64_MAX, UINT64_MAX), UINT64_MAX - 1);
+    ASSERT_EQ(__time_umulh64(UINT64_MAX, 1), 0ULL);
+    for (size_t n = 0; n < kRandomSamples; ++n) {
+        uint64_t a = rng();
+        uint64_t b = rng();
+        ASSERT_EQ(__time_umulh64(a, b), (uint64_t)(((umul128_t)a * b) >> 64));
+    }
+}
+
+/*
+ * Exhaustive loops don't use ASSERT_* in their body, as gtest assertions cost more
+ * than the code under test. The first failing input is reported instead.
+ */
+template <typename F>
+static bool first_failure_u32(F check, uint32_t *failing)
+{
+    uint32_t x = 0;
+    do {
+        if (!check(x)) {
+            *failing = x;
+            return true;
+        }
+    } while (++x != 0);
+    return false;
+}
+
+TEST(TestTimeConv, Div1000U32Exhaustive) {
+    uint32_t x = 0;
+    ASSERT_FALSE(first_failure_u32([](uint32_t v) { return __time_udiv1000_u32(v) == v / 1000U; }, &x)) << "x=" << x;
+}
+
+TEST(TestTimeConv, Div1000000U32Exhaustive) {
+    uint32_t x = 0;
+    ASSERT_FALSE(first_failure_u32([](uint32_t v) { return __time_udiv1000000_u32(v) == v / 1000000U; }, &x)) << "x=" << x;
+}
+
+TEST(TestTimeConv, Div1000U64) {
+    check_u64_div(__time_udiv1000_u64, 1000ULL);
+}
+
+TEST(TestTimeConv, Div1000000U64) {
+    check_u64_div(__time_udiv1000000_u64, 1000000ULL);
+}
+
+TEST(TestTimeConv, Div1000000000U64) {
+    check_u64_div(__time_udiv1000000000_u64, 1000000000ULL);
+}
+
+TEST(TestTimeConv, Div64LowWordExhaustive) {
+    uint32_t x = 0;
+    ASSERT_FALSE(first_failure_u32([](uint32_t v) {
+        /* v is 32 bits wide: the reference division is the 32 bits one */
+        return (__time_udiv1000_u64(v) == v / 1000U) &&
+               (__time_udiv1000000_u64(v) == v / 1000000U) &&
+               (__time_udiv1000000000_u64(v) == v / 1000000000U);
+    }, &x)) << "x=" << x;
+}
+
+TEST(TestTimeConv, SplitUs) {
+    std::mt19937_64 rng(1);
+    uint64_t sec;
+    uint32_t nsec;
+
+    for (size_t n = 0; n < kRandomSamples; ++n) {
+        uint64_t us = rng();
+        __time_us_to_sec_nsec(us, &sec, &nsec);
+        ASSERT_EQ(sec, us / 1000000ULL);
+        ASSERT_EQ(nsec, (us % 1000000ULL) * 1000ULL);
+    }
+}
+
+TEST(TestTimeConv, SplitNs) {
+    std::mt19937_64 rng(2);
+    uint64_t sec;
+    uint32_t nsec;
+
+    for (size_t n = 0; n < kRandomSamples; ++n) {
+        uint64_t ns = rng();
+        __time_ns_to_sec_nsec(ns, &sec, &nsec);
+        ASSERT_EQ(sec, ns / 1000000000ULL);
+        ASSERT_EQ(nsec, ns % 1000000000ULL);
+    }
+}
+
+TEST(TestTimeConv, SplitMsExhaustive) {
+    uint32_t ms = 0;
+    ASSERT_FALSE(first_failure_u32([](uint32_t v) {
+        uint32_t sec;
+        uint32_t nsec;
+        __time_ms_to_sec_nsec(v, &sec, &nsec);
+        return (sec == v / 1000U) && (nsec == (v % 1000U) * 1000000U);
+    }, &ms)) << "ms=" << ms;
+}
+
+TEST(TestTimeConv, NsecFieldExhaustive) {
+    /* tv_nsec field is always in [0, 10^9[ */
+    uint32_t ns = 0;
+    ASSERT_FALSE(first_failure_u32([](uint32_t v) {
+        return (v >= 1000000000U) ||
+               ((__time_ns_to_ms(v) == v / 1000000U) && (__time_ns_to_us(v) == v / 1000U));
+    }, &ns)) << "ns=" << ns;
+}
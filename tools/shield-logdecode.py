@@ -0,0 +1,227 @@
+#!/usr/bin/env python3
+# SPDX-FileCopyrightText: 2024 Ledger SAS
+# SPDX-License-Identifier: Apache-2.0 OR BSD-3-Clause
+
+"""libshield debug output decoder.
+
+Read the raw debug output of a task (file or stdin) and write the text output,
+expanding:
+ - the binary log frames emitted by shield_log() (libshield built with
+   CONFIG_LOG_BINARY), using the format strings of the task ELF file
+ - the compressed printf() frames (libshield built with CONFIG_LOG_LZ)
+
+Frame formats are described in src/log.c and src/printf.c.
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+ESC = 0x1B
+FRAME_BIN = ord("B")
+FRAME_LZ = ord("Z")
+LZ_MIN_MATCH = 4
+
+FMT_SECTION = "shield_log_fmt"
+
+CONVERSION = re.compile(
+    r"%(?P<flags>[-+ #0]*)(?P<width>\d*)(?P<prec>(?:\.\d*)?)"
+    r"(?P<len>hh|h|ll|l|j|z|t)?(?P<conv>[diouxXcsp%])"
+)
+
+
+class DecodeError(Exception):
+    pass
+
+
+def elf_section(path, name):
+    """Return the content of the given ELF section, and whether the ELF is 64 bits."""
+    with open(path, "rb") as f:
+        elf = f.read()
+    if elf[:4] != b"\x7fELF":
+        raise DecodeError(f"{path}: not an ELF file")
+    is64 = elf[4] == 2
+    endian = "<" if elf[5] == 1 else ">"
+    if is64:
+        shoff, = struct.unpack_from(endian + "Q", elf, 0x28)
+        shentsize, shnum, shstrndx = struct.unpack_from(endian + "HHH", elf, 0x3A)
+        shdr = endian + "IIQQQQIIQQ"
+    else:
+        shoff, = struct.unpack_from(endian + "I", elf, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from(endian + "HHH", elf, 0x2E)
+        shdr = endian + "IIIIIIIIII"
+    sections = [struct.unpack_from(shdr, elf, shoff + i * shentsize) for i in range(shnum)]
+    strtab = sections[shstrndx]
+    for sh_name, sh_type, _, _, sh_offset, sh_size, *_ in sections:
+        start = strtab[4] + sh_name
+        if elf[start:elf.index(b"\0", start)].decode() == name:
+            if sh_type == 8:  # SHT_NOBITS
+                raise DecodeError(f"{path}: {name} section has no content")
+            return elf[sh_offset:sh_offset + sh_size], is64
+    raise DecodeError(f"{path}: no {name} section")
+
+
+class Formatter:
+    """Rebuild shield_log() output from the format strings section."""
+
+    def __init__(self, strings, is64):
+        self.strings = strings
+        self.is64 = is64
+
+    def fmt_string(self, fmt_id):
+        if fmt_id >= len(self.strings):
+            raise DecodeError(f"unknown format string id {fmt_id:#x}")
+        return self.strings[fmt_id:self.strings.index(b"\0", fmt_id)].decode(errors="replace")
+
+    def arg_words(self, length, conv):
+        """Number of words of an argument, its type being promoted as for a variadic call."""
+        if length == "ll":
+            return 2
+        if conv in "sp" or length in ("l", "j", "z", "t"):
+            return 2 if self.is64 else 1
+        return 1
+
+    def format(self, fmt_id, words):
+        fmt = self.fmt_string(fmt_id)
+        pos = 0
+
+        def conversion(m):
+            nonlocal pos
+            conv = m["conv"]
+            if conv == "%":
+                return "%"
+            nwords = self.arg_words(m["len"], conv)
+            if pos + nwords > len(words):
+                raise DecodeError(f"missing arguments for format {fmt!r}")
+            value = 0
+            for i, word in enumerate(words[pos:pos + nwords]):
+                value |= word << (32 * i)
+            pos += nwords
+            bits = 32 * nwords
+            if m["len"] == "hh":
+                value &= 0xFF
+                bits = 8
+            elif m["len"] == "h":
+                value &= 0xFFFF
+                bits = 16
+            spec = "%" + m["flags"] + m["width"]
+            if conv in "di":
+                if value >= 1 << (bits - 1):
+                    value -= 1 << bits
+                return (spec + m["prec"] + "d") % value
+            if conv == "u":
+                return (spec + m["prec"] + "d") % value
+            if conv in "oxX":
+                return (spec + m["prec"] + conv) % value
+            if conv == "c":
+                return (spec + "c") % chr(value & 0xFF)
+            if conv == "p":
+                return (spec + "s") % f"{value:#x}"
+            # strings content is not emitted, only their address
+            return (spec + "s") % f"<str@{value:#x}>"
+
+        return CONVERSION.sub(conversion, fmt)
+
+
+def lz_decode(src, out):
+    """Decode an LZ block, matches referring to the previous output (stream mode)."""
+    ip = 0
+
+    def get_len(length):
+        nonlocal ip
+        while True:
+            b = src[ip]
+            ip += 1
+            length += b
+            if b != 255:
+                return length
+
+    while ip < len(src):
+        token = src[ip]
+        ip += 1
+        litlen = token >> 4
+        if litlen == 15:
+            litlen = get_len(litlen)
+        out += src[ip:ip + litlen]
+        ip += litlen
+        if ip == len(src):
+            break
+        offset = src[ip] | (src[ip + 1] << 8)
+        ip += 2
+        mlen = token & 0xF
+        if mlen == 15:
+            mlen = get_len(mlen)
+        mlen += LZ_MIN_MATCH
+        if offset == 0 or offset > len(out):
+            raise DecodeError("invalid compressed frame")
+        for _ in range(mlen):
+            out.append(out[-offset])
+
+
+def decode(data, formatter, out):
+    lz_history = bytearray()
+    text = bytearray()
+    i = 0
+
+    while i < len(data):
+        if data[i] != ESC or i + 1 == len(data) or data[i + 1] not in (FRAME_BIN, FRAME_LZ):
+            text.append(data[i])
+            i += 1
+            continue
+        # raw text is UTF-8, as the compressed frames content
+        out.write(text.decode(errors="replace"))
+        text.clear()
+        if data[i + 1] == FRAME_LZ:
+            rawlen, clen = data[i + 2], data[i + 3]
+            payload = data[i + 4:i + 4 + clen]
+            i += 4 + clen
+            start = len(lz_history)
+            if clen == rawlen:
+                lz_history += payload
+            else:
+                lz_decode(payload, lz_history)
+            if len(lz_history) - start != rawlen:
+                raise DecodeError("invalid compressed frame length")
+            out.write(lz_history[start:].decode(errors="replace"))
+            continue
+        flen = data[i + 2]
+        payload = data[i + 3:i + 3 + flen]
+        i += 3 + flen
+        off = 0
+        while off < len(payload):
+            nwords = payload[off]
+            fmt_id, = struct.unpack_from("<I", payload, off + 1)
+            words = struct.unpack_from(f"<{nwords}I", payload, off + 5)
+            off += 5 + 4 * nwords
+            if formatter is None:
+                out.write(f"<log {fmt_id:#x} {' '.join(hex(w) for w in words)}>\n")
+            else:
+                out.write(formatter.format(fmt_id, words))
+    out.write(text.decode(errors="replace"))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("-e", "--elf", help="task ELF file, needed for shield_log() output")
+    parser.add_argument("input", nargs="?", help="raw debug output (default: stdin)")
+    args = parser.parse_args()
+
+    formatter = None
+    try:
+        if args.elf:
+            formatter = Formatter(*elf_section(args.elf, FMT_SECTION))
+        if args.input:
+            with open(args.input, "rb") as f:
+                data = f.read()
+        else:
+            data = sys.stdin.buffer.read()
+        decode(data, formatter, sys.stdout)
+    except (DecodeError, OSError) as e:
+        print(f"error: {e}", file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())